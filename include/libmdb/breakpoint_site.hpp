@@ -1,12 +1,20 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <libmdb/expression.hpp>
 #include <libmdb/types.hpp>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace mdb
 {
 class process;
+template <class Stoppoint>
+class stoppoint_collection;
 
 class breakpoint_site
 {
@@ -30,6 +38,17 @@ class breakpoint_site
     return is_hardware_;
   }
   [[nodiscard]]
+  bool uses_debug_register() const
+  {
+    return hardware_register_index_ >= 0;
+  }
+  [[nodiscard]]
+  bool is_pinned() const
+  {
+    return is_pinned_;
+  }
+  void set_pinned(bool pinned);
+  [[nodiscard]]
   bool is_internal() const
   {
     return is_internal_;
@@ -39,6 +58,13 @@ class breakpoint_site
   {
     return is_enabled_;
   }
+  // Whether the trap or debug register is in place, which internal hooks need even while the
+  // user has the site disabled
+  [[nodiscard]]
+  bool is_armed() const
+  {
+    return is_armed_;
+  }
   virt_addr address() const
   {
     return address_;
@@ -54,6 +80,74 @@ class breakpoint_site
     return low <= address_ && address_ < high;
   }
 
+  using hit_action    = std::function<void(breakpoint_site&)>;
+  using hit_action_id = std::uint32_t;
+
+  hit_action_id add_hit_action(hit_action action);
+  void          remove_hit_action(hit_action_id id);
+
+  [[nodiscard]]
+  bool has_hit_actions() const
+  {
+    return !hit_actions_.empty();
+  }
+
+  // Hooks belong to the debugger and run on every arrival, before and regardless of the
+  // user's enable state, condition and counts. A hook returns whether the process should stop.
+  using internal_hook    = std::function<bool(breakpoint_site&)>;
+  using internal_hook_id = std::uint32_t;
+
+  [[nodiscard]]
+  bool has_internal_hooks() const
+  {
+    return std::any_of(begin(internal_hooks_),
+                       end(internal_hooks_),
+                       [](auto& hook) { return static_cast<bool>(hook.second); });
+  }
+
+  [[nodiscard]]
+  bool auto_continues() const
+  {
+    return auto_continue_;
+  }
+  void set_auto_continue(bool auto_continue)
+  {
+    auto_continue_ = auto_continue;
+  }
+
+  const std::optional<expression>& condition() const
+  {
+    return condition_;
+  }
+  void set_condition(std::optional<expression> condition)
+  {
+    condition_ = std::move(condition);
+  }
+
+  std::uint64_t hit_count() const
+  {
+    return hit_count_;
+  }
+  void reset_hit_count()
+  {
+    hit_count_ = 0;
+  }
+
+  std::uint64_t ignore_count() const
+  {
+    return ignore_count_;
+  }
+  void set_ignore_count(std::uint64_t count)
+  {
+    ignore_count_ = count;
+  }
+
+  std::optional<std::uint64_t> hits_until_disable() const
+  {
+    return hits_until_disable_;
+  }
+  void disable_after(std::optional<std::uint64_t> hits);
+
  private:
   breakpoint_site(process&  proc,
                   virt_addr address,
@@ -61,14 +155,46 @@ class breakpoint_site
                   bool      is_internal = false);
 
   friend process;
+  friend stoppoint_collection<breakpoint_site>;
+
+  void run_hit_actions();
+  bool run_internal_hooks();
+  internal_hook_id add_internal_hook(internal_hook hook);
+  void             remove_internal_hook(internal_hook_id id);
+  // Hooked sites change hands between the debugger, which only uses traps, and the user
+  void claim_for_user(bool hardware);
+  void release_user();
+  void set_hardware(bool hardware);
+
+  void arm();
+  void disarm();
+  void install_trap();
+  void remove_trap();
 
   id_type   id_;
   process*  process_;
   virt_addr address_;
   bool      is_enabled_;
+  bool      is_armed_ = false;
   std::byte saved_data_;
   bool      is_hardware_;
   bool      is_internal_;
   int       hardware_register_index_ = -1;
+  bool      is_pinned_               = false;
+  bool      is_degraded_             = false;
+  bool      auto_continue_           = false;
+
+  std::optional<expression>    condition_;
+  std::uint64_t                hit_count_    = 0;
+  std::uint64_t                ignore_count_ = 0;
+  std::optional<std::uint64_t> hits_until_disable_;
+
+  std::vector<std::pair<hit_action_id, hit_action>> hit_actions_;
+  hit_action_id                                     next_hit_action_id_ = 0;
+
+  // Hooks removed while running leave an empty slot, compacted once the run is over
+  std::vector<std::pair<internal_hook_id, internal_hook>> internal_hooks_;
+  internal_hook_id                                        next_internal_hook_id_ = 0;
+  bool                                                    running_hooks_         = false;
 };
 }  // namespace mdb
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <libmdb/breakpoint_site.hpp>
+#include <libmdb/mapped_file.hpp>
+#include <libmdb/types.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace mdb
+{
+class process;
+
+enum class call_event_kind : std::uint32_t
+{
+  entry,
+  exit
+};
+
+struct call_event
+{
+  std::uint64_t                timestamp;
+  pid_t                        tid;
+  std::uint32_t                function_id;
+  call_event_kind              kind;
+  std::uint32_t                padding;
+  std::array<std::uint64_t, 6> args;
+};
+
+struct call_trace_header
+{
+  std::array<char, 8> magic;
+  std::uint32_t       version;
+  std::uint32_t       n_args;
+  std::uint64_t       n_events;
+  std::uint64_t       n_functions;
+  std::uint64_t       function_table_offset;
+};
+
+inline constexpr std::array<char, 8> call_trace_magic   = {'M', 'D', 'B', 'C', 'T', 'R', 'C', 0};
+inline constexpr std::uint32_t       call_trace_version = 1;
+
+class call_tracer
+{
+ public:
+  call_tracer(process& proc, const std::filesystem::path& path, std::size_t n_args = 0);
+  // Only seals the file; finish() must run while the process is alive to take out the hooks
+  ~call_tracer() noexcept;
+
+  call_tracer()                              = delete;
+  call_tracer(const call_tracer&)            = delete;
+  call_tracer& operator=(const call_tracer&) = delete;
+
+  std::uint32_t trace_function(virt_addr entry, std::string_view name);
+
+  std::uint64_t event_count() const
+  {
+    return n_events_;
+  }
+
+  void finish();
+
+ private:
+  struct frame
+  {
+    std::uint32_t function_id;
+    std::uint64_t stack_pointer;
+  };
+
+  struct attached_action
+  {
+    virt_addr                         address;
+    breakpoint_site::internal_hook_id id;
+  };
+
+  void on_entry(std::uint32_t function_id);
+  void on_exit();
+  void watch_return_address(virt_addr address);
+  void attach(virt_addr address, breakpoint_site::internal_hook hook);
+  void write_function_table();
+
+  call_event& append_event(call_event_kind kind, std::uint32_t function_id);
+
+  process*                          process_;
+  std::unique_ptr<mapped_file>      file_;
+  std::size_t                       n_args_;
+  std::uint64_t                     n_events_ = 0;
+  bool                              finished_ = false;
+  std::vector<std::string>          names_;
+  std::vector<frame>                shadow_stack_;
+  std::vector<attached_action>      actions_;
+  std::unordered_set<std::uint64_t> watched_returns_;
+};
+
+class call_trace
+{
+ public:
+  explicit call_trace(const std::filesystem::path& path);
+
+  const call_trace_header& header() const
+  {
+    return header_;
+  }
+
+  span<const call_event> events() const
+  {
+    return events_;
+  }
+
+  const std::vector<std::string>& function_names() const
+  {
+    return names_;
+  }
+
+ private:
+  std::unique_ptr<mapped_file> file_;
+  call_trace_header            header_;
+  span<const call_event>       events_;
+  std::vector<std::string>     names_;
+};
+}  // namespace mdb
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <libmdb/mapped_file.hpp>
+#include <libmdb/types.hpp>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mdb
+{
+class elf;
+
+// The DWARF sections stripped out of a binary, kept in a separate file
+class debug_file
+{
+ public:
+  debug_file()                             = delete;
+  debug_file(const debug_file&)            = delete;
+  debug_file& operator=(const debug_file&) = delete;
+
+  // Tries <dir>/.build-id/xx/yyyy.debug under each debug directory, then the .gnu_debuglink
+  // name next to the binary, in its .debug directory and under each debug directory. Files
+  // found through the build ID must carry the same one; the others must match the link's CRC.
+  static std::unique_ptr<debug_file> find(const elf& obj);
+
+  // Taken from $MDB_DEBUG_FILE_DIRECTORY, a colon-separated list, else /usr/lib/debug
+  static std::vector<std::filesystem::path> directories();
+
+  const std::filesystem::path& path() const
+  {
+    return path_;
+  }
+
+  span<const std::byte> get_section_contents(std::string_view name) const;
+
+ private:
+  static std::unique_ptr<debug_file> open(const std::filesystem::path& path);
+
+  debug_file(std::filesystem::path path, std::unique_ptr<mapped_file> file)
+      : path_(std::move(path)), file_(std::move(file))
+  {
+  }
+
+  std::filesystem::path                                       path_;
+  std::unique_ptr<mapped_file>                                file_;
+  std::unordered_map<std::string_view, span<const std::byte>> sections_;
+};
+}  // namespace mdb
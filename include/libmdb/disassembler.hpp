@@ -19,6 +19,51 @@ class disassembler
   std::vector<instruction> disassemble(std::size_t              n_instructions,
                                        std::optional<virt_addr> address = std::nullopt);
 
+  struct instruction_extent
+  {
+    virt_addr   address;
+    std::size_t length;
+    bool        is_position_dependent;
+    bool        is_call;
+  };
+
+  std::vector<instruction_extent> decode_extents(virt_addr address, std::size_t min_bytes);
+
+  // Targets of the direct jumps and calls decoded linearly from [low, high)
+  std::vector<virt_addr> find_branch_targets(virt_addr low, virt_addr high);
+
+  enum class segment
+  {
+    none,
+    fs,
+    gs
+  };
+
+  // Address is segment base + base + index * scale + displacement; rip-relative operands are
+  // folded into the displacement, pushes land at the rsp left behind by the instruction
+  struct memory_write
+  {
+    std::optional<register_id> base;
+    std::optional<register_id> index;
+    std::uint8_t               scale;
+    std::int64_t               displacement;
+    std::size_t                size;
+    segment                    segment_base;
+    bool                       is_stack_push;
+  };
+
+  // Writes to x87, MMX and SSE state are flagged rather than listed; system calls write
+  // wherever the kernel pleases and are flagged too
+  struct write_decoding
+  {
+    std::size_t               length;
+    std::vector<memory_write> writes;
+    bool                      writes_fprs;
+    bool                      is_syscall;
+  };
+
+  write_decoding decode_memory_writes(virt_addr address);
+
  private:
   process* process_;
 };
@@ -148,6 +148,15 @@ class dwarf
     return elf_;
   }
 
+  span<const std::byte> debug_info() const
+  {
+    return debug_info_;
+  }
+  span<const std::byte> debug_str() const
+  {
+    return debug_str_;
+  }
+
   const std::unordered_map<std::uint64_t, abbrev>& get_abbrev_table(std::size_t offset);
 
   const std::vector<std::unique_ptr<compile_unit>>& compile_units() const
@@ -157,6 +166,8 @@ class dwarf
 
  private:
   const elf*                                                                 elf_;
+  span<const std::byte>                                                      debug_info_;
+  span<const std::byte>                                                      debug_str_;
   std::unordered_map<std::size_t, std::unordered_map<std::uint64_t, abbrev>> abbrev_tables_;
   std::vector<std::unique_ptr<compile_unit>>                                 compile_units_;
 };
@@ -2,15 +2,22 @@
 
 #include <elf.h>
 
+#include <cstdint>
 #include <filesystem>
+#include <libmdb/mapped_file.hpp>
 #include <libmdb/types.hpp>
-#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace mdb
 {
+class debug_file;
+
 class elf
 {
  public:
@@ -32,10 +39,35 @@ class elf
 
   void parse_symbol_table();
 
+  // Descriptor of the NT_GNU_BUILD_ID note, empty when the binary has none
+  span<const std::byte> build_id() const
+  {
+    return build_id_;
+  }
+  // The build ID in lowercase hex, as used in .build-id paths
+  std::string                  build_id_string() const;
+  static span<const std::byte> find_build_id(span<const std::byte> notes);
+
+  // Symbol indexes of binaries with a build ID are kept here between runs: $MDB_CACHE_DIR,
+  // else $XDG_CACHE_HOME/mdb, else ~/.cache/mdb. Setting MDB_CACHE_DIR empty disables the cache.
+  static std::filesystem::path index_cache_directory();
+
+  bool index_loaded_from_cache() const
+  {
+    return index_cache_ != nullptr;
+  }
+
   std::optional<const Elf64_Shdr*> get_section(std::string_view name) const;
 
   span<const std::byte> get_section_contents(std::string_view name) const;
 
+  // A DWARF section from this file or, when it has been stripped, from the separate debug file.
+  // That file is only searched for and mapped by the first call that needs it.
+  span<const std::byte> get_debug_section_contents(std::string_view name) const;
+
+  // Empty until a DWARF lookup has loaded a separate debug file
+  std::filesystem::path debug_file_path() const;
+
   std::string_view get_string(std::size_t index) const;
 
   std::string_view get_section_name(std::size_t index) const;
@@ -51,7 +83,21 @@ class elf
 
   const Elf64_Shdr* get_section_containing_address(virt_addr addr) const;
 
+  // Names that miss every mangled name are looked up among the demangled ones
   std::vector<const Elf64_Sym*> get_symbols_by_name(std::string_view name) const;
+  // The two halves of the above. Only the demangled lookup can wait on the background index.
+  std::vector<const Elf64_Sym*> get_symbols_by_raw_name(std::string_view name) const;
+  std::vector<const Elf64_Sym*> get_symbols_by_demangled_name(std::string_view name) const;
+
+  std::string get_demangled_name(const Elf64_Sym& symbol) const;
+
+  // Both search distinct mangled and demangled names and return them sorted. The names are
+  // demangled and sorted in the background from the moment the file is loaded; a search that
+  // comes in before that is done waits for it.
+  std::vector<std::string_view> find_symbol_names_with_prefix(std::string_view prefix,
+                                                              std::size_t      max_results) const;
+  std::vector<std::string_view> find_symbol_names_containing(std::string_view text,
+                                                             std::size_t      max_results) const;
 
   std::optional<const Elf64_Sym*> get_symbol_at_address(file_addr addr) const;
 
@@ -61,34 +107,128 @@ class elf
 
   std::optional<const Elf64_Sym*> get_symbol_containing_address(virt_addr addr) const;
 
+  // Resolves many addresses at once, walking forward through runs of ascending addresses
+  std::vector<std::optional<const Elf64_Sym*>> symbolize(span<const virt_addr> addresses) const;
+
   void notify_loaded(virt_addr address)
   {
     load_bias_ = address;
   }
 
+  // Lowest loaded address and one past the highest, covering every allocated section
+  std::pair<virt_addr, virt_addr> loaded_range() const;
+
  private:
   void parse_section_headers();
   void build_section_map();
+  void build_section_index();
+  void read_build_id();
   void build_symbol_maps();
+  void build_demangled_name_map() const;
+  void build_name_search_index() const;
+  void build_name_indexes() const;
+  void ensure_name_indexes() const;
 
-  struct range_comparator
+  bool attach_index(span<const std::byte> image, bool is_complete) const;
+  bool load_index_cache();
+  void write_index_cache() const;
+
+  bool has_hash_table() const
   {
-    bool operator()(std::pair<file_addr, file_addr> lhs, std::pair<file_addr, file_addr> rhs) const
+    return gnu_hash_.size() != 0 or sysv_hash_.size() != 0;
+  }
+  std::vector<const Elf64_Sym*> find_in_hash_table(std::string_view name) const;
+
+  std::size_t                     symbols_starting_at_or_before(std::uint64_t addr) const;
+  std::optional<const Elf64_Sym*> symbol_containing(std::uint64_t addr, std::size_t rank) const;
+
+  std::unique_ptr<mapped_file>                            file_;
+  std::filesystem::path                                   path_;
+  std::size_t                                             file_size_;
+  std::byte*                                              data_;
+  Elf64_Ehdr                                              header_;
+  span<const Elf64_Shdr>                                  section_headers_;
+  std::unordered_map<std::string_view, const Elf64_Shdr*> section_map_;
+  std::vector<std::uint64_t>                              section_starts_;
+  std::vector<const Elf64_Shdr*>                          sections_by_address_;
+  span<const std::byte>                                   string_table_;
+  span<const std::byte>                                   build_id_;
+  virt_addr                                               load_bias_;
+  span<const Elf64_Sym>                                   symbol_table_;
+  span<const std::byte>                                   gnu_hash_;
+  span<const std::byte>                                   sysv_hash_;
+
+  // The indexes below view either images built in memory or a mapped cache file.
+  mutable std::vector<std::byte> index_image_;
+  mutable std::vector<std::byte> demangled_image_;
+  mutable std::vector<std::byte> search_image_;
+  std::unique_ptr<mapped_file>   index_cache_;
+
+  // Address ranges sorted by start, one symbol per start. The starts are repeated in
+  // Eytzinger (breadth-first) order, with each slot's sorted rank, for cache-friendly search.
+  mutable span<const std::uint64_t> symbol_starts_;
+  mutable span<const std::uint64_t> symbol_ends_;
+  mutable span<const std::uint32_t> symbol_indices_;
+  mutable span<const std::uint64_t> eytzinger_starts_;
+  mutable span<const std::uint32_t> eytzinger_ranks_;
+
+  // Open-addressed hash tables keyed on the GNU hash of each name. Slots hold an entry
+  // index plus one, or zero when empty. Binaries with their own hash table skip the first.
+  mutable span<const std::uint32_t> name_slots_;
+
+  mutable bool                      has_demangled_names_ = false;
+  mutable span<const std::uint32_t> demangled_symbols_;
+  mutable span<const std::uint32_t> demangled_offsets_;
+  mutable span<const std::uint32_t> demangled_slots_;
+  mutable span<const char>          demangled_names_;
+
+  mutable std::once_flag              debug_file_once_;
+  mutable std::unique_ptr<debug_file> debug_file_;
+
+  // Sorted names packed back to back, each null-terminated, with the offset of each one
+  mutable bool                      has_search_index_ = false;
+  mutable span<const char>          search_names_;
+  mutable span<const std::uint32_t> search_offsets_;
+
+  // The demangled names and search index are built by the first query that needs them
+  mutable std::once_flag name_indexes_once_;
+};
+
+// Objects loaded into one address space, indexed by the address range each one covers.
+// Objects must have their load bias set before they are pushed.
+class elf_collection
+{
+ public:
+  elf_collection()                                 = default;
+  elf_collection(const elf_collection&)            = delete;
+  elf_collection& operator=(const elf_collection&) = delete;
+
+  elf& push(std::unique_ptr<elf> obj);
+  void remove(const elf& obj);
+
+  template <class F>
+  void for_each(F f) const
+  {
+    for (auto& obj : elves_)
     {
-      return lhs.first < rhs.first;
+      f(static_cast<const elf&>(*obj));
     }
-  };
-
-  int                                                                     fd_;
-  std::filesystem::path                                                   path_;
-  std::size_t                                                             file_size_;
-  std::byte*                                                              data_;
-  Elf64_Ehdr                                                              header_;
-  std::vector<Elf64_Shdr>                                                 section_headers_;
-  std::unordered_map<std::string_view, Elf64_Shdr*>                       section_map_;
-  virt_addr                                                               load_bias_;
-  std::vector<Elf64_Sym>                                                  symbol_table_;
-  std::unordered_multimap<std::string_view, Elf64_Sym*>                   symbol_name_map_;
-  std::map<std::pair<file_addr, file_addr>, Elf64_Sym*, range_comparator> symbol_addr_map_;
+  }
+
+  std::size_t size() const
+  {
+    return elves_.size();
+  }
+
+  const elf* get_elf_containing_address(virt_addr address) const;
+  const elf* get_elf_by_path(const std::filesystem::path& path) const;
+
+ private:
+  void build_range_index();
+
+  std::vector<std::unique_ptr<elf>> elves_;
+  std::vector<std::uint64_t>        range_starts_;
+  std::vector<std::uint64_t>        range_ends_;
+  std::vector<const elf*>           range_elves_;
 };
 }  // namespace mdb
\ No newline at end of file
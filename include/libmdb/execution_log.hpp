@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <libmdb/disassembler.hpp>
+#include <libmdb/process.hpp>
+#include <libmdb/types.hpp>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mdb
+{
+// Undo log of everything the inferior does while stepping forward under it. Reverse
+// execution rewinds registers and memory from the log instead of re-executing; going
+// forward again after a rewind re-executes and drops the rewound part of the history.
+// FPRs are saved before each instruction that writes them, which leaves out the upper halves
+// of AVX registers. What a system call writes is unknown, so history before one is out of reach.
+class execution_log
+{
+ public:
+  execution_log()                                = delete;
+  execution_log(const execution_log&)            = delete;
+  execution_log& operator=(const execution_log&) = delete;
+
+  static constexpr std::uint64_t default_snapshot_interval = 4096;
+
+  explicit execution_log(process&      proc,
+                         std::uint64_t snapshot_interval = default_snapshot_interval);
+
+  stop_reason step();
+  stop_reason resume();
+
+  stop_reason reverse_step();
+  stop_reason reverse_continue();
+
+  std::uint64_t size() const
+  {
+    return pcs_.size();
+  }
+  std::size_t memory_usage() const;
+
+  // Set when the last reverse_continue stopped at a write to a watched range
+  std::optional<watchpoint::id_type> last_watchpoint() const
+  {
+    return last_watchpoint_;
+  }
+
+ private:
+  step_result record(std::uint64_t max_steps);
+  void        observe(const user_regs_struct& regs);
+  void        commit(const user_regs_struct& regs);
+  stop_reason rewind_to(std::uint64_t position, trap_type trap_reason);
+
+  struct write_header
+  {
+    std::uint64_t address;
+    std::uint64_t size;
+  };
+
+  process*                                                         process_;
+  std::uint64_t                                                    snapshot_interval_;
+  std::unordered_map<std::uint64_t, disassembler::write_decoding> decodings_;
+
+  std::optional<user_regs_struct>   pending_regs_;
+  std::vector<std::byte>            pending_writes_;
+  std::optional<user_fpregs_struct> pending_fprs_;
+  bool                              pending_syscall_ = false;
+
+  std::vector<std::uint64_t>    pcs_;
+  std::vector<std::size_t>      register_offsets_;
+  std::vector<std::size_t>      memory_offsets_;
+  std::vector<std::uint64_t>    register_undo_;
+  std::vector<std::byte>        memory_undo_;
+  std::vector<user_regs_struct> snapshots_;
+
+  // Indexed by the record of the instruction that changed them
+  std::vector<std::pair<std::uint64_t, user_fpregs_struct>> fpr_undo_;
+  std::vector<std::uint64_t>                                syscalls_;
+
+  std::optional<watchpoint::id_type> last_watchpoint_;
+};
+}  // namespace mdb
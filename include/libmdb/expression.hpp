@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mdb
+{
+class process;
+
+class expression
+{
+ public:
+  static expression compile(std::string_view text);
+
+  std::uint64_t evaluate(const process& proc) const;
+
+  const std::string& text() const
+  {
+    return text_;
+  }
+
+  static constexpr std::size_t max_stack_depth = 32;
+
+ private:
+  class parser;
+
+  enum class opcode : std::uint8_t
+  {
+    constant,
+    read_register,
+    load,
+    negate,
+    bit_not,
+    logical_not,
+    to_bool,
+    add,
+    subtract,
+    multiply,
+    divide,
+    modulo,
+    bit_and,
+    bit_or,
+    bit_xor,
+    shift_left,
+    shift_right,
+    equal,
+    not_equal,
+    less,
+    less_equal,
+    greater,
+    greater_equal,
+    // Short-circuit jumps: operand is the index of the first
+    // instruction after the right-hand side
+    logical_and,
+    logical_or,
+  };
+
+  struct instruction
+  {
+    opcode        op;
+    std::uint8_t  size;
+    std::uint64_t operand;
+  };
+
+  expression(std::string text, std::vector<instruction> code)
+      : text_(std::move(text)), code_(std::move(code))
+  {
+  }
+
+  std::uint64_t apply(opcode op, std::uint64_t lhs, std::uint64_t rhs) const;
+
+  std::string              text_;
+  std::vector<instruction> code_;
+};
+}  // namespace mdb
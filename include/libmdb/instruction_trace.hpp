@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <libmdb/disassembler.hpp>
+#include <libmdb/mapped_file.hpp>
+#include <libmdb/process.hpp>
+#include <libmdb/register_info.hpp>
+#include <libmdb/types.hpp>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace mdb
+{
+struct trace_options
+{
+  std::size_t              ring_size      = 64 << 20;
+  std::uint64_t            index_interval = 4096;
+  std::vector<register_id> registers      = {register_id::rax,
+                                             register_id::rbx,
+                                             register_id::rcx,
+                                             register_id::rdx,
+                                             register_id::rsi,
+                                             register_id::rdi,
+                                             register_id::rbp,
+                                             register_id::rsp};
+};
+
+struct traced_write
+{
+  virt_addr              address;
+  std::vector<std::byte> data;
+};
+
+struct trace_entry
+{
+  std::uint64_t              instruction;
+  virt_addr                  pc;
+  std::vector<std::uint64_t> registers;
+  std::vector<traced_write>  writes;
+};
+
+class trace_recorder
+{
+ public:
+  trace_recorder()                                 = delete;
+  trace_recorder(const trace_recorder&)            = delete;
+  trace_recorder& operator=(const trace_recorder&) = delete;
+
+  trace_recorder(process& proc, const std::filesystem::path& path, trace_options options = {});
+
+  step_result record(std::uint64_t max_steps, std::optional<virt_addr> until = std::nullopt);
+
+  std::uint64_t instructions() const;
+  std::uint64_t bytes_written() const;
+
+ private:
+  void observe(const user_regs_struct& regs);
+  void append(const user_regs_struct& before, const user_regs_struct& after);
+  void write_bytes(const std::byte* data, std::size_t size);
+
+  process*                                                         process_;
+  trace_options                                                    options_;
+  std::unique_ptr<mapped_file>                                     file_;
+  std::unordered_map<std::uint64_t, disassembler::write_decoding> decodings_;
+  std::optional<user_regs_struct>                                  previous_;
+  std::uint64_t                                                    last_pc_    = 0;
+  std::uint64_t                                                    last_write_ = 0;
+  std::vector<std::uint64_t>                                       last_registers_;
+  std::vector<std::byte>                                           scratch_;
+};
+
+class trace_reader
+{
+ public:
+  trace_reader()                               = delete;
+  trace_reader(const trace_reader&)            = delete;
+  trace_reader& operator=(const trace_reader&) = delete;
+
+  explicit trace_reader(const std::filesystem::path& path);
+
+  const std::vector<register_id>& registers() const
+  {
+    return registers_;
+  }
+
+  // Instructions older than the oldest surviving keyframe have been overwritten by the ring
+  std::uint64_t first_instruction() const;
+  std::uint64_t end_instruction() const;
+
+  void                       seek(std::uint64_t instruction);
+  std::optional<trace_entry> next();
+
+ private:
+  std::uint64_t read_varint();
+  std::uint64_t oldest_offset() const;
+
+  std::unique_ptr<mapped_file> file_;
+  std::vector<register_id>     registers_;
+  std::uint64_t                offset_      = 0;
+  std::uint64_t                instruction_ = 0;
+  std::uint64_t                last_pc_     = 0;
+  std::uint64_t                last_write_  = 0;
+  std::vector<std::uint64_t>   last_registers_;
+};
+}  // namespace mdb
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <libmdb/expression.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mdb
+{
+class process;
+
+class log_sink
+{
+ public:
+  explicit log_sink(int fd = STDOUT_FILENO);
+  ~log_sink();
+
+  log_sink(const log_sink&)            = delete;
+  log_sink& operator=(const log_sink&) = delete;
+
+  int output() const
+  {
+    return fd_;
+  }
+  void set_output(int fd);
+
+  void append(std::string_view text);
+  void append_integer(std::uint64_t value, int base, bool is_signed = false);
+  void flush();
+
+  static constexpr std::size_t capacity = 64 * 1024;
+
+ private:
+  int                     fd_;
+  std::unique_ptr<char[]> buffer_;
+  std::size_t             used_ = 0;
+};
+
+class logpoint
+{
+ public:
+  static logpoint compile(std::string_view format, const std::vector<std::string>& arguments);
+
+  void log(const process& proc, log_sink& sink) const;
+
+  const std::string& format() const
+  {
+    return format_;
+  }
+
+ private:
+  enum class conversion
+  {
+    none,
+    unsigned_decimal,
+    signed_decimal,
+    hex,
+    prefixed_hex
+  };
+
+  struct segment
+  {
+    std::size_t literal_offset;
+    std::size_t literal_size;
+    conversion  conv;
+  };
+
+  logpoint(std::string             format,
+           std::string             literals,
+           std::vector<segment>    segments,
+           std::vector<expression> arguments)
+      : format_(std::move(format)),
+        literals_(std::move(literals)),
+        segments_(std::move(segments)),
+        arguments_(std::move(arguments))
+  {
+  }
+
+  std::string             format_;
+  std::string             literals_;
+  std::vector<segment>    segments_;
+  std::vector<expression> arguments_;
+};
+}  // namespace mdb
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <libmdb/types.hpp>
+#include <memory>
+
+namespace mdb
+{
+class mapped_file
+{
+ public:
+  static std::unique_ptr<mapped_file> create(const std::filesystem::path& path, std::size_t size);
+  static std::unique_ptr<mapped_file> open(const std::filesystem::path& path);
+
+  mapped_file()                              = delete;
+  mapped_file(const mapped_file&)            = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+  ~mapped_file();
+
+  std::byte* data()
+  {
+    return data_;
+  }
+  const std::byte* data() const
+  {
+    return data_;
+  }
+  std::size_t size() const
+  {
+    return size_;
+  }
+  bool is_writable() const
+  {
+    return writable_;
+  }
+
+  span<const std::byte> contents() const
+  {
+    return {data_, size_};
+  }
+
+  void resize(std::size_t size);
+
+ private:
+  mapped_file(int fd, std::byte* data, std::size_t size, bool writable)
+      : fd_(fd), data_(data), size_(size), writable_(writable)
+  {
+  }
+
+  int         fd_;
+  std::byte*  data_;
+  std::size_t size_;
+  bool        writable_;
+};
+}  // namespace mdb
@@ -3,15 +3,23 @@
 
 #include <sys/types.h>
 
+#include <array>
+#include <chrono>
 #include <filesystem>
+#include <functional>
 #include <libmdb/bit.hpp>
 #include <libmdb/breakpoint_site.hpp>
+#include <libmdb/logpoint.hpp>
+#include <libmdb/region_watch.hpp>
 #include <libmdb/registers.hpp>
 #include <libmdb/stoppoint_collection.hpp>
+#include <libmdb/tracepoint.hpp>
 #include <libmdb/watchpoint.hpp>
+#include <map>
 #include <memory>
 #include <optional>
 #include <unordered_map>
+#include <variant>
 #include <vector>
 
 namespace mdb
@@ -29,6 +37,7 @@ enum class trap_type
   single_step,
   software_break,
   hardware_break,
+  software_watch,
   syscall,
   unknown
 };
@@ -54,6 +63,20 @@ struct stop_reason
   std::optional<syscall_information> syscall_info;
 };
 
+struct step_result
+{
+  stop_reason              reason;
+  std::uint64_t            steps;
+  std::chrono::nanoseconds elapsed;
+
+  double steps_per_second() const
+  {
+    return elapsed.count() == 0
+               ? 0
+               : static_cast<double>(steps) * 1e9 / static_cast<double>(elapsed.count());
+  }
+};
+
 class syscall_catch_policy
 {
  public:
@@ -98,6 +121,24 @@ class syscall_catch_policy
   std::vector<int> to_catch_;
 };
 
+// A stopped copy of the inferior made by fork, parked until it is restored
+struct checkpoint
+{
+  using id_type = std::int32_t;
+
+  id_type            id;
+  pid_t              pid;
+  user_regs_struct   regs;
+  user_fpregs_struct fprs;
+  // What the copy has in memory but the live process may since have changed
+  std::vector<std::byte>                       code_at_pc;
+  std::vector<std::pair<virt_addr, std::byte>> traps;
+  std::map<std::uint64_t, int>                 page_protections;
+  std::map<std::uint64_t, int>                 original_protections;
+};
+
+class execution_log;
+
 class process
 {
  public:
@@ -110,16 +151,69 @@ class process
   void             resume();
   stop_reason      wait_on_signal();
   mdb::stop_reason step_instruction();
+  mdb::stop_reason step_over();
+  mdb::stop_reason step_out();
+  // The observer sees the registers before the first step and after every step taken
+  using step_observer = std::function<void(const user_regs_struct&)>;
+  step_result step_instructions(std::uint64_t            max_steps,
+                                std::optional<virt_addr> until    = std::nullopt,
+                                const step_observer&     observer = {});
 
   process()                          = delete;
   process(const process&)            = delete;
   process& operator=(const process&) = delete;
 
-  breakpoint_site& create_breakpoint_site(virt_addr address,
-                                          bool      hardware = false,
-                                          bool      internal = false);
+  // A site the debugger already hooks at the address is taken over rather than duplicated
+  breakpoint_site& create_breakpoint_site(virt_addr address, bool hardware = false);
+
+  // Hooks share the site of any user breakpoint at the address. The site goes with its last
+  // hook unless the user holds it, after the hooks have run if one of them removed it.
+  breakpoint_site::internal_hook_id add_internal_hook(virt_addr                      address,
+                                                      breakpoint_site::internal_hook hook);
+  void remove_internal_hook(virt_addr address, breakpoint_site::internal_hook_id id);
+
+  breakpoint_site& create_logpoint(virt_addr address, logpoint point);
+
+  watchpoint& create_watchpoint(virt_addr      address,
+                                stoppoint_mode mode,
+                                std::size_t    size,
+                                bool           hardware = true);
+
+  // Without the bounds of the function around the address, branches into the patch cannot
+  // be ruled out, so only a single instruction may be patched
+  tracepoint& create_tracepoint(virt_addr                                address,
+                                std::optional<tracepoint::address_range> function = std::nullopt);
+
+  stoppoint_collection<tracepoint>& tracepoints()
+  {
+    return tracepoints_;
+  }
+
+  [[nodiscard]] const stoppoint_collection<tracepoint>& tracepoints() const
+  {
+    return tracepoints_;
+  }
+
+  tracepoint_buffer& get_tracepoint_buffer();
+
+  region_watch& create_region_watch(virt_addr address, std::size_t size);
+
+  stoppoint_collection<region_watch>& region_watches()
+  {
+    return region_watches_;
+  }
+
+  [[nodiscard]] const stoppoint_collection<region_watch>& region_watches() const
+  {
+    return region_watches_;
+  }
 
-  watchpoint& create_watchpoint(virt_addr address, stoppoint_mode mode, std::size_t size);
+  template <class... Args>
+  std::int64_t inject_syscall(std::uint64_t number, Args... args)
+  {
+    static_assert(sizeof...(Args) <= 6, "Syscalls take at most six arguments");
+    return inject_syscall_with(number, {static_cast<std::uint64_t>(args)...});
+  }
 
   stoppoint_collection<watchpoint>& watchpoints()
   {
@@ -132,10 +226,14 @@ class process
   }
 
   [[nodiscard]] std::vector<std::byte> read_memory(virt_addr address, std::size_t amount) const;
+  void read_memory_into(virt_addr address, span<std::byte> into) const;
   [[nodiscard]] std::vector<std::byte> read_memory_without_traps(virt_addr   address,
                                                                  std::size_t amount) const;
 
   void write_memory(virt_addr address, span<const std::byte> data);
+  // Writes many regions with few system calls; only pages the process cannot write, such as
+  // code, fall back to ptrace
+  void write_memory_regions(span<const std::pair<virt_addr, span<const std::byte>>> regions);
 
   template <class T>
   T read_memory_as(virt_addr address) const
@@ -164,6 +262,9 @@ class process
 
   void write_user_area(std::size_t offset, std::uint64_t data);
 
+  // Reads the FPRs straight from the inferior, leaving the register cache alone
+  [[nodiscard]] user_fpregs_struct read_fprs() const;
+
   void write_fprs(const user_fpregs_struct& fprs);
   void write_gprs(const user_regs_struct& fprs);
 
@@ -198,6 +299,11 @@ class process
   [[nodiscard]] std::variant<breakpoint_site::id_type, watchpoint::id_type>
   get_current_hardware_stoppoint() const;
 
+  [[nodiscard]] watchpoint::id_type get_current_software_watchpoint() const
+  {
+    return current_software_watchpoint_;
+  }
+
   void set_syscall_catch_policy(syscall_catch_policy info)
   {
     syscall_catch_policy_ = std::move(info);
@@ -205,6 +311,20 @@ class process
 
   [[nodiscard]] std::unordered_map<int, std::uint64_t> get_auxv() const;
 
+  checkpoint::id_type create_checkpoint();
+  void                restore_checkpoint(checkpoint::id_type id);
+  void                delete_checkpoint(checkpoint::id_type id);
+
+  [[nodiscard]] const std::vector<checkpoint>& checkpoints() const
+  {
+    return checkpoints_;
+  }
+
+  log_sink& get_log_sink()
+  {
+    return log_sink_;
+  }
+
  private:
   process(pid_t pid, bool terminate_on_end, bool is_attached)
       : pid_(pid),
@@ -216,11 +336,42 @@ class process
 
   int set_hardware_stoppoint(virt_addr address, stoppoint_mode mode, std::size_t size);
 
+  std::int64_t inject_syscall_with(std::uint64_t number, const std::array<std::uint64_t, 6>& args);
+  pid_t        fork_stopped_copy();
+
+  stop_reason run_to_return(virt_addr return_address, std::uint64_t caller_rsp);
+
   void read_all_registers();
+  void read_memory_with_ptrace(virt_addr address, span<std::byte> into) const;
 
   void augment_stop_reason(stop_reason& reason);
 
-  mdb::stop_reason maybe_resume_from_syscall(const stop_reason& reason);
+  friend breakpoint_site;
+  friend watchpoint;
+  friend region_watch;
+  friend execution_log;
+
+  void collect_dirty_pages();
+
+  using hardware_stoppoint = std::variant<breakpoint_site*, watchpoint*>;
+
+  void schedule_hardware_stoppoints(std::optional<hardware_stoppoint> enabling = std::nullopt);
+  void release_hardware_stoppoint(hardware_stoppoint stoppoint);
+  template <class Stoppoint>
+  void move_to_debug_register(Stoppoint& point);
+  template <class Stoppoint>
+  void move_to_trap(Stoppoint& point);
+
+  void protect_watched_pages(const watchpoint& point);
+  void unprotect_watched_pages(const watchpoint& point);
+  void apply_page_protection(std::uint64_t first_page, std::uint64_t last_page);
+  bool should_resume_from_fault(stop_reason& reason);
+
+  bool should_resume_internally(const stop_reason& reason);
+  bool should_stop_at_breakpoint(breakpoint_site& site);
+  // Sorted addresses of the enabled breakpoint sites
+  std::vector<std::uint64_t> enabled_site_addresses() const;
+  bool should_stop_at_syscall(const syscall_information& info) const;
 
   pid_t                                 pid_              = 0;
   bool                                  terminate_on_end_ = true;
@@ -229,8 +380,27 @@ class process
   std::unique_ptr<registers>            registers_;
   stoppoint_collection<breakpoint_site> breakpoint_sites_;
   stoppoint_collection<watchpoint>      watchpoints_;
+  stoppoint_collection<tracepoint>      tracepoints_;
+  std::unique_ptr<tracepoint_buffer>    tracepoint_buffer_;
+  stoppoint_collection<region_watch>    region_watches_;
+
+  std::array<std::optional<hardware_stoppoint>, 4> debug_register_owners_;
+
+  struct protected_page
+  {
+    int         original_protection;
+    int         applied_protection;
+    std::size_t write_watches  = 0;
+    std::size_t access_watches = 0;
+  };
+  std::map<std::uint64_t, protected_page> protected_pages_;
+  watchpoint::id_type                     current_software_watchpoint_ = 0;
+  bool                                    stepping_                    = false;
   syscall_catch_policy                  syscall_catch_policy_ = syscall_catch_policy::catch_none();
   bool                                  expecting_syscall_exit_ = false;
+  log_sink                              log_sink_;
+  std::vector<checkpoint>               checkpoints_;
+  checkpoint::id_type                   next_checkpoint_id_ = 1;
 };
 }  // namespace mdb
 
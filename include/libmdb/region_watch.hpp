@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <libmdb/types.hpp>
+#include <vector>
+
+namespace mdb
+{
+class process;
+
+struct memory_change
+{
+  virt_addr              address;
+  std::vector<std::byte> old_data;
+  std::vector<std::byte> new_data;
+};
+
+class region_watch
+{
+ public:
+  region_watch()                               = delete;
+  region_watch(const region_watch&)            = delete;
+  region_watch& operator=(const region_watch&) = delete;
+
+  using id_type = std::int32_t;
+
+  [[nodiscard]]
+  id_type id() const
+  {
+    return id_;
+  }
+
+  void enable();
+  void disable();
+
+  bool is_enabled() const
+  {
+    return is_enabled_;
+  }
+  virt_addr address() const
+  {
+    return address_;
+  }
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  bool at_address(virt_addr addr) const
+  {
+    return address_ == addr;
+  }
+
+  bool in_range(virt_addr low, virt_addr high) const
+  {
+    return low < address_ + size_ && address_ < high;
+  }
+
+  std::vector<memory_change> changes();
+
+  std::size_t last_compared_pages() const
+  {
+    return last_compared_pages_;
+  }
+
+  static bool soft_dirty_supported();
+
+ private:
+  friend process;
+  region_watch(process& proc, virt_addr address, std::size_t size);
+
+  std::uint64_t first_page() const;
+  std::size_t   page_count() const;
+
+  id_type                id_;
+  process*               process_;
+  virt_addr              address_;
+  std::size_t            size_;
+  bool                   is_enabled_;
+  std::vector<std::byte> snapshot_;
+  std::vector<bool>      dirty_pages_;
+  std::size_t            last_compared_pages_ = 0;
+};
+}  // namespace mdb
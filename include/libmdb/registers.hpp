@@ -10,6 +10,8 @@
 namespace mdb
 {
 class process;
+class expression;
+class execution_log;
 class registers
 {
  public:
@@ -45,6 +47,8 @@ class registers
 
  private:
   friend process;
+  friend expression;
+  friend execution_log;
   registers(process& proc) : proc_(&proc) {}
 
   user     data_;
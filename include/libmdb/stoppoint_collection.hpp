@@ -4,10 +4,12 @@
 #include <libmdb/error.hpp>
 #include <libmdb/types.hpp>
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 namespace mdb
 {
+class breakpoint_site;
 
 template <class Stoppoint>
 class stoppoint_collection
@@ -52,6 +54,7 @@ class stoppoint_collection
   typename points_t::const_iterator find_by_id(typename Stoppoint::id_type id) const;
   typename points_t::iterator       find_by_address(virt_addr address);
   typename points_t::const_iterator find_by_address(virt_addr address) const;
+  void                              remove(typename points_t::iterator it);
 
   points_t stoppoints_;
 };
@@ -150,15 +153,27 @@ const Stoppoint& stoppoint_collection<Stoppoint>::get_by_address(virt_addr addre
 template <class Stoppoint>
 void stoppoint_collection<Stoppoint>::remove_by_id(typename Stoppoint::id_type id)
 {
-  auto it = find_by_id(id);
-  (**it).disable();
-  stoppoints_.erase(it);
+  remove(find_by_id(id));
 }
 
 template <class Stoppoint>
 void stoppoint_collection<Stoppoint>::remove_by_address(virt_addr address)
 {
-  auto it = find_by_address(address);
+  remove(find_by_address(address));
+}
+
+template <class Stoppoint>
+void stoppoint_collection<Stoppoint>::remove(typename points_t::iterator it)
+{
+  // A breakpoint site the debugger still hooks outlives the user's breakpoint on it
+  if constexpr (std::is_same_v<Stoppoint, breakpoint_site>)
+  {
+    if ((**it).has_internal_hooks())
+    {
+      (**it).release_user();
+      return;
+    }
+  }
   (**it).disable();
   stoppoints_.erase(it);
 }
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <link.h>
+
+#include <functional>
+#include <libmdb/breakpoint_site.hpp>
 #include <libmdb/elf.hpp>
 #include <libmdb/process.hpp>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace mdb
 {
@@ -27,6 +33,7 @@ class target
   {
     return *process_;
   }
+  // The main executable
   elf& get_elf()
   {
     return *elf_;
@@ -36,13 +43,54 @@ class target
     return *elf_;
   }
 
+  // The executable and every shared object the dynamic loader reports as loaded
+  const elf_collection& get_elves() const
+  {
+    return elves_;
+  }
+
+  // Rereads the loader's list of shared objects; runs on its own whenever the list changes
+  void reload_dynamic_libraries();
+
+  // Configures a site created for a function breakpoint before it is enabled
+  using breakpoint_setup = std::function<void(breakpoint_site&)>;
+
+  struct pending_breakpoint
+  {
+    std::string      name;
+    bool             is_hardware;
+    breakpoint_setup setup;
+  };
+
+  // Breaks on every loaded definition of the function. When nothing defines it yet, the
+  // breakpoint stays pending until the loader maps an object that does.
+  std::vector<breakpoint_site*> create_function_breakpoint(std::string      name,
+                                                           bool             is_hardware = false,
+                                                           breakpoint_setup setup       = {});
+
+  // Patches a tracepoint after checking the function around it for branches into the patch
+  tracepoint& create_tracepoint(virt_addr address);
+
+  const std::vector<pending_breakpoint>& pending_breakpoints() const
+  {
+    return pending_breakpoints_;
+  }
+
  private:
   target(std::unique_ptr<process> proc, std::unique_ptr<elf> obj)
-      : process_(std::move(proc)), elf_(std::move(obj))
+      : process_(std::move(proc)), elf_(&elves_.push(std::move(obj)))
   {
   }
 
-  std::unique_ptr<process> process_;
-  std::unique_ptr<elf>     elf_;
+  void                          resolve_dynamic_linker_rendezvous();
+  r_debug                       read_rendezvous() const;
+  std::vector<breakpoint_site*> resolve_pending_breakpoints(const std::vector<const elf*>& loaded);
+
+  std::unique_ptr<process>                         process_;
+  elf_collection                                   elves_;
+  elf*                                             elf_;
+  std::optional<virt_addr>                         rendezvous_address_;
+  std::optional<breakpoint_site::internal_hook_id> entry_hook_;
+  std::vector<pending_breakpoint>                  pending_breakpoints_;
 };
 }  // namespace mdb
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <libmdb/mapped_file.hpp>
+#include <libmdb/register_info.hpp>
+#include <libmdb/types.hpp>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace mdb
+{
+class process;
+
+struct tracepoint_record
+{
+  std::uint64_t                 tracepoint_id;
+  std::uint64_t                 timestamp;
+  std::uint64_t                 rflags;
+  std::array<std::uint64_t, 16> gprs;
+
+  std::uint64_t read(register_id id) const;
+};
+
+class tracepoint
+{
+ public:
+  using address_range = std::pair<virt_addr, virt_addr>;
+
+  tracepoint()                             = delete;
+  tracepoint(const tracepoint&)            = delete;
+  tracepoint& operator=(const tracepoint&) = delete;
+
+  using id_type = std::int32_t;
+
+  [[nodiscard]]
+  id_type id() const
+  {
+    return id_;
+  }
+
+  void enable();
+  void disable();
+
+  bool is_enabled() const
+  {
+    return is_enabled_;
+  }
+  virt_addr address() const
+  {
+    return address_;
+  }
+  virt_addr trampoline() const
+  {
+    return trampoline_;
+  }
+  std::size_t patch_size() const
+  {
+    return original_code_.size();
+  }
+
+  bool at_address(virt_addr addr) const
+  {
+    return address_ == addr;
+  }
+
+  bool in_range(virt_addr low, virt_addr high) const
+  {
+    return low < address_ + patch_size() && address_ < high;
+  }
+
+ private:
+  friend process;
+  tracepoint(process& proc, virt_addr address, std::optional<address_range> function);
+
+  id_type                id_;
+  process*               process_;
+  virt_addr              address_;
+  bool                   is_enabled_;
+  std::vector<std::byte> original_code_;
+  virt_addr              trampoline_;
+};
+
+class tracepoint_buffer
+{
+ public:
+  tracepoint_buffer()                                    = delete;
+  tracepoint_buffer(const tracepoint_buffer&)            = delete;
+  tracepoint_buffer& operator=(const tracepoint_buffer&) = delete;
+
+  static constexpr std::size_t default_capacity = 1 << 16;
+
+  std::size_t drain(const std::function<void(const tracepoint_record&)>& callback);
+
+  std::size_t capacity() const
+  {
+    return capacity_;
+  }
+  std::uint64_t dropped() const;
+
+  virt_addr inferior_address() const
+  {
+    return inferior_address_;
+  }
+
+ private:
+  friend process;
+  friend tracepoint;
+  tracepoint_buffer(process& proc, std::size_t capacity);
+
+  virt_addr allocate_code(virt_addr near, std::size_t size);
+
+  struct code_chunk
+  {
+    virt_addr   address;
+    std::size_t used;
+  };
+
+  process*                     process_;
+  std::size_t                  capacity_;
+  std::unique_ptr<mapped_file> ring_;
+  virt_addr                    inferior_address_;
+  std::vector<code_chunk>      code_chunks_;
+};
+}  // namespace mdb
@@ -1,13 +1,26 @@
 #pragma once
 
+#include <sys/types.h>
+
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <libmdb/types.hpp>
+#include <vector>
 
 namespace mdb
 {
 class process;
 
+struct watch_record
+{
+  std::chrono::system_clock::time_point timestamp;
+  pid_t                                 tid;
+  virt_addr                             pc;
+  std::uint64_t                         old_value;
+  std::uint64_t                         new_value;
+};
+
 class watchpoint
 {
  public:
@@ -42,6 +55,22 @@ class watchpoint
   {
     return size_;
   }
+  [[nodiscard]]
+  bool is_hardware() const
+  {
+    return is_hardware_;
+  }
+  [[nodiscard]]
+  bool uses_debug_register() const
+  {
+    return hardware_register_index_ >= 0;
+  }
+  [[nodiscard]]
+  bool is_pinned() const
+  {
+    return is_pinned_;
+  }
+  void set_pinned(bool pinned);
 
   bool at_address(virt_addr addr) const
   {
@@ -53,6 +82,11 @@ class watchpoint
     return low < address_ && high > address_;
   }
 
+  bool overlaps(virt_addr low, virt_addr high) const
+  {
+    return low < address_ + size_ && address_ < high;
+  }
+
   std::uint64_t data() const
   {
     return data_;
@@ -62,11 +96,44 @@ class watchpoint
     return previous_data_;
   }
 
-  void update_data();
+  bool update_data();
+
+  std::uint64_t hit_count() const
+  {
+    return hit_count_;
+  }
+  void reset_hit_count()
+  {
+    hit_count_ = 0;
+  }
+
+  static constexpr std::size_t default_history_capacity = 1024;
+
+  [[nodiscard]]
+  bool is_logging() const
+  {
+    return !history_.empty();
+  }
+  void start_logging(std::size_t capacity = default_history_capacity);
+  void stop_logging();
+
+  std::vector<watch_record> history() const;
+  std::uint64_t             dropped_records() const
+  {
+    return recorded_ > history_.size() ? recorded_ - history_.size() : 0;
+  }
 
  private:
   friend process;
-  watchpoint(process& proc, virt_addr address, stoppoint_mode mode, std::size_t size);
+  watchpoint(process&       proc,
+             virt_addr      address,
+             stoppoint_mode mode,
+             std::size_t    size,
+             bool           is_hardware = true);
+
+  void install_trap();
+  void remove_trap();
+  void record_hit(pid_t tid, virt_addr pc);
 
   id_type        id_;
   process*       process_;
@@ -74,8 +141,17 @@ class watchpoint
   stoppoint_mode mode_;
   std::size_t    size_;
   bool           is_enabled_;
+  bool           is_hardware_;
   int            hardware_register_index_ = -1;
+  bool           is_pinned_               = false;
+  bool           is_degraded_             = false;
+  std::uint64_t  hit_count_               = 0;
   std::uint64_t  data_                    = 0;
   std::uint64_t  previous_data_           = 0;
+
+  std::vector<std::byte> contents_;
+
+  std::vector<watch_record> history_;
+  std::uint64_t             recorded_ = 0;
 };
 }  // namespace mdb
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <sys/ptrace.h>
 
+#include <algorithm>
 #include <libmdb/breakpoint_site.hpp>
 #include <libmdb/error.hpp>
 #include <libmdb/process.hpp>
@@ -34,60 +35,248 @@ void mdb::breakpoint_site::enable()
     return;
   }
 
-  if (is_hardware_)
+  arm();
+  is_enabled_ = true;
+}
+
+void mdb::breakpoint_site::disable()
+{
+  if (!is_enabled_)
   {
-    hardware_register_index_ = process_->set_hardware_breakpoint(id_, address_);
+    return;
   }
-  else
-  {
-    errno              = 0;
-    std::uint64_t data = ptrace(PTRACE_PEEKDATA, process_->pid(), address_, nullptr);
-    if (errno != 0)
-    {
-      error::send_errno("Enabling breakpoint site failed!");
-    }
 
-    saved_data_ = static_cast<std::byte>(data & 0xff);
+  is_enabled_ = false;
+  if (!has_internal_hooks())
+  {
+    disarm();
+  }
+}
 
-    std::uint64_t int3           = 0xcc;
-    std::uint64_t data_with_int3 = ((data & ~0xff) | int3);
+void mdb::breakpoint_site::arm()
+{
+  if (is_armed_)
+  {
+    return;
+  }
 
-    if (ptrace(PTRACE_POKEDATA, process_->pid(), address_, data_with_int3) < 0)
-    {
-      error::send_errno("Enabling breakpoint site failed!");
-    }
+  if (is_hardware_)
+  {
+    process_->schedule_hardware_stoppoints(this);
+  }
+  else
+  {
+    install_trap();
   }
 
-  is_enabled_ = true;
+  is_armed_ = true;
 }
 
-void mdb::breakpoint_site::disable()
+void mdb::breakpoint_site::disarm()
 {
-  if (!is_enabled_)
+  if (!is_armed_)
   {
     return;
   }
 
   if (is_hardware_)
   {
-    process_->clear_hardware_stoppoint(hardware_register_index_);
-    hardware_register_index_ = -1;
+    process_->release_hardware_stoppoint(this);
   }
   else
   {
-    errno              = 0;
-    std::uint64_t data = ptrace(PTRACE_PEEKDATA, process_->pid(), address_, nullptr);
-    if (errno != 0)
+    remove_trap();
+  }
+
+  is_armed_ = false;
+}
+
+void mdb::breakpoint_site::set_pinned(bool pinned)
+{
+  is_pinned_ = pinned;
+  if (is_armed_ and is_hardware_)
+  {
+    process_->schedule_hardware_stoppoints();
+  }
+}
+
+void mdb::breakpoint_site::install_trap()
+{
+  errno     = 0;
+  auto word = ptrace(PTRACE_PEEKDATA, process_->pid(), address_, nullptr);
+  if (errno != 0)
+  {
+    error::send_errno("Enabling breakpoint site failed!");
+  }
+  auto data = static_cast<std::uint64_t>(word);
+
+  saved_data_ = static_cast<std::byte>(data & 0xff);
+
+  std::uint64_t int3           = 0xcc;
+  std::uint64_t data_with_int3 = ((data & ~std::uint64_t{0xff}) | int3);
+
+  if (ptrace(PTRACE_POKEDATA, process_->pid(), address_, data_with_int3) < 0)
+  {
+    error::send_errno("Enabling breakpoint site failed!");
+  }
+}
+
+void mdb::breakpoint_site::remove_trap()
+{
+  errno     = 0;
+  auto word = ptrace(PTRACE_PEEKDATA, process_->pid(), address_, nullptr);
+  if (errno != 0)
+  {
+    error::send_errno("Disabling breakpoint site failed!");
+  }
+  auto data = static_cast<std::uint64_t>(word);
+
+  auto restored_data = ((data & ~std::uint64_t{0xff}) | static_cast<std::uint8_t>(saved_data_));
+  if (ptrace(PTRACE_POKEDATA, process_->pid(), address_, restored_data) < 0)
+  {
+    error::send_errno("Disabling breakpoint site failed!");
+  }
+}
+
+mdb::breakpoint_site::hit_action_id mdb::breakpoint_site::add_hit_action(hit_action action)
+{
+  auto id = next_hit_action_id_++;
+  hit_actions_.emplace_back(id, std::move(action));
+  return id;
+}
+
+void mdb::breakpoint_site::remove_hit_action(hit_action_id id)
+{
+  auto it = std::find_if(begin(hit_actions_),
+                         end(hit_actions_),
+                         [=](auto& action) { return action.first == id; });
+  if (it == end(hit_actions_))
+  {
+    error::send("Invalid hit action id");
+  }
+  hit_actions_.erase(it);
+}
+
+void mdb::breakpoint_site::disable_after(std::optional<std::uint64_t> hits)
+{
+  if (hits == 0)
+  {
+    error::send("Hit limit must be positive");
+  }
+  hits_until_disable_ = hits;
+}
+
+void mdb::breakpoint_site::run_hit_actions()
+{
+  // Actions may attach further actions to this site, so index rather than iterate
+  for (std::size_t i = 0; i < hit_actions_.size(); ++i)
+  {
+    hit_actions_[i].second(*this);
+  }
+}
+
+bool mdb::breakpoint_site::run_internal_hooks()
+{
+  struct run_guard
+  {
+    ~run_guard()
     {
-      error::send_errno("Disabling breakpoint site failed!");
+      running = false;
     }
+    bool& running;
+  };
 
-    auto restored_data = ((data & ~0xff) | static_cast<std::uint8_t>(saved_data_));
-    if (ptrace(PTRACE_POKEDATA, process_->pid(), address_, restored_data) < 0)
+  bool stop = false;
+  {
+    running_hooks_ = true;
+    run_guard guard{running_hooks_};
+    // Hooks may add hooks to this site or remove any of them, their own included, so index
+    // rather than iterate and call a copy
+    for (std::size_t i = 0; i < internal_hooks_.size(); ++i)
     {
-      error::send_errno("Disabling breakpoint site failed!");
+      if (auto hook = internal_hooks_[i].second)
+      {
+        stop |= hook(*this);
+      }
     }
   }
 
-  is_enabled_ = false;
-}
\ No newline at end of file
+  internal_hooks_.erase(std::remove_if(begin(internal_hooks_),
+                                       end(internal_hooks_),
+                                       [](auto& hook) { return !hook.second; }),
+                        end(internal_hooks_));
+  if (internal_hooks_.empty() and !is_enabled_)
+  {
+    disarm();
+  }
+  return stop;
+}
+
+mdb::breakpoint_site::internal_hook_id mdb::breakpoint_site::add_internal_hook(internal_hook hook)
+{
+  auto id = next_internal_hook_id_++;
+  internal_hooks_.emplace_back(id, std::move(hook));
+  arm();
+  return id;
+}
+
+void mdb::breakpoint_site::remove_internal_hook(internal_hook_id id)
+{
+  auto it = std::find_if(begin(internal_hooks_),
+                         end(internal_hooks_),
+                         [=](auto& hook) { return hook.first == id and hook.second; });
+  if (it == end(internal_hooks_))
+  {
+    error::send("Invalid internal hook id");
+  }
+
+  // The hook may be the one running, so only its slot is cleared until the run ends
+  if (running_hooks_)
+  {
+    it->second = nullptr;
+    return;
+  }
+  internal_hooks_.erase(it);
+  if (internal_hooks_.empty() and !is_enabled_)
+  {
+    disarm();
+  }
+}
+
+void mdb::breakpoint_site::claim_for_user(bool hardware)
+{
+  set_hardware(hardware);
+  id_          = get_next_id();
+  is_internal_ = false;
+}
+
+void mdb::breakpoint_site::release_user()
+{
+  disable();
+  set_hardware(false);
+  id_          = -1;
+  is_internal_ = true;
+  is_pinned_   = false;
+  condition_.reset();
+  hit_count_    = 0;
+  ignore_count_ = 0;
+  hits_until_disable_.reset();
+  auto_continue_ = false;
+  hit_actions_.clear();
+}
+
+void mdb::breakpoint_site::set_hardware(bool hardware)
+{
+  if (is_hardware_ == hardware)
+  {
+    return;
+  }
+
+  bool was_armed = is_armed_;
+  disarm();
+  is_hardware_ = hardware;
+  if (was_armed)
+  {
+    arm();
+  }
+}
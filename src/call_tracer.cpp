@@ -0,0 +1,254 @@
+#include <time.h>
+
+#include <cstddef>
+#include <cstring>
+#include <libmdb/bit.hpp>
+#include <libmdb/call_tracer.hpp>
+#include <libmdb/error.hpp>
+#include <libmdb/process.hpp>
+
+namespace
+{
+constexpr std::size_t initial_event_capacity = 4096;
+
+std::uint64_t monotonic_nanoseconds()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<std::uint64_t>(now.tv_sec) * 1'000'000'000 +
+         static_cast<std::uint64_t>(now.tv_nsec);
+}
+
+constexpr std::array<mdb::register_id, 6> argument_registers = {mdb::register_id::rdi,
+                                                                mdb::register_id::rsi,
+                                                                mdb::register_id::rdx,
+                                                                mdb::register_id::rcx,
+                                                                mdb::register_id::r8,
+                                                                mdb::register_id::r9};
+}  // namespace
+
+mdb::call_tracer::call_tracer(process& proc, const std::filesystem::path& path, std::size_t n_args)
+    : process_(&proc), n_args_(n_args)
+{
+  if (n_args_ > argument_registers.size())
+  {
+    error::send("Call tracer can record at most 6 arguments");
+  }
+
+  file_ = mapped_file::create(
+      path, sizeof(call_trace_header) + initial_event_capacity * sizeof(call_event));
+
+  call_trace_header header{};
+  header.magic   = call_trace_magic;
+  header.version = call_trace_version;
+  header.n_args  = static_cast<std::uint32_t>(n_args_);
+  std::memcpy(file_->data(), &header, sizeof(header));
+}
+
+mdb::call_tracer::~call_tracer() noexcept
+{
+  // The process may be gone by now, so only the file is sealed
+  if (finished_)
+  {
+    return;
+  }
+  finished_ = true;
+  try
+  {
+    write_function_table();
+  }
+  catch (...)
+  {
+  }
+}
+
+std::uint32_t mdb::call_tracer::trace_function(virt_addr entry, std::string_view name)
+{
+  if (finished_)
+  {
+    error::send("Call trace already finished");
+  }
+
+  auto id = static_cast<std::uint32_t>(names_.size());
+  names_.emplace_back(name);
+  attach(entry,
+         [this, id](auto&)
+         {
+           on_entry(id);
+           return false;
+         });
+  return id;
+}
+
+void mdb::call_tracer::attach(virt_addr address, breakpoint_site::internal_hook hook)
+{
+  actions_.push_back({address, process_->add_internal_hook(address, std::move(hook))});
+}
+
+void mdb::call_tracer::watch_return_address(virt_addr address)
+{
+  if (watched_returns_.insert(address.addr()).second)
+  {
+    attach(address,
+           [this](auto&)
+           {
+             on_exit();
+             return false;
+           });
+  }
+}
+
+mdb::call_event& mdb::call_tracer::append_event(call_event_kind kind, std::uint32_t function_id)
+{
+  auto offset = sizeof(call_trace_header) + n_events_ * sizeof(call_event);
+  if (offset + sizeof(call_event) > file_->size())
+  {
+    file_->resize(file_->size() * 2);
+  }
+
+  auto event = reinterpret_cast<call_event*>(file_->data() + offset);
+  *event     = call_event{monotonic_nanoseconds(), process_->pid(), function_id, kind, 0, {}};
+
+  ++n_events_;
+  std::memcpy(file_->data() + offsetof(call_trace_header, n_events), &n_events_, sizeof(n_events_));
+  return *event;
+}
+
+void mdb::call_tracer::on_entry(std::uint32_t function_id)
+{
+  auto& regs = process_->get_registers();
+  auto  sp   = regs.read_by_id_as<std::uint64_t>(register_id::rsp);
+  auto  ret  = virt_addr{process_->read_memory_as<std::uint64_t>(virt_addr{sp})};
+
+  // Frames below a fresh entry's stack pointer were unwound without returning
+  while (!shadow_stack_.empty() and shadow_stack_.back().stack_pointer < sp)
+  {
+    append_event(call_event_kind::exit, shadow_stack_.back().function_id);
+    shadow_stack_.pop_back();
+  }
+
+  auto& event = append_event(call_event_kind::entry, function_id);
+  for (std::size_t i = 0; i < n_args_; ++i)
+  {
+    event.args[i] = regs.read_by_id_as<std::uint64_t>(argument_registers[i]);
+  }
+
+  shadow_stack_.push_back({function_id, sp});
+  watch_return_address(ret);
+}
+
+void mdb::call_tracer::on_exit()
+{
+  auto& regs   = process_->get_registers();
+  auto  sp     = regs.read_by_id_as<std::uint64_t>(register_id::rsp);
+  auto  retval = regs.read_by_id_as<std::uint64_t>(register_id::rax);
+
+  while (!shadow_stack_.empty() and shadow_stack_.back().stack_pointer < sp)
+  {
+    auto& event   = append_event(call_event_kind::exit, shadow_stack_.back().function_id);
+    event.args[0] = retval;
+    shadow_stack_.pop_back();
+  }
+}
+
+void mdb::call_tracer::finish()
+{
+  if (finished_)
+  {
+    return;
+  }
+  finished_ = true;
+
+  if (process_->state() == process_state::stopped)
+  {
+    for (auto& action : actions_)
+    {
+      process_->remove_internal_hook(action.address, action.id);
+    }
+  }
+  write_function_table();
+}
+
+void mdb::call_tracer::write_function_table()
+{
+  auto table_offset = sizeof(call_trace_header) + n_events_ * sizeof(call_event);
+  auto table_size   = std::size_t(0);
+  for (auto& name : names_)
+  {
+    table_size += 2 * sizeof(std::uint32_t) + name.size();
+  }
+  file_->resize(table_offset + table_size);
+
+  auto pos = file_->data() + table_offset;
+  for (std::uint32_t id = 0; id < names_.size(); ++id)
+  {
+    auto size = static_cast<std::uint32_t>(names_[id].size());
+    std::memcpy(pos, &id, sizeof(id));
+    std::memcpy(pos + sizeof(id), &size, sizeof(size));
+    std::memcpy(pos + 2 * sizeof(std::uint32_t), names_[id].data(), size);
+    pos += 2 * sizeof(std::uint32_t) + size;
+  }
+
+  auto header                  = from_bytes<call_trace_header>(file_->data());
+  header.n_events              = n_events_;
+  header.n_functions           = names_.size();
+  header.function_table_offset = table_offset;
+  std::memcpy(file_->data(), &header, sizeof(header));
+}
+
+mdb::call_trace::call_trace(const std::filesystem::path& path) : file_(mapped_file::open(path))
+{
+  auto invalid = [&] { error::send(path.string() + " is not a valid call trace"); };
+
+  auto contents = file_->contents();
+  if (contents.size() < sizeof(call_trace_header))
+  {
+    invalid();
+  }
+
+  header_ = from_bytes<call_trace_header>(contents.begin());
+  if (header_.magic != call_trace_magic or header_.version != call_trace_version)
+  {
+    invalid();
+  }
+
+  auto events_end = sizeof(call_trace_header) + header_.n_events * sizeof(call_event);
+  if (events_end > contents.size())
+  {
+    invalid();
+  }
+  events_ = {reinterpret_cast<const call_event*>(contents.begin() + sizeof(call_trace_header)),
+             header_.n_events};
+
+  if (header_.function_table_offset == 0)
+  {
+    return;
+  }
+  if (header_.function_table_offset > contents.size())
+  {
+    invalid();
+  }
+
+  auto pos = contents.begin() + header_.function_table_offset;
+  for (std::uint64_t i = 0; i < header_.n_functions; ++i)
+  {
+    if (pos + 2 * sizeof(std::uint32_t) > contents.end())
+    {
+      invalid();
+    }
+    auto id   = from_bytes<std::uint32_t>(pos);
+    auto size = from_bytes<std::uint32_t>(pos + sizeof(std::uint32_t));
+    pos += 2 * sizeof(std::uint32_t);
+    if (pos + size > contents.end())
+    {
+      invalid();
+    }
+
+    if (id >= names_.size())
+    {
+      names_.resize(id + 1);
+    }
+    names_[id] = std::string(reinterpret_cast<const char*>(pos), size);
+    pos += size;
+  }
+}
@@ -0,0 +1,190 @@
+#include <elf.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <libmdb/bit.hpp>
+#include <libmdb/debug_file.hpp>
+#include <libmdb/elf.hpp>
+#include <libmdb/error.hpp>
+#include <string>
+#include <system_error>
+
+namespace
+{
+// The CRC-32 used by zlib, which is what .gnu_debuglink records
+std::uint32_t debuglink_crc(mdb::span<const std::byte> data)
+{
+  static const auto table = []
+  {
+    std::array<std::uint32_t, 256> entries{};
+    for (std::uint32_t i = 0; i < entries.size(); ++i)
+    {
+      auto entry = i;
+      for (int bit = 0; bit < 8; ++bit)
+      {
+        entry = entry & 1 ? 0xedb88320 ^ (entry >> 1) : entry >> 1;
+      }
+      entries[i] = entry;
+    }
+    return entries;
+  }();
+
+  std::uint32_t crc = 0xffffffff;
+  for (auto byte : data)
+  {
+    crc = table[(crc ^ std::to_integer<std::uint32_t>(byte)) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffff;
+}
+
+bool same_bytes(mdb::span<const std::byte> lhs, mdb::span<const std::byte> rhs)
+{
+  return lhs.size() == rhs.size() and std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+}  // namespace
+
+std::vector<std::filesystem::path> mdb::debug_file::directories()
+{
+  auto list = std::getenv("MDB_DEBUG_FILE_DIRECTORY");
+  if (!list)
+  {
+    return {"/usr/lib/debug"};
+  }
+
+  std::vector<std::filesystem::path> ret;
+  std::string_view                   rest = list;
+  while (!rest.empty())
+  {
+    auto colon = rest.find(':');
+    if (auto directory = rest.substr(0, colon); !directory.empty())
+    {
+      ret.emplace_back(directory);
+    }
+    rest = colon == rest.npos ? std::string_view() : rest.substr(colon + 1);
+  }
+  return ret;
+}
+
+std::unique_ptr<mdb::debug_file> mdb::debug_file::open(const std::filesystem::path& path)
+{
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(path, ec))
+  {
+    return nullptr;
+  }
+
+  std::unique_ptr<mapped_file> file;
+  try
+  {
+    file = mapped_file::open(path);
+  }
+  catch (const error&)
+  {
+    return nullptr;
+  }
+
+  // Only the section table is read here; the sections themselves are paged in on use
+  auto contents = file->contents();
+  if (contents.size() < sizeof(Elf64_Ehdr) or
+      std::memcmp(contents.begin(), ELFMAG, SELFMAG) != 0)
+  {
+    return nullptr;
+  }
+  auto header = from_bytes<Elf64_Ehdr>(contents.begin());
+  if (header.e_ident[EI_CLASS] != ELFCLASS64 or header.e_shentsize != sizeof(Elf64_Shdr) or
+      header.e_shoff > contents.size() or
+      header.e_shnum > (contents.size() - header.e_shoff) / sizeof(Elf64_Shdr) or
+      header.e_shstrndx >= header.e_shnum)
+  {
+    return nullptr;
+  }
+
+  auto sections = span<const Elf64_Shdr>{
+      reinterpret_cast<const Elf64_Shdr*>(contents.begin() + header.e_shoff), header.e_shnum};
+  auto in_file = [&](const Elf64_Shdr& section)
+  {
+    return section.sh_type != SHT_NOBITS and section.sh_offset <= contents.size() and
+           section.sh_size <= contents.size() - section.sh_offset;
+  };
+  auto& names = sections[header.e_shstrndx];
+  if (!in_file(names))
+  {
+    return nullptr;
+  }
+
+  auto ret = std::unique_ptr<debug_file>(new debug_file(path, std::move(file)));
+  for (auto& section : sections)
+  {
+    if (in_file(section) and section.sh_name < names.sh_size)
+    {
+      auto name = reinterpret_cast<const char*>(contents.begin() + names.sh_offset) +
+                  section.sh_name;
+      ret->sections_[name] = {contents.begin() + section.sh_offset, section.sh_size};
+    }
+  }
+  return ret;
+}
+
+std::unique_ptr<mdb::debug_file> mdb::debug_file::find(const elf& obj)
+{
+  if (auto build_id = obj.build_id(); build_id.size() > 1)
+  {
+    auto hex = obj.build_id_string();
+    for (auto& directory : directories())
+    {
+      auto file = open(directory / ".build-id" / hex.substr(0, 2) / (hex.substr(2) + ".debug"));
+      if (!file)
+      {
+        continue;
+      }
+      auto notes = file->get_section_contents(".note.gnu.build-id");
+      if (same_bytes(elf::find_build_id(notes), build_id))
+      {
+        return file;
+      }
+    }
+  }
+
+  // The link is the file name, padded to 4 bytes, then the CRC of the whole debug file
+  auto link     = obj.get_section_contents(".gnu_debuglink");
+  auto name_end = std::find(link.begin(), link.end(), std::byte{0});
+  auto crc_at   = (static_cast<std::size_t>(name_end - link.begin()) + 4) & ~std::size_t{3};
+  if (name_end == link.begin() or name_end == link.end() or crc_at + 4 > link.size())
+  {
+    return nullptr;
+  }
+  auto name = std::string(reinterpret_cast<const char*>(link.begin()),
+                          static_cast<std::size_t>(name_end - link.begin()));
+  auto crc  = from_bytes<std::uint32_t>(link.begin() + crc_at);
+
+  // /proc/<pid>/exe is a link to the executable, whose directory is the one that matters
+  std::error_code ec;
+  auto            binary = std::filesystem::canonical(obj.path(), ec);
+  if (ec)
+  {
+    binary = obj.path();
+  }
+  auto directory = binary.parent_path();
+
+  std::vector<std::filesystem::path> candidates{directory / name, directory / ".debug" / name};
+  for (auto& debug_directory : directories())
+  {
+    candidates.push_back(debug_directory / directory.relative_path() / name);
+  }
+  for (auto& candidate : candidates)
+  {
+    if (auto file = open(candidate); file and debuglink_crc(file->file_->contents()) == crc)
+    {
+      return file;
+    }
+  }
+  return nullptr;
+}
+
+mdb::span<const std::byte> mdb::debug_file::get_section_contents(std::string_view name) const
+{
+  auto it = sections_.find(name);
+  return it == sections_.end() ? span<const std::byte>{} : it->second;
+}
@@ -1,6 +1,125 @@
 #include <Zydis/Zydis.h>
 
+#include <algorithm>
 #include <libmdb/disassembler.hpp>
+#include <libmdb/error.hpp>
+
+namespace
+{
+std::optional<mdb::register_id> to_register_id(ZydisRegister reg)
+{
+  using mdb::register_id;
+  static constexpr std::pair<ZydisRegister, register_id> gprs[] = {
+      {ZYDIS_REGISTER_RAX, register_id::rax},
+      {ZYDIS_REGISTER_RCX, register_id::rcx},
+      {ZYDIS_REGISTER_RDX, register_id::rdx},
+      {ZYDIS_REGISTER_RBX, register_id::rbx},
+      {ZYDIS_REGISTER_RSP, register_id::rsp},
+      {ZYDIS_REGISTER_RBP, register_id::rbp},
+      {ZYDIS_REGISTER_RSI, register_id::rsi},
+      {ZYDIS_REGISTER_RDI, register_id::rdi},
+      {ZYDIS_REGISTER_R8, register_id::r8},
+      {ZYDIS_REGISTER_R9, register_id::r9},
+      {ZYDIS_REGISTER_R10, register_id::r10},
+      {ZYDIS_REGISTER_R11, register_id::r11},
+      {ZYDIS_REGISTER_R12, register_id::r12},
+      {ZYDIS_REGISTER_R13, register_id::r13},
+      {ZYDIS_REGISTER_R14, register_id::r14},
+      {ZYDIS_REGISTER_R15, register_id::r15},
+  };
+
+  if (reg == ZYDIS_REGISTER_NONE)
+  {
+    return std::nullopt;
+  }
+
+  auto it = std::find_if(
+      std::begin(gprs), std::end(gprs), [reg](auto& entry) { return entry.first == reg; });
+  if (it == std::end(gprs))
+    mdb::error::send("Unsupported address register");
+
+  return it->second;
+}
+
+// Whether the instruction changes anything PTRACE_GETFPREGS saves: x87, MMX and SSE registers
+// along with their control and status words
+bool writes_fprs(const ZydisDecodedInstruction& instr, const ZydisDecodedOperand* operands)
+{
+  switch (instr.mnemonic)
+  {
+    case ZYDIS_MNEMONIC_FLDENV:
+    case ZYDIS_MNEMONIC_FRSTOR:
+    case ZYDIS_MNEMONIC_FXRSTOR:
+    case ZYDIS_MNEMONIC_FXRSTOR64:
+    case ZYDIS_MNEMONIC_XRSTOR:
+    case ZYDIS_MNEMONIC_XRSTOR64:
+    case ZYDIS_MNEMONIC_XRSTORS:
+    case ZYDIS_MNEMONIC_XRSTORS64:
+    case ZYDIS_MNEMONIC_VZEROALL:
+    case ZYDIS_MNEMONIC_VZEROUPPER:
+      return true;
+    default:
+      break;
+  }
+
+  for (std::size_t i = 0; i < instr.operand_count; ++i)
+  {
+    auto& operand = operands[i];
+    if (operand.type != ZYDIS_OPERAND_TYPE_REGISTER or
+        !(operand.actions & ZYDIS_OPERAND_ACTION_MASK_WRITE))
+    {
+      continue;
+    }
+    switch (ZydisRegisterGetClass(operand.reg.value))
+    {
+      case ZYDIS_REGCLASS_X87:
+      case ZYDIS_REGCLASS_MMX:
+      case ZYDIS_REGCLASS_XMM:
+      case ZYDIS_REGCLASS_YMM:
+      case ZYDIS_REGCLASS_ZMM:
+        return true;
+      default:
+        break;
+    }
+    if (operand.reg.value == ZYDIS_REGISTER_MXCSR or
+        operand.reg.value == ZYDIS_REGISTER_X87CONTROL or
+        operand.reg.value == ZYDIS_REGISTER_X87STATUS or
+        operand.reg.value == ZYDIS_REGISTER_X87TAG)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads up to size bytes, stopping early at a page that cannot be read. Decoding only needs
+// the bytes of the instructions themselves, which never run into an unmapped page.
+std::vector<std::byte> read_code(const mdb::process& proc, mdb::virt_addr address, std::size_t size)
+{
+  constexpr std::uint64_t page_size = 0x1000;
+
+  std::vector<std::byte> code;
+  while (code.size() < size)
+  {
+    auto at     = address + code.size();
+    auto amount = std::min<std::size_t>(size - code.size(), page_size - at.addr() % page_size);
+    try
+    {
+      auto chunk = proc.read_memory_without_traps(at, amount);
+      code.insert(code.end(), chunk.begin(), chunk.end());
+    }
+    catch (const mdb::error&)
+    {
+      if (code.empty())
+      {
+        throw;
+      }
+      break;
+    }
+  }
+  return code;
+}
+}  // namespace
 
 std::vector<mdb::disassembler::instruction> mdb::disassembler::disassemble(
     std::size_t              n_instructions,
@@ -32,5 +151,143 @@ std::vector<mdb::disassembler::instruction> mdb::disassembler::disassemble(
     --n_instructions;
   }
 
+  return ret;
+}
+
+std::vector<mdb::disassembler::instruction_extent> mdb::disassembler::decode_extents(
+    virt_addr   address,
+    std::size_t min_bytes)
+{
+  std::vector<instruction_extent> ret;
+
+  auto code = read_code(*process_, address, min_bytes + 15);
+
+  ZydisDecoder decoder;
+  ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+
+  ZyanUSize               offset = 0;
+  ZydisDecodedInstruction instr;
+  while (offset < min_bytes)
+  {
+    if (!ZYAN_SUCCESS(ZydisDecoderDecodeInstruction(
+            &decoder, nullptr, code.data() + offset, code.size() - offset, &instr)))
+    {
+      error::send("Could not decode instruction");
+    }
+
+    auto category = instr.meta.category;
+    bool position_dependent =
+        (instr.attributes & ZYDIS_ATTRIB_IS_RELATIVE) or category == ZYDIS_CATEGORY_CALL or
+        category == ZYDIS_CATEGORY_RET or category == ZYDIS_CATEGORY_COND_BR or
+        category == ZYDIS_CATEGORY_UNCOND_BR;
+
+    ret.push_back(instruction_extent{
+        address + offset, instr.length, position_dependent, category == ZYDIS_CATEGORY_CALL});
+    offset += instr.length;
+  }
+
+  return ret;
+}
+
+std::vector<mdb::virt_addr> mdb::disassembler::find_branch_targets(virt_addr low, virt_addr high)
+{
+  std::vector<virt_addr> ret;
+  auto code = process_->read_memory_without_traps(low, high.addr() - low.addr());
+
+  ZydisDecoder decoder;
+  ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+
+  ZyanUSize               offset = 0;
+  ZydisDecodedInstruction instr;
+  ZydisDecodedOperand     operands[ZYDIS_MAX_OPERAND_COUNT];
+  while (offset < code.size())
+  {
+    // Padding and data between functions do not always decode; resynchronize on the next byte
+    if (!ZYAN_SUCCESS(ZydisDecoderDecodeFull(
+            &decoder, code.data() + offset, code.size() - offset, &instr, operands)))
+    {
+      ++offset;
+      continue;
+    }
+
+    auto category = instr.meta.category;
+    if (category == ZYDIS_CATEGORY_CALL or category == ZYDIS_CATEGORY_COND_BR or
+        category == ZYDIS_CATEGORY_UNCOND_BR)
+    {
+      for (std::size_t i = 0; i < instr.operand_count; ++i)
+      {
+        auto&   operand = operands[i];
+        ZyanU64 target;
+        if (operand.type == ZYDIS_OPERAND_TYPE_IMMEDIATE and operand.imm.is_relative and
+            ZYAN_SUCCESS(
+                ZydisCalcAbsoluteAddress(&instr, &operand, low.addr() + offset, &target)))
+        {
+          ret.push_back(virt_addr{target});
+        }
+      }
+    }
+    offset += instr.length;
+  }
+  return ret;
+}
+
+mdb::disassembler::write_decoding mdb::disassembler::decode_memory_writes(virt_addr address)
+{
+  auto code = read_code(*process_, address, 15);
+
+  ZydisDecoder decoder;
+  ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+
+  ZydisDecodedInstruction instr;
+  ZydisDecodedOperand     operands[ZYDIS_MAX_OPERAND_COUNT];
+  if (!ZYAN_SUCCESS(
+          ZydisDecoderDecodeFull(&decoder, code.data(), code.size(), &instr, operands)))
+  {
+    error::send("Could not decode instruction");
+  }
+
+  write_decoding ret{instr.length,
+                     {},
+                     writes_fprs(instr, operands),
+                     instr.mnemonic == ZYDIS_MNEMONIC_SYSCALL};
+  for (std::size_t i = 0; i < instr.operand_count; ++i)
+  {
+    auto& operand = operands[i];
+    if (operand.type != ZYDIS_OPERAND_TYPE_MEMORY or
+        !(operand.actions & ZYDIS_OPERAND_ACTION_MASK_WRITE))
+    {
+      continue;
+    }
+    // Scatter stores write one element per vector lane, addressed through vector registers
+    // that are not recorded
+    if (operand.mem.type == ZYDIS_MEMOP_TYPE_VSIB)
+    {
+      error::send("Cannot record the memory written by a scatter store");
+    }
+    if (operand.mem.type != ZYDIS_MEMOP_TYPE_MEM)
+    {
+      continue;
+    }
+
+    memory_write write{};
+    write.size         = operand.size / 8;
+    write.displacement = operand.mem.disp.value;
+    write.segment_base = operand.mem.segment == ZYDIS_REGISTER_FS   ? segment::fs
+                         : operand.mem.segment == ZYDIS_REGISTER_GS ? segment::gs
+                                                                    : segment::none;
+    write.is_stack_push = operand.visibility == ZYDIS_OPERAND_VISIBILITY_HIDDEN and
+                          operand.mem.base == ZYDIS_REGISTER_RSP;
+    if (operand.mem.base == ZYDIS_REGISTER_RIP)
+    {
+      write.displacement += static_cast<std::int64_t>(address.addr() + instr.length);
+    }
+    else if (!write.is_stack_push)
+    {
+      write.base  = to_register_id(operand.mem.base);
+      write.index = to_register_id(operand.mem.index);
+      write.scale = operand.mem.scale;
+    }
+    ret.writes.push_back(write);
+  }
   return ret;
 }
\ No newline at end of file
@@ -20,6 +20,7 @@ class cursor
     {
       case DW_FORM_flag_present:
         break;
+      case DW_FORM_data1:
       case DW_FORM_ref1:
       case DW_FORM_flag:
         pos_ += 1;
@@ -192,7 +193,7 @@ class cursor
 std::unordered_map<std::uint64_t, mdb::abbrev> parse_abbrev_table(const mdb::elf& obj,
                                                                   std::size_t     offset)
 {
-  cursor cur(obj.get_section_contents(".debug_abbrev"));
+  cursor cur(obj.get_debug_section_contents(".debug_abbrev"));
   cur += offset;
 
   std::unordered_map<std::uint64_t, mdb::abbrev> table;
@@ -259,8 +260,7 @@ std::unique_ptr<mdb::compile_unit> parse_compile_unit(mdb::dwarf&     dwarf,
 std::vector<std::unique_ptr<mdb::compile_unit>> parse_compile_units(mdb::dwarf&     dwarf,
                                                                     const mdb::elf& obj)
 {
-  auto   debug_info = obj.get_section_contents(".debug_info");
-  cursor cur(debug_info);
+  cursor cur(dwarf.debug_info());
 
   std::vector<std::unique_ptr<mdb::compile_unit>> units;
   while (!cur.finished())
@@ -315,7 +315,10 @@ const std::unordered_map<std::uint64_t, mdb::abbrev>& mdb::compile_unit::abbrev_
   return parent_->get_abbrev_table(abbrev_offset_);
 }
 
-mdb::dwarf::dwarf(const mdb::elf& parent) : elf_(&parent)
+mdb::dwarf::dwarf(const mdb::elf& parent)
+    : elf_(&parent),
+      debug_info_(parent.get_debug_section_contents(".debug_info")),
+      debug_str_(parent.get_debug_section_contents(".debug_str"))
 {
   compile_units_ = parse_compile_units(*this, parent);
 }
@@ -491,7 +494,7 @@ mdb::die mdb::attr::as_reference() const
     case DW_FORM_ref_addr:
     {
       offset          = cur.u32();
-      auto  section   = cu_->dwarf_info()->elf_file()->get_section_contents(".debug_info");
+      auto  section   = cu_->dwarf_info()->debug_info();
       auto  die_pos   = section.begin() + offset;
       auto& cus       = cu_->dwarf_info()->compile_units();
       auto  cu_finder = [=](auto& cu)
@@ -518,7 +521,7 @@ std::string_view mdb::attr::as_string() const
     case DW_FORM_strp:
     {
       auto   offset = cur.u32();
-      auto   stab   = cu_->dwarf_info()->elf_file()->get_section_contents(".debug_str");
+      auto   stab   = cu_->dwarf_info()->debug_str();
       cursor stab_cur({stab.begin() + offset, stab.end()});
       return stab_cur.string();
     }
@@ -534,15 +537,10 @@ mdb::file_addr mdb::die::low_pc() const
 
 mdb::file_addr mdb::die::high_pc() const
 {
-  auto           attr = (*this)[DW_AT_high_pc];
-  std::file_addr addr;
+  auto attr = (*this)[DW_AT_high_pc];
   if (attr.form() == DW_FORM_addr)
   {
-    addr = attr.as_address();
+    return attr.as_address();
   }
-  else
-  {
-    addr = low_pc() + attr.as_int();
-  }
-  return file_addr{*cu_->dwarf_info()->elf_file(), addr};
+  return low_pc() + static_cast<std::int64_t>(attr.as_int());
 }
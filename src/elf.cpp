@@ -1,65 +1,307 @@
 #include <cxxabi.h>
-#include <fcntl.h>
 #include <sys/mman.h>
-#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <libmdb/bit.hpp>
+#include <libmdb/debug_file.hpp>
 #include <libmdb/elf.hpp>
 #include <libmdb/error.hpp>
+#include <system_error>
+#include <thread>
 
-mdb::elf::elf(const std::filesystem::path& path)
+namespace
 {
-  path_ = path;
+constexpr std::uint64_t page_size = 0x1000;
+
+// Advice is only a hint, so failures are ignored
+void advise(const std::byte* mapping, mdb::span<const std::byte> range, int advice)
+{
+  if (range.size() == 0)
+  {
+    return;
+  }
+  auto first = reinterpret_cast<std::uintptr_t>(range.begin()) & ~(page_size - 1);
+  auto last  = reinterpret_cast<std::uintptr_t>(range.end());
+  if (first < reinterpret_cast<std::uintptr_t>(mapping))
+  {
+    first = reinterpret_cast<std::uintptr_t>(mapping);
+  }
+  madvise(reinterpret_cast<void*>(first), last - first, advice);
+}
+
+// Extra threads demangling for every object at once, so concurrent searches share one bound
+constexpr unsigned    max_demangle_helpers = 7;
+std::atomic<unsigned> demangle_helpers{0};
+
+unsigned claim_demangle_helpers(unsigned wanted)
+{
+  auto busy = demangle_helpers.load();
+  while (true)
+  {
+    auto claimed = std::min(wanted, max_demangle_helpers - std::min(busy, max_demangle_helpers));
+    if (claimed == 0 or demangle_helpers.compare_exchange_weak(busy, busy + claimed))
+    {
+      return claimed;
+    }
+  }
+}
+
+bool is_mangled(std::string_view name)
+{
+  return name.size() > 2 and name[0] == '_' and name[1] == 'Z';
+}
+
+std::uint32_t gnu_hash(std::string_view name)
+{
+  std::uint32_t hash = 5381;
+  for (auto c : name)
+  {
+    hash = hash * 33 + static_cast<unsigned char>(c);
+  }
+  return hash;
+}
+
+std::uint32_t sysv_hash(std::string_view name)
+{
+  std::uint32_t hash = 0;
+  for (auto c : name)
+  {
+    hash      = (hash << 4) + static_cast<unsigned char>(c);
+    auto high = hash & 0xf0000000;
+    hash ^= high >> 24;
+    hash &= ~high;
+  }
+  return hash;
+}
 
-  if ((fd_ = open(path.c_str(), O_LARGEFILE, O_RDONLY)) < 0)
+// Lays the sorted starts out as an implicit binary tree: slot k has children 2k and 2k + 1
+std::size_t fill_eytzinger(const std::vector<std::uint64_t>& sorted,
+                           std::vector<std::uint64_t>&       starts,
+                           std::vector<std::uint32_t>&       ranks,
+                           std::size_t                       slot,
+                           std::size_t                       rank)
+{
+  if (slot < starts.size())
   {
-    error::send_errno("Could not open ELF file");
+    rank         = fill_eytzinger(sorted, starts, ranks, 2 * slot, rank);
+    starts[slot] = sorted[rank];
+    ranks[slot]  = static_cast<std::uint32_t>(rank);
+    rank         = fill_eytzinger(sorted, starts, ranks, 2 * slot + 1, rank + 1);
   }
+  return rank;
+}
 
-  struct stat stats;
-  if (fstat(fd_, &stats) < 0)
+// A table at most half full keeps probe sequences short
+template <class F>
+std::vector<std::uint32_t> build_name_slots(std::size_t n_entries, F name_of)
+{
+  std::size_t n_slots = 8;
+  while (n_slots < 2 * n_entries)
   {
-    error::send_errno("Could not retrieve ELF file stats");
+    n_slots *= 2;
   }
 
-  file_size_ = stats.st_size;
+  std::vector<std::uint32_t> slots(n_slots);
+  for (std::size_t entry = 0; entry < n_entries; ++entry)
+  {
+    auto name = name_of(entry);
+    if (name.empty())
+    {
+      continue;
+    }
+    auto slot = gnu_hash(name) & (n_slots - 1);
+    while (slots[slot] != 0)
+    {
+      slot = (slot + 1) & (n_slots - 1);
+    }
+    slots[slot] = static_cast<std::uint32_t>(entry + 1);
+  }
+  return slots;
+}
 
-  void* ret;
-  if ((ret = mmap(0, file_size_, PROT_READ, MAP_SHARED, fd_, 0)) == MAP_FAILED)
+// Calls f with every entry in the probe sequence for name; f compares the names itself
+template <class F>
+void probe_name_slots(mdb::span<const std::uint32_t> slots, std::string_view name, F f)
+{
+  if (slots.size() == 0)
+  {
+    return;
+  }
+  auto mask = slots.size() - 1;
+  for (auto slot = gnu_hash(name) & mask; slots[slot] != 0; slot = (slot + 1) & mask)
   {
-    close(fd_);
-    error::send_errno("Could not mmap ELF file");
+    f(slots[slot] - 1);
   }
+}
+
+constexpr char          index_magic[8] = {'M', 'D', 'B', 'I', 'N', 'D', 'E', 'X'};
+constexpr std::uint32_t index_version  = 2;
 
-  data_ = reinterpret_cast<std::byte*>(ret);
+enum class index_array : std::size_t
+{
+  symbol_starts,
+  symbol_ends,
+  symbol_indices,
+  eytzinger_starts,
+  eytzinger_ranks,
+  name_slots,
+  demangled_symbols,
+  demangled_offsets,
+  demangled_slots,
+  demangled_names,
+  search_offsets,
+  search_names,
+  count
+};
+constexpr auto n_index_arrays = static_cast<std::size_t>(index_array::count);
+
+// Index images are a header followed by the arrays it locates, each aligned to 8 bytes.
+// An offset of zero marks an array the image does not carry. The symbol table location
+// and string table size tie an image to the symbol table it was built from.
+struct index_header
+{
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t has_demangled_names;
+  std::uint64_t symbol_table_offset;
+  std::uint64_t symbol_count;
+  std::uint64_t string_table_size;
+  struct
+  {
+    std::uint64_t offset;
+    std::uint64_t size;
+  } arrays[n_index_arrays];
+};
+
+index_header index_header_for(const std::byte*           data,
+                              mdb::span<const Elf64_Sym> symbols,
+                              mdb::span<const std::byte> strings)
+{
+  index_header header{};
+  std::copy(std::begin(index_magic), std::end(index_magic), header.magic);
+  header.version = index_version;
+  if (symbols.size() != 0)
+  {
+    header.symbol_table_offset =
+        static_cast<std::uint64_t>(reinterpret_cast<const std::byte*>(symbols.begin()) - data);
+  }
+  header.symbol_count      = symbols.size();
+  header.string_table_size = strings.size();
+  return header;
+}
+
+class index_writer
+{
+ public:
+  explicit index_writer(const index_header& header) : header_{header} {}
+
+  template <class T>
+  void add(index_array array, mdb::span<const T> data)
+  {
+    parts_.push_back(
+        {array, reinterpret_cast<const std::byte*>(data.begin()), data.size() * sizeof(T)});
+  }
+
+  std::vector<std::byte> finish()
+  {
+    std::size_t size = sizeof(index_header);
+    for (auto& part : parts_)
+    {
+      size          = (size + 7) & ~std::size_t{7};
+      auto& located = header_.arrays[static_cast<std::size_t>(part.array)];
+      located       = {size, part.size};
+      size += part.size;
+    }
+
+    std::vector<std::byte> image(size);
+    std::memcpy(image.data(), &header_, sizeof(header_));
+    for (auto& part : parts_)
+    {
+      if (part.size != 0)
+      {
+        auto offset = header_.arrays[static_cast<std::size_t>(part.array)].offset;
+        std::memcpy(image.data() + offset, part.data, part.size);
+      }
+    }
+    return image;
+  }
+
+ private:
+  struct array_part
+  {
+    index_array      array;
+    const std::byte* data;
+    std::size_t      size;
+  };
+
+  index_header            header_;
+  std::vector<array_part> parts_;
+};
+}  // namespace
+
+mdb::elf::elf(const std::filesystem::path& path)
+{
+  path_ = path;
+
+  // Section headers, symbols and strings are all read in place from this mapping, which is
+  // owned from the start so that it is released if parsing throws
+  file_      = mapped_file::open(path);
+  data_      = file_->data();
+  file_size_ = file_->size();
+  if (file_size_ < sizeof(header_))
+  {
+    error::send("Not an ELF file");
+  }
   std::copy(data_, data_ + sizeof(header_), as_bytes(header_));
 
   parse_section_headers();
   build_section_map();
+  build_section_index();
+  read_build_id();
   parse_symbol_table();
-  build_symbol_maps();
+  if (!load_index_cache())
+  {
+    auto symbols =
+        span<const std::byte>{reinterpret_cast<const std::byte*>(symbol_table_.begin()),
+                              reinterpret_cast<const std::byte*>(symbol_table_.end())};
+    advise(data_, symbols, MADV_WILLNEED);
+    advise(data_, string_table_, MADV_WILLNEED);
+    advise(data_, symbols, MADV_SEQUENTIAL);
+    build_symbol_maps();
+    advise(data_, symbols, MADV_NORMAL);
+  }
 }
 
-mdb::elf::~elf()
-{
-  munmap(data_, file_size_);
-  close(fd_);
-}
+mdb::elf::~elf() = default;
 
 void mdb::elf::parse_section_headers()
 {
-  auto n_headers = header_.e_shnum;
+  auto fits = [this](std::size_t count)
+  {
+    return header_.e_shoff <= file_size_ and
+           count <= (file_size_ - header_.e_shoff) / sizeof(Elf64_Shdr);
+  };
+
+  // Past SHN_LORESERVE sections the count moves to the first section header's sh_size
+  std::size_t n_headers = header_.e_shnum;
   if (n_headers == 0 and header_.e_shentsize != 0)
   {
+    if (!fits(1))
+    {
+      error::send("Section header table is outside the ELF file");
+    }
     n_headers = from_bytes<Elf64_Shdr>(data_ + header_.e_shoff).sh_size;
   }
-  section_headers_.resize(header_.e_shnum);
-  std::copy(data_ + header_.e_shoff,
-            data_ + header_.e_shoff + sizeof(Elf64_Shdr) * header_.e_shnum,
-            reinterpret_cast<std::byte*>(section_headers_.data()));
+  if (!fits(n_headers))
+  {
+    error::send("Section header table is outside the ELF file");
+  }
+  section_headers_ = {reinterpret_cast<const Elf64_Shdr*>(data_ + header_.e_shoff), n_headers};
 }
 
 std::string_view mdb::elf::get_section_name(std::size_t index) const
@@ -76,6 +318,32 @@ void mdb::elf::build_section_map()
   }
 }
 
+void mdb::elf::build_section_index()
+{
+  // Only allocated sections have addresses; .tbss takes no space and would overlap its neighbours
+  for (auto& section : section_headers_)
+  {
+    bool is_tbss = (section.sh_flags & SHF_TLS) and section.sh_type == SHT_NOBITS;
+    if ((section.sh_flags & SHF_ALLOC) and section.sh_size != 0 and !is_tbss)
+    {
+      sections_by_address_.push_back(&section);
+    }
+  }
+  std::sort(begin(sections_by_address_),
+            end(sections_by_address_),
+            [](auto lhs, auto rhs) { return lhs->sh_addr < rhs->sh_addr; });
+  for (auto section : sections_by_address_)
+  {
+    section_starts_.push_back(section->sh_addr);
+  }
+
+  string_table_ = get_section_contents(".strtab");
+  if (string_table_.size() == 0)
+  {
+    string_table_ = get_section_contents(".dynstr");
+  }
+}
+
 std::optional<const Elf64_Shdr*> mdb::elf::get_section(std::string_view name) const
 {
   if (section_map_.count(name) == 0)
@@ -96,17 +364,30 @@ mdb::span<const std::byte> mdb::elf::get_section_contents(std::string_view name)
   return {nullptr, std::size_t(0)};
 }
 
+mdb::span<const std::byte> mdb::elf::get_debug_section_contents(std::string_view name) const
+{
+  if (auto sect = get_section(name); sect and sect.value()->sh_type != SHT_NOBITS)
+  {
+    return get_section_contents(name);
+  }
+
+  std::call_once(debug_file_once_, [this] { debug_file_ = debug_file::find(*this); });
+  return debug_file_ ? debug_file_->get_section_contents(name) : span<const std::byte>{};
+}
+
+std::filesystem::path mdb::elf::debug_file_path() const
+{
+  return debug_file_ ? debug_file_->path() : std::filesystem::path();
+}
+
 std::string_view mdb::elf::get_string(std::size_t index) const
 {
-  auto opt_strtab = get_section(".strtab");
-  if (!opt_strtab)
+  if (string_table_.size() == 0)
   {
-    opt_strtab = get_section(".dynstr");
-    if (!opt_strtab)
-      return "";
+    return "";
   }
 
-  return {reinterpret_cast<char*>(data_) + opt_strtab.value()->sh_offset + index};
+  return {reinterpret_cast<const char*>(string_table_.begin()) + index};
 }
 
 const Elf64_Shdr* mdb::elf::get_section_containing_address(file_addr addr) const
@@ -116,29 +397,23 @@ const Elf64_Shdr* mdb::elf::get_section_containing_address(file_addr addr) const
     return nullptr;
   }
 
-  for (const auto& section : section_headers_)
+  auto next = std::upper_bound(begin(section_starts_), end(section_starts_), addr.addr());
+  if (next == begin(section_starts_))
   {
-    if (section.sh_addr <= addr.addr() and section.sh_addr + section.sh_size > addr.addr())
-    {
-      return &section;
-    }
+    return nullptr;
   }
 
-  return nullptr;
+  auto section = sections_by_address_[static_cast<std::size_t>(next - begin(section_starts_)) - 1];
+  return addr.addr() < section->sh_addr + section->sh_size ? section : nullptr;
 }
 
 const Elf64_Shdr* mdb::elf::get_section_containing_address(virt_addr addr) const
 {
-  for (const auto& section : section_headers_)
+  if (addr < load_bias_)
   {
-    if (load_bias_ + section.sh_addr <= addr and
-        load_bias_ + section.sh_addr + section.sh_size > addr)
-    {
-      return &section;
-    }
+    return nullptr;
   }
-
-  return nullptr;
+  return get_section_containing_address(file_addr{*this, addr.addr() - load_bias_.addr()});
 }
 
 std::optional<mdb::file_addr> mdb::elf::get_section_start_address(std::string_view name) const
@@ -164,58 +439,769 @@ void mdb::elf::parse_symbol_table()
   }
 
   auto symtab = *opt_symtab;
-  symbol_table_.resize(symtab->sh_size / symtab->sh_entsize);
-  std::copy(data_ + symtab->sh_offset,
-            data_ + symtab->sh_offset + symtab->sh_size,
-            reinterpret_cast<std::byte*>(symbol_table_.data()));
+  if (symtab->sh_offset + symtab->sh_size > file_size_)
+  {
+    error::send("Symbol table is outside the ELF file");
+  }
+  symbol_table_ = {reinterpret_cast<const Elf64_Sym*>(data_ + symtab->sh_offset),
+                   symtab->sh_size / sizeof(Elf64_Sym)};
+
+  // Only the dynamic symbol table comes with hash tables; malformed ones are ignored
+  auto hash_table_for_symtab = [&](std::string_view name, std::size_t minimum_size)
+  {
+    auto section = get_section(name);
+    if (!section or section.value()->sh_link != symtab - section_headers_.begin() or
+        section.value()->sh_offset + section.value()->sh_size > file_size_ or
+        section.value()->sh_size < minimum_size)
+    {
+      return span<const std::byte>{};
+    }
+    return span<const std::byte>{data_ + section.value()->sh_offset, section.value()->sh_size};
+  };
+  auto word = [](span<const std::byte> table, std::size_t offset)
+  { return std::size_t{from_bytes<std::uint32_t>(table.begin() + offset)}; };
+
+  gnu_hash_ = hash_table_for_symtab(".gnu.hash", 16);
+  if (gnu_hash_.size() != 0 and
+      (word(gnu_hash_, 0) == 0 or word(gnu_hash_, 8) == 0 or
+       gnu_hash_.size() < 16 + word(gnu_hash_, 8) * 8 + word(gnu_hash_, 0) * 4))
+  {
+    gnu_hash_ = {};
+  }
+
+  sysv_hash_ = hash_table_for_symtab(".hash", 8);
+  if (sysv_hash_.size() != 0 and
+      (word(sysv_hash_, 0) == 0 or
+       sysv_hash_.size() < 8 + (word(sysv_hash_, 0) + word(sysv_hash_, 4)) * 4))
+  {
+    sysv_hash_ = {};
+  }
 }
 
 void mdb::elf::build_symbol_maps()
 {
-  for (auto& symbol : symbol_table_)
+  std::vector<std::uint32_t> indices;
+  for (std::size_t i = 0; i < symbol_table_.size(); ++i)
+  {
+    auto& symbol = symbol_table_[i];
+    if (symbol.st_value != 0 and symbol.st_name != 0 and ELF64_ST_TYPE(symbol.st_info) != STT_TLS)
+    {
+      indices.push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+
+  // The first symbol in the table wins when several share a start address
+  auto start_of = [this](std::uint32_t index) { return symbol_table_[index].st_value; };
+  std::stable_sort(begin(indices),
+                   end(indices),
+                   [&](auto lhs, auto rhs) { return start_of(lhs) < start_of(rhs); });
+  indices.erase(std::unique(begin(indices),
+                            end(indices),
+                            [&](auto lhs, auto rhs) { return start_of(lhs) == start_of(rhs); }),
+                end(indices));
+
+  std::vector<std::uint64_t> starts;
+  std::vector<std::uint64_t> ends;
+  starts.reserve(indices.size());
+  ends.reserve(indices.size());
+  for (auto index : indices)
+  {
+    auto& symbol = symbol_table_[index];
+    starts.push_back(symbol.st_value);
+    ends.push_back(symbol.st_value + symbol.st_size);
+  }
+
+  std::vector<std::uint64_t> eytzinger_starts(starts.size() + 1);
+  std::vector<std::uint32_t> eytzinger_ranks(starts.size() + 1);
+  fill_eytzinger(starts, eytzinger_starts, eytzinger_ranks, 1, 0);
+
+  // Names are looked up through the binary's own hash table when it has one
+  std::vector<std::uint32_t> name_slots;
+  if (!has_hash_table())
+  {
+    name_slots = build_name_slots(symbol_table_.size(),
+                                  [this](std::size_t i)
+                                  { return get_string(symbol_table_[i].st_name); });
+  }
+
+  index_writer writer(index_header_for(data_, symbol_table_, string_table_));
+  writer.add(index_array::symbol_starts, span<const std::uint64_t>(starts));
+  writer.add(index_array::symbol_ends, span<const std::uint64_t>(ends));
+  writer.add(index_array::symbol_indices, span<const std::uint32_t>(indices));
+  writer.add(index_array::eytzinger_starts, span<const std::uint64_t>(eytzinger_starts));
+  writer.add(index_array::eytzinger_ranks, span<const std::uint32_t>(eytzinger_ranks));
+  writer.add(index_array::name_slots, span<const std::uint32_t>(name_slots));
+  index_image_ = writer.finish();
+  attach_index(index_image_, true);
+}
+
+void mdb::elf::build_demangled_name_map() const
+{
+  if (has_demangled_names_)
+  {
+    return;
+  }
+
+  // Each thread packs its names null-terminated into its own buffer
+  struct demangled
+  {
+    std::vector<std::uint32_t> symbols;
+    std::vector<std::uint32_t> offsets;
+    std::string                names;
+  };
+
+  auto n_helpers = 0u;
+  if (symbol_table_.size() >= 4096)
+  {
+    n_helpers = claim_demangle_helpers(std::max(1u, std::thread::hardware_concurrency()) - 1);
+  }
+  auto n_threads = std::size_t{n_helpers} + 1;
+  auto chunk     = (symbol_table_.size() + n_threads - 1) / n_threads;
+
+  std::vector<demangled> results(n_threads);
+  auto                   work = [&](std::size_t thread)
   {
-    auto mangled_name = get_string(symbol.st_name);
-    int  demangle_status;
-    auto demangled_name =
-        abi::__cxa_demangle(mangled_name.data(), nullptr, nullptr, &demangle_status);
+    // One buffer per thread, grown by __cxa_demangle itself, avoids a malloc per name
+    char*       buffer = nullptr;
+    std::size_t length = 0;
+    auto        first  = std::min(symbol_table_.size(), thread * chunk);
+    auto        last   = std::min(symbol_table_.size(), first + chunk);
+    auto&       result = results[thread];
+    for (auto i = first; i < last; ++i)
+    {
+      auto name = get_string(symbol_table_[i].st_name);
+      if (!is_mangled(name))
+      {
+        continue;
+      }
+
+      int  status;
+      auto text = abi::__cxa_demangle(name.data(), buffer, &length, &status);
+      if (status == 0)
+      {
+        buffer = text;
+        result.symbols.push_back(static_cast<std::uint32_t>(i));
+        result.offsets.push_back(static_cast<std::uint32_t>(result.names.size()));
+        result.names.append(text);
+        result.names.push_back('\0');
+      }
+    }
+    std::free(buffer);
+  };
 
-    if (demangle_status == 0)
+  std::vector<std::thread> threads;
+  for (std::size_t thread = 1; thread < n_threads; ++thread)
+  {
+    threads.emplace_back(work, thread);
+  }
+  work(0);
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+  demangle_helpers -= n_helpers;
+
+  auto& all = results[0];
+  for (std::size_t thread = 1; thread < n_threads; ++thread)
+  {
+    auto base = static_cast<std::uint32_t>(all.names.size());
+    for (auto offset : results[thread].offsets)
     {
-      symbol_name_map_.insert({demangled_name, &symbol});
-      free(demangled_name);
+      all.offsets.push_back(base + offset);
     }
-    symbol_name_map_.insert({mangled_name, &symbol});
+    all.symbols.insert(
+        all.symbols.end(), results[thread].symbols.begin(), results[thread].symbols.end());
+    all.names += results[thread].names;
+  }
+  auto name_of = [&](std::size_t entry)
+  { return std::string_view(all.names.data() + all.offsets[entry]); };
+  auto slots = build_name_slots(all.symbols.size(), name_of);
 
-    if (symbol.st_value != 0 and symbol.st_name != 0 and ELF64_ST_TYPE(symbol.st_info) != STT_TLS)
+  auto header                = index_header_for(data_, symbol_table_, string_table_);
+  header.has_demangled_names = 1;
+  index_writer writer(header);
+  writer.add(index_array::demangled_symbols, span<const std::uint32_t>(all.symbols));
+  writer.add(index_array::demangled_offsets, span<const std::uint32_t>(all.offsets));
+  writer.add(index_array::demangled_slots, span<const std::uint32_t>(slots));
+  writer.add(index_array::demangled_names, span<const char>(all.names.data(), all.names.size()));
+  demangled_image_ = writer.finish();
+  attach_index(demangled_image_, false);
+}
+
+bool mdb::elf::attach_index(span<const std::byte> image, bool is_complete) const
+{
+  if (image.size() < sizeof(index_header))
+  {
+    return false;
+  }
+  auto header = from_bytes<index_header>(image.begin());
+  auto key    = index_header_for(data_, symbol_table_, string_table_);
+  if (!std::equal(std::begin(index_magic), std::end(index_magic), header.magic) or
+      header.version != index_version or header.symbol_table_offset != key.symbol_table_offset or
+      header.symbol_count != key.symbol_count or header.string_table_size != key.string_table_size)
+  {
+    return false;
+  }
+
+  std::array<span<const std::byte>, n_index_arrays> arrays;
+  std::array<bool, n_index_arrays>                  present{};
+  for (std::size_t i = 0; i < n_index_arrays; ++i)
+  {
+    auto [offset, size] = header.arrays[i];
+    if (offset == 0)
     {
-      auto addr_range = std::pair(file_addr{*this, symbol.st_value},
-                                  file_addr{*this, symbol.st_value + symbol.st_size});
-      symbol_addr_map_.insert({addr_range, &symbol});
+      continue;
     }
+    if (offset % 8 != 0 or offset > image.size() or size > image.size() - offset)
+    {
+      return false;
+    }
+    arrays[i]  = {image.begin() + offset, size};
+    present[i] = true;
   }
+
+  auto view = [&](index_array array, auto element)
+  {
+    using T     = decltype(element);
+    auto& bytes = arrays[static_cast<std::size_t>(array)];
+    return span<const T>{reinterpret_cast<const T*>(bytes.begin()), bytes.size() / sizeof(T)};
+  };
+  auto has = [&](index_array array) { return present[static_cast<std::size_t>(array)]; };
+  auto is_power_of_two = [](std::size_t n) { return n != 0 and (n & (n - 1)) == 0; };
+
+  // A stale or damaged file must not send lookups outside the tables they index. Slots hold
+  // an entry index plus one, and a probe only ends at an empty slot.
+  auto all_below = [](auto values, std::size_t limit)
+  {
+    return std::all_of(
+        values.begin(), values.end(), [=](auto value) { return std::size_t{value} < limit; });
+  };
+  auto valid_slots = [&](span<const std::uint32_t> slots, std::size_t n_entries)
+  {
+    return is_power_of_two(slots.size()) and all_below(slots, n_entries + 1) and
+           std::find(slots.begin(), slots.end(), 0u) != slots.end();
+  };
+  auto n_symbols = symbol_table_.size();
+
+  auto starts           = view(index_array::symbol_starts, std::uint64_t{});
+  auto ends             = view(index_array::symbol_ends, std::uint64_t{});
+  auto indices          = view(index_array::symbol_indices, std::uint32_t{});
+  auto eytzinger_starts = view(index_array::eytzinger_starts, std::uint64_t{});
+  auto eytzinger_ranks  = view(index_array::eytzinger_ranks, std::uint32_t{});
+  auto name_slots       = view(index_array::name_slots, std::uint32_t{});
+  bool has_symbols      = has(index_array::symbol_starts);
+  if ((is_complete and !has_symbols) or
+      (has_symbols and
+       (ends.size() != starts.size() or indices.size() != starts.size() or
+        eytzinger_starts.size() != starts.size() + 1 or
+        eytzinger_ranks.size() != starts.size() + 1 or
+        has_hash_table() != (name_slots.size() == 0) or
+        (name_slots.size() != 0 and !valid_slots(name_slots, n_symbols)) or
+        !all_below(indices, n_symbols) or !all_below(eytzinger_ranks, starts.size() + 1))))
+  {
+    return false;
+  }
+
+  auto search_offsets = view(index_array::search_offsets, std::uint32_t{});
+  auto search_names   = view(index_array::search_names, char{});
+  bool has_search     = has(index_array::search_offsets);
+  if (has_search and
+      (!has(index_array::search_names) or
+       (search_names.size() != 0 and search_names.end()[-1] != '\0') or
+       !std::is_sorted(search_offsets.begin(), search_offsets.end()) or
+       (search_offsets.size() != 0 and search_offsets.end()[-1] >= search_names.size())))
+  {
+    return false;
+  }
+
+  auto demangled_symbols = view(index_array::demangled_symbols, std::uint32_t{});
+  auto demangled_offsets = view(index_array::demangled_offsets, std::uint32_t{});
+  auto demangled_slots   = view(index_array::demangled_slots, std::uint32_t{});
+  auto demangled_names   = view(index_array::demangled_names, char{});
+  if (header.has_demangled_names and
+      (demangled_offsets.size() != demangled_symbols.size() or
+       !valid_slots(demangled_slots, demangled_symbols.size()) or
+       (demangled_names.size() != 0 and demangled_names.end()[-1] != '\0') or
+       !all_below(demangled_symbols, n_symbols) or
+       !all_below(demangled_offsets, demangled_names.size())))
+  {
+    return false;
+  }
+
+  if (has_symbols)
+  {
+    symbol_starts_    = starts;
+    symbol_ends_      = ends;
+    symbol_indices_   = indices;
+    eytzinger_starts_ = eytzinger_starts;
+    eytzinger_ranks_  = eytzinger_ranks;
+    name_slots_       = name_slots;
+  }
+  if (header.has_demangled_names)
+  {
+    demangled_symbols_   = demangled_symbols;
+    demangled_offsets_   = demangled_offsets;
+    demangled_slots_     = demangled_slots;
+    demangled_names_     = demangled_names;
+    has_demangled_names_ = true;
+  }
+  if (has_search)
+  {
+    search_offsets_   = search_offsets;
+    search_names_     = search_names;
+    has_search_index_ = true;
+  }
+  return true;
+}
+
+mdb::span<const std::byte> mdb::elf::find_build_id(span<const std::byte> notes)
+{
+  // Each note is a header, then the name and descriptor, both padded to 4 bytes
+  for (std::size_t offset = 0; offset + sizeof(Elf64_Nhdr) <= notes.size();)
+  {
+    auto note        = from_bytes<Elf64_Nhdr>(notes.begin() + offset);
+    auto name_offset = offset + sizeof(Elf64_Nhdr);
+    auto desc_offset = name_offset + ((note.n_namesz + 3) & ~3u);
+    auto next        = desc_offset + ((note.n_descsz + 3) & ~3u);
+    if (next > notes.size())
+    {
+      break;
+    }
+
+    auto name =
+        std::string_view(reinterpret_cast<const char*>(notes.begin() + name_offset), note.n_namesz);
+    if (note.n_type == NT_GNU_BUILD_ID and name == std::string_view("GNU", 4) and
+        note.n_descsz != 0)
+    {
+      return {notes.begin() + desc_offset, note.n_descsz};
+    }
+    offset = next;
+  }
+  return {};
+}
+
+std::string mdb::elf::build_id_string() const
+{
+  std::string ret;
+  for (auto byte : build_id_)
+  {
+    constexpr char digits[] = "0123456789abcdef";
+    ret.push_back(digits[std::to_integer<unsigned>(byte) >> 4]);
+    ret.push_back(digits[std::to_integer<unsigned>(byte) & 0xf]);
+  }
+  return ret;
+}
+
+void mdb::elf::read_build_id()
+{
+  for (auto& section : section_headers_)
+  {
+    if (section.sh_type == SHT_NOTE and section.sh_offset + section.sh_size <= file_size_)
+    {
+      build_id_ = find_build_id({data_ + section.sh_offset, section.sh_size});
+      if (build_id_.size() != 0)
+      {
+        return;
+      }
+    }
+  }
+}
+
+std::filesystem::path mdb::elf::index_cache_directory()
+{
+  if (auto directory = std::getenv("MDB_CACHE_DIR"))
+  {
+    return directory;
+  }
+  if (auto directory = std::getenv("XDG_CACHE_HOME"); directory and *directory)
+  {
+    return std::filesystem::path(directory) / "mdb";
+  }
+  if (auto home = std::getenv("HOME"); home and *home)
+  {
+    return std::filesystem::path(home) / ".cache" / "mdb";
+  }
+  return {};
+}
+
+namespace
+{
+std::filesystem::path index_cache_path(const mdb::elf& obj)
+{
+  auto directory = mdb::elf::index_cache_directory();
+  if (obj.build_id().size() == 0 or directory.empty())
+  {
+    return {};
+  }
+  return directory / (obj.build_id_string() + ".index");
+}
+}  // namespace
+
+bool mdb::elf::load_index_cache()
+{
+  // Any trouble reaching the cache, such as an unreadable directory, is just a miss
+  auto            path = index_cache_path(*this);
+  std::error_code lookup_error;
+  if (path.empty() or !std::filesystem::exists(path, lookup_error))
+  {
+    return false;
+  }
+
+  std::unique_ptr<mapped_file> cache;
+  try
+  {
+    cache = mapped_file::open(path);
+  }
+  catch (const error&)
+  {
+    return false;
+  }
+
+  // A file that fails validation is dropped so that the rebuilt index replaces it
+  if (!attach_index(cache->contents(), true))
+  {
+    cache.reset();
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+    return false;
+  }
+  index_cache_ = std::move(cache);
+  return true;
+}
+
+void mdb::elf::write_index_cache() const
+{
+  auto path = index_cache_path(*this);
+  if (path.empty())
+  {
+    return;
+  }
+
+  auto header                = index_header_for(data_, symbol_table_, string_table_);
+  header.has_demangled_names = has_demangled_names_;
+  index_writer writer(header);
+  writer.add(index_array::symbol_starts, symbol_starts_);
+  writer.add(index_array::symbol_ends, symbol_ends_);
+  writer.add(index_array::symbol_indices, symbol_indices_);
+  writer.add(index_array::eytzinger_starts, eytzinger_starts_);
+  writer.add(index_array::eytzinger_ranks, eytzinger_ranks_);
+  writer.add(index_array::name_slots, name_slots_);
+  if (has_demangled_names_)
+  {
+    writer.add(index_array::demangled_symbols, demangled_symbols_);
+    writer.add(index_array::demangled_offsets, demangled_offsets_);
+    writer.add(index_array::demangled_slots, demangled_slots_);
+    writer.add(index_array::demangled_names, demangled_names_);
+  }
+  if (has_search_index_)
+  {
+    writer.add(index_array::search_offsets, search_offsets_);
+    writer.add(index_array::search_names, search_names_);
+  }
+  auto image = writer.finish();
+
+  // Written under a private name and renamed, so readers never map a partial file. The
+  // cache only saves time, so failing to write it is not an error.
+  auto temporary = path;
+  temporary += "." + std::to_string(getpid());
+  try
+  {
+    std::error_code ignored;
+    std::filesystem::create_directories(path.parent_path(), ignored);
+    {
+      auto file = mapped_file::create(temporary, image.size());
+      std::memcpy(file->data(), image.data(), image.size());
+    }
+    std::filesystem::rename(temporary, path, ignored);
+  }
+  catch (const error&)
+  {
+  }
+  std::error_code ignored;
+  std::filesystem::remove(temporary, ignored);
+}
+
+std::vector<const Elf64_Sym*> mdb::elf::find_in_hash_table(std::string_view name) const
+{
+  std::vector<const Elf64_Sym*> ret;
+  auto                          add_if_named = [&](std::size_t index)
+  {
+    if (index < symbol_table_.size() and get_string(symbol_table_[index].st_name) == name)
+    {
+      ret.push_back(&symbol_table_[index]);
+    }
+  };
+
+  if (gnu_hash_.size() != 0)
+  {
+    auto word = [this](std::size_t offset)
+    { return std::size_t{from_bytes<std::uint32_t>(gnu_hash_.begin() + offset)}; };
+    auto n_buckets     = word(0);
+    auto symbol_offset = word(4);
+    auto bloom_size    = word(8);
+    auto bloom_shift   = word(12);
+    auto buckets       = 16 + bloom_size * 8;
+    auto chains        = buckets + n_buckets * 4;
+
+    // The bloom filter rejects most absent names before touching the buckets
+    auto hash  = gnu_hash(name);
+    auto bloom = from_bytes<std::uint64_t>(gnu_hash_.begin() + 16 + hash / 64 % bloom_size * 8);
+    auto mask  = std::uint64_t{1} << hash % 64 | std::uint64_t{1} << (hash >> bloom_shift) % 64;
+    if ((bloom & mask) == mask)
+    {
+      for (auto index = word(buckets + hash % n_buckets * 4);
+           index != 0 and index >= symbol_offset and
+           chains + (index - symbol_offset) * 4 + 4 <= gnu_hash_.size();
+           ++index)
+      {
+        auto chain_hash = word(chains + (index - symbol_offset) * 4);
+        if ((chain_hash | 1) == (hash | 1))
+        {
+          add_if_named(index);
+        }
+        if (chain_hash & 1)
+        {
+          break;
+        }
+      }
+    }
+
+    // Undefined symbols sit below the hashed range
+    for (std::size_t index = 1; index < std::min(symbol_offset, symbol_table_.size()); ++index)
+    {
+      add_if_named(index);
+    }
+    return ret;
+  }
+
+  auto word = [this](std::size_t offset)
+  { return std::size_t{from_bytes<std::uint32_t>(sysv_hash_.begin() + offset)}; };
+  auto n_buckets = word(0);
+  auto n_chains  = word(4);
+  auto index     = word(8 + sysv_hash(name) % n_buckets * 4);
+  for (std::size_t steps = 0; index != STN_UNDEF and index < n_chains and steps < n_chains; ++steps)
+  {
+    add_if_named(index);
+    index = word(8 + (n_buckets + index) * 4);
+  }
+  return ret;
 }
 
 std::vector<const Elf64_Sym*> mdb::elf::get_symbols_by_name(std::string_view name) const
 {
-  auto [begin, end] = symbol_name_map_.equal_range(name);
+  auto ret = get_symbols_by_raw_name(name);
+  if (ret.empty() and !is_mangled(name))
+  {
+    ret = get_symbols_by_demangled_name(name);
+  }
+  return ret;
+}
+
+std::vector<const Elf64_Sym*> mdb::elf::get_symbols_by_raw_name(std::string_view name) const
+{
+  if (has_hash_table())
+  {
+    return find_in_hash_table(name);
+  }
 
   std::vector<const Elf64_Sym*> ret;
-  std::transform(begin, end, std::back_inserter(ret), [](auto& pair) { return pair.second; });
+  probe_name_slots(name_slots_,
+                   name,
+                   [&](std::size_t index)
+                   {
+                     if (get_string(symbol_table_[index].st_name) == name)
+                       ret.push_back(&symbol_table_[index]);
+                   });
+  return ret;
+}
+
+std::vector<const Elf64_Sym*> mdb::elf::get_symbols_by_demangled_name(std::string_view name) const
+{
+  ensure_name_indexes();
+  std::vector<const Elf64_Sym*> ret;
+  probe_name_slots(demangled_slots_,
+                   name,
+                   [&](std::size_t entry)
+                   {
+                     auto text = demangled_names_.begin() + demangled_offsets_[entry];
+                     if (std::string_view(text) == name)
+                       ret.push_back(&symbol_table_[demangled_symbols_[entry]]);
+                   });
+  return ret;
+}
+
+void mdb::elf::build_name_search_index() const
+{
+  std::vector<std::string_view> names;
+  names.reserve(symbol_table_.size() + demangled_offsets_.size());
+  for (auto& symbol : symbol_table_)
+  {
+    if (auto name = get_string(symbol.st_name); !name.empty())
+      names.push_back(name);
+  }
+  for (auto offset : demangled_offsets_)
+  {
+    names.push_back(demangled_names_.begin() + offset);
+  }
+  std::sort(begin(names), end(names));
+  names.erase(std::unique(begin(names), end(names)), end(names));
+
+  std::size_t total = 0;
+  for (auto name : names)
+  {
+    total += name.size() + 1;
+  }
+  std::string                packed;
+  std::vector<std::uint32_t> offsets;
+  packed.reserve(total);
+  offsets.reserve(names.size());
+  for (auto name : names)
+  {
+    offsets.push_back(static_cast<std::uint32_t>(packed.size()));
+    packed.append(name);
+    packed.push_back('\0');
+  }
+
+  index_writer writer(index_header_for(data_, symbol_table_, string_table_));
+  writer.add(index_array::search_offsets, span<const std::uint32_t>(offsets));
+  writer.add(index_array::search_names, span<const char>(packed.data(), packed.size()));
+  search_image_ = writer.finish();
+  attach_index(search_image_, false);
+}
+
+void mdb::elf::build_name_indexes() const
+{
+  if (has_demangled_names_ and has_search_index_)
+  {
+    return;
+  }
+  if (!has_demangled_names_)
+  {
+    build_demangled_name_map();
+  }
+  if (!has_search_index_)
+  {
+    build_name_search_index();
+  }
+  // The one place the cache is written, once it holds everything a later run would build
+  write_index_cache();
+}
+
+void mdb::elf::ensure_name_indexes() const
+{
+  // Demangling and sorting every name takes over a second on the largest libraries, so only
+  // objects someone searches pay for it
+  std::call_once(name_indexes_once_, [this] { build_name_indexes(); });
+}
 
+std::vector<std::string_view> mdb::elf::find_symbol_names_with_prefix(
+    std::string_view prefix, std::size_t max_results) const
+{
+  ensure_name_indexes();
+
+  auto name_at = [this](std::uint32_t offset)
+  { return std::string_view(search_names_.begin() + offset); };
+  auto it = std::lower_bound(search_offsets_.begin(),
+                             search_offsets_.end(),
+                             prefix,
+                             [&](std::uint32_t offset, std::string_view value)
+                             { return name_at(offset) < value; });
+
+  std::vector<std::string_view> ret;
+  for (; it != search_offsets_.end() and ret.size() < max_results; ++it)
+  {
+    auto name = name_at(*it);
+    if (name.substr(0, prefix.size()) != prefix)
+      break;
+    ret.push_back(name);
+  }
   return ret;
 }
 
+std::vector<std::string_view> mdb::elf::find_symbol_names_containing(
+    std::string_view text, std::size_t max_results) const
+{
+  ensure_name_indexes();
+
+  // One pass over the packed names; each hit skips the rest of the name it landed in
+  std::vector<std::string_view> ret;
+  auto                          data = search_names_.begin();
+  auto                          size = search_names_.size();
+  for (std::size_t pos = 0; pos < size and ret.size() < max_results;)
+  {
+    auto hit = static_cast<const char*>(memmem(data + pos, size - pos, text.data(), text.size()));
+    if (!hit)
+      break;
+
+    auto next = std::upper_bound(
+        search_offsets_.begin(), search_offsets_.end(), static_cast<std::uint32_t>(hit - data));
+    ret.push_back(std::string_view(data + *std::prev(next)));
+    pos = next == search_offsets_.end() ? size : *next;
+  }
+  return ret;
+}
+
+std::string mdb::elf::get_demangled_name(const Elf64_Sym& symbol) const
+{
+  auto name = get_string(symbol.st_name);
+  if (!is_mangled(name))
+  {
+    return std::string(name);
+  }
+
+  int  status;
+  auto demangled = abi::__cxa_demangle(name.data(), nullptr, nullptr, &status);
+  if (status != 0)
+  {
+    return std::string(name);
+  }
+  std::string ret(demangled);
+  std::free(demangled);
+  return ret;
+}
+
+std::size_t mdb::elf::symbols_starting_at_or_before(std::uint64_t addr) const
+{
+  // Branch-free descent; the prefetch pulls in the great-grandchildren a few levels early
+  auto        starts = eytzinger_starts_.begin();
+  std::size_t slot   = 1;
+  while (slot < eytzinger_starts_.size())
+  {
+    __builtin_prefetch(starts + std::min(slot * 8, eytzinger_starts_.size() - 1));
+    slot = 2 * slot + (starts[slot] <= addr);
+  }
+
+  // Undo the trailing right turns to reach the first start above addr
+  slot >>= __builtin_ffsll(static_cast<long long>(~slot));
+  return slot == 0 ? symbol_starts_.size() : eytzinger_ranks_[slot];
+}
+
+std::optional<const Elf64_Sym*> mdb::elf::symbol_containing(std::uint64_t addr,
+                                                            std::size_t   rank) const
+{
+  if (rank == 0)
+  {
+    return std::nullopt;
+  }
+
+  auto candidate = rank - 1;
+  if (symbol_starts_[candidate] == addr or addr < symbol_ends_[candidate])
+  {
+    return &symbol_table_[symbol_indices_[candidate]];
+  }
+  return std::nullopt;
+}
+
 std::optional<const Elf64_Sym*> mdb::elf::get_symbol_at_address(file_addr address) const
 {
   if (address.elf_file() != this)
     return std::nullopt;
 
-  file_addr null_addr;
-  auto      it = symbol_addr_map_.find({address, null_addr});
-  if (it == end(symbol_addr_map_))
+  auto rank = symbols_starting_at_or_before(address.addr());
+  if (rank == 0 or symbol_starts_[rank - 1] != address.addr())
     return std::nullopt;
 
-  return it->second;
+  return &symbol_table_[symbol_indices_[rank - 1]];
 }
 
 std::optional<const Elf64_Sym*> mdb::elf::get_symbol_at_address(virt_addr address) const
@@ -225,38 +1211,133 @@ std::optional<const Elf64_Sym*> mdb::elf::get_symbol_at_address(virt_addr addres
 
 std::optional<const Elf64_Sym*> mdb::elf::get_symbol_containing_address(file_addr address) const
 {
-  if (address.elf_file() != this or symbol_addr_map_.empty())
+  if (address.elf_file() != this)
   {
     return std::nullopt;
   }
 
-  file_addr null_addr;
+  return symbol_containing(address.addr(), symbols_starting_at_or_before(address.addr()));
+}
+
+std::optional<const Elf64_Sym*> mdb::elf::get_symbol_containing_address(virt_addr address) const
+{
+  return get_symbol_containing_address(address.to_file_addr(*this));
+}
 
-  auto it = symbol_addr_map_.lower_bound({address, null_addr});
+std::vector<std::optional<const Elf64_Sym*>> mdb::elf::symbolize(
+    span<const virt_addr> addresses) const
+{
+  std::vector<std::optional<const Elf64_Sym*>> ret;
+  ret.reserve(addresses.size());
 
-  if (it != end(symbol_addr_map_))
+  // Symbol ranges never leave their section, so the load bias alone maps addresses back
+  auto bias      = load_bias_.addr();
+  auto by_offset = [bias](virt_addr lhs, virt_addr rhs)
+  { return lhs.addr() - bias < rhs.addr() - bias; };
+  if (!std::is_sorted(addresses.begin(), addresses.end(), by_offset))
   {
-    if (auto [key, value] = *it; key.first == address)
+    for (auto address : addresses)
     {
-      return value;
+      auto addr = address.addr() - bias;
+      ret.push_back(symbol_containing(addr, symbols_starting_at_or_before(addr)));
     }
+    return ret;
   }
 
-  if (it == begin(symbol_addr_map_))
+  // Sorted input is merged against the sorted starts, galloping over the gaps
+  auto        starts = symbol_starts_.begin();
+  auto        count  = symbol_starts_.size();
+  std::size_t rank   = 0;
+  for (auto address : addresses)
   {
-    return std::nullopt;
+    auto addr = address.addr() - bias;
+    auto low  = rank;
+    auto high = rank;
+    for (std::size_t step = 1; high < count and starts[high] <= addr; step *= 2)
+    {
+      low = high + 1;
+      high += step;
+    }
+    high = std::min(high, count);
+    rank = static_cast<std::size_t>(std::upper_bound(starts + low, starts + high, addr) - starts);
+    ret.push_back(symbol_containing(addr, rank));
   }
+  return ret;
+}
 
-  --it;
-  if (auto [key, value] = *it; key.first < address and key.second > address)
+std::pair<mdb::virt_addr, mdb::virt_addr> mdb::elf::loaded_range() const
+{
+  if (sections_by_address_.empty())
   {
-    return value;
+    return {load_bias_, load_bias_};
   }
 
-  return std::nullopt;
+  std::uint64_t high = 0;
+  for (auto section : sections_by_address_)
+  {
+    high = std::max(high, section->sh_addr + section->sh_size);
+  }
+  return {load_bias_ + section_starts_.front(), load_bias_ + high};
 }
 
-std::optional<const Elf64_Sym*> mdb::elf::get_symbol_containing_address(virt_addr address) const
+mdb::elf& mdb::elf_collection::push(std::unique_ptr<elf> obj)
 {
-  return get_symbol_containing_address(address.to_file_addr(*this));
-}
\ No newline at end of file
+  auto& ret = *obj;
+  elves_.push_back(std::move(obj));
+  build_range_index();
+  return ret;
+}
+
+void mdb::elf_collection::remove(const elf& obj)
+{
+  elves_.erase(std::remove_if(begin(elves_),
+                              end(elves_),
+                              [&](auto& candidate) { return candidate.get() == &obj; }),
+               end(elves_));
+  build_range_index();
+}
+
+void mdb::elf_collection::build_range_index()
+{
+  std::vector<const elf*> sorted;
+  for (auto& obj : elves_)
+  {
+    if (auto [low, high] = obj->loaded_range(); low < high)
+    {
+      sorted.push_back(obj.get());
+    }
+  }
+  std::sort(begin(sorted),
+            end(sorted),
+            [](auto lhs, auto rhs)
+            { return lhs->loaded_range().first < rhs->loaded_range().first; });
+
+  range_starts_.clear();
+  range_ends_.clear();
+  for (auto obj : sorted)
+  {
+    auto [low, high] = obj->loaded_range();
+    range_starts_.push_back(low.addr());
+    range_ends_.push_back(high.addr());
+  }
+  range_elves_ = std::move(sorted);
+}
+
+const mdb::elf* mdb::elf_collection::get_elf_containing_address(virt_addr address) const
+{
+  auto next = std::upper_bound(begin(range_starts_), end(range_starts_), address.addr());
+  if (next == begin(range_starts_))
+  {
+    return nullptr;
+  }
+
+  auto index = static_cast<std::size_t>(next - begin(range_starts_)) - 1;
+  return address.addr() < range_ends_[index] ? range_elves_[index] : nullptr;
+}
+
+const mdb::elf* mdb::elf_collection::get_elf_by_path(const std::filesystem::path& path) const
+{
+  auto it =
+      std::find_if(begin(elves_), end(elves_), [&](auto& obj) { return obj->path() == path; });
+  return it == end(elves_) ? nullptr : it->get();
+}
@@ -0,0 +1,364 @@
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <cstring>
+#include <libmdb/error.hpp>
+#include <libmdb/execution_log.hpp>
+#include <limits>
+
+namespace
+{
+constexpr std::size_t register_fields = sizeof(user_regs_struct) / sizeof(std::uint64_t);
+static_assert(register_fields <= 64);
+
+mdb::stop_reason stopped_with(mdb::trap_type trap_reason)
+{
+  mdb::stop_reason reason(W_STOPCODE(SIGTRAP));
+  reason.trap_reason = trap_reason;
+  return reason;
+}
+}  // namespace
+
+mdb::execution_log::execution_log(process& proc, std::uint64_t snapshot_interval)
+    : process_{&proc}, snapshot_interval_{snapshot_interval}
+{
+  if (snapshot_interval_ == 0)
+  {
+    error::send("Snapshot interval must be positive");
+  }
+}
+
+mdb::stop_reason mdb::execution_log::step()
+{
+  return record(1).reason;
+}
+
+mdb::stop_reason mdb::execution_log::resume()
+{
+  // Recording single-steps everything, stopping in front of breakpoints rather than on them.
+  // The step loop only stops at a site once its condition and actions ask it to, so internal
+  // sites have already run their actions and been stepped over.
+  auto reason = record(std::numeric_limits<std::uint64_t>::max()).reason;
+  auto pc     = process_->get_pc();
+  if (reason.reason == process_state::stopped and
+      reason.trap_reason == trap_type::single_step and
+      process_->breakpoint_sites().enabled_stoppoint_at_address(pc))
+  {
+    reason.trap_reason = trap_type::software_break;
+  }
+  return reason;
+}
+
+mdb::step_result mdb::execution_log::record(std::uint64_t max_steps)
+{
+  last_watchpoint_.reset();
+  pending_regs_.reset();
+  auto result = process_->step_instructions(
+      max_steps, std::nullopt, [this](const user_regs_struct& regs) { observe(regs); });
+  pending_regs_.reset();
+  return result;
+}
+
+void mdb::execution_log::observe(const user_regs_struct& regs)
+{
+  if (pending_regs_)
+  {
+    commit(regs);
+  }
+  pending_regs_ = regs;
+  pending_writes_.clear();
+  pending_fprs_.reset();
+
+  auto decoding = decodings_.find(regs.rip);
+  if (decoding == decodings_.end())
+  {
+    decoding = decodings_
+                   .emplace(regs.rip,
+                            disassembler(*process_).decode_memory_writes(virt_addr{regs.rip}))
+                   .first;
+  }
+
+  // The old contents have to be saved before the instruction overwrites them
+  pending_syscall_ = decoding->second.is_syscall;
+  if (decoding->second.writes_fprs)
+  {
+    pending_fprs_ = process_->read_fprs();
+  }
+
+  std::uint64_t fields[register_fields];
+  std::memcpy(fields, &regs, sizeof(regs));
+  auto field = [&](register_id id)
+  { return fields[(register_info_by_id(id).offset - offsetof(user, regs)) / 8]; };
+  for (auto& write : decoding->second.writes)
+  {
+    std::uint64_t address = regs.rsp - write.size;
+    if (!write.is_stack_push)
+    {
+      address = static_cast<std::uint64_t>(write.displacement);
+      if (write.base)
+        address += field(*write.base);
+      if (write.index)
+        address += field(*write.index) * write.scale;
+      if (write.segment_base == disassembler::segment::fs)
+        address += regs.fs_base;
+      if (write.segment_base == disassembler::segment::gs)
+        address += regs.gs_base;
+    }
+
+    std::vector<std::byte> old_data;
+    try
+    {
+      old_data = process_->read_memory(virt_addr{address}, write.size);
+    }
+    catch (const error&)
+    {
+      // A write to unmapped memory faults before changing anything
+      continue;
+    }
+
+    write_header header{address, old_data.size()};
+    auto         header_bytes = reinterpret_cast<const std::byte*>(&header);
+    pending_writes_.insert(pending_writes_.end(), header_bytes, header_bytes + sizeof(header));
+    pending_writes_.insert(pending_writes_.end(), old_data.begin(), old_data.end());
+  }
+}
+
+void mdb::execution_log::commit(const user_regs_struct& regs)
+{
+  auto& before = *pending_regs_;
+  if (pcs_.size() % snapshot_interval_ == 0)
+  {
+    snapshots_.push_back(before);
+  }
+  pcs_.push_back(before.rip);
+
+  std::uint64_t old_fields[register_fields];
+  std::uint64_t new_fields[register_fields];
+  std::memcpy(old_fields, &before, sizeof(before));
+  std::memcpy(new_fields, &regs, sizeof(regs));
+
+  register_offsets_.push_back(register_undo_.size());
+  auto mask_index = register_undo_.size();
+  register_undo_.push_back(0);
+  for (std::size_t field = 0; field < register_fields; ++field)
+  {
+    if (old_fields[field] != new_fields[field])
+    {
+      register_undo_[mask_index] |= std::uint64_t{1} << field;
+      register_undo_.push_back(old_fields[field]);
+    }
+  }
+
+  memory_offsets_.push_back(memory_undo_.size());
+  memory_undo_.insert(memory_undo_.end(), pending_writes_.begin(), pending_writes_.end());
+
+  auto record = pcs_.size() - 1;
+  if (pending_fprs_)
+  {
+    fpr_undo_.emplace_back(record, *pending_fprs_);
+  }
+  if (pending_syscall_)
+  {
+    syscalls_.push_back(record);
+  }
+}
+
+mdb::stop_reason mdb::execution_log::reverse_step()
+{
+  if (pcs_.empty())
+  {
+    error::send("No recorded history to reverse");
+  }
+  return rewind_to(pcs_.size() - 1, trap_type::single_step);
+}
+
+mdb::stop_reason mdb::execution_log::reverse_continue()
+{
+  if (pcs_.empty())
+  {
+    error::send("No recorded history to reverse");
+  }
+
+  std::vector<std::uint64_t> stops;
+  process_->breakpoint_sites().for_each(
+      [&](breakpoint_site& site)
+      {
+        if (site.is_enabled())
+          stops.push_back(site.address().addr());
+      });
+
+  std::vector<const watchpoint*> watched;
+  process_->watchpoints().for_each(
+      [&](watchpoint& point)
+      {
+        if (!point.is_enabled())
+          return;
+        if (point.mode() == stoppoint_mode::execute)
+          stops.push_back(point.address().addr());
+        else
+          watched.push_back(&point);
+      });
+  std::sort(begin(stops), end(stops));
+
+  auto floor = syscalls_.empty() ? 0 : syscalls_.back() + 1;
+  for (auto position = pcs_.size(); position-- > floor;)
+  {
+    if (std::binary_search(begin(stops), end(stops), pcs_[position]))
+    {
+      return rewind_to(position, trap_type::software_break);
+    }
+    if (watched.empty())
+    {
+      continue;
+    }
+
+    auto end = position + 1 < pcs_.size() ? memory_offsets_[position + 1] : memory_undo_.size();
+    for (auto offset = memory_offsets_[position]; offset < end;)
+    {
+      write_header header;
+      std::memcpy(&header, memory_undo_.data() + offset, sizeof(header));
+      offset += sizeof(header) + header.size;
+
+      auto low  = virt_addr{header.address};
+      auto high = low + static_cast<std::int64_t>(header.size);
+      for (auto point : watched)
+      {
+        if (low < point->address() + static_cast<std::int64_t>(point->size()) and
+            point->address() < high)
+        {
+          auto reason      = rewind_to(position, trap_type::single_step);
+          last_watchpoint_ = point->id();
+          return reason;
+        }
+      }
+    }
+  }
+  return rewind_to(0, trap_type::single_step);
+}
+
+mdb::stop_reason mdb::execution_log::rewind_to(std::uint64_t position, trap_type trap_reason)
+{
+  if (!syscalls_.empty() and syscalls_.back() >= position)
+  {
+    error::send("Cannot reverse past a system call, its effects were not recorded");
+  }
+  last_watchpoint_.reset();
+  auto size = pcs_.size();
+
+  // Registers unwind backwards from the first snapshot at or after the target
+  auto             snapshot = (position + snapshot_interval_ - 1) / snapshot_interval_;
+  user_regs_struct regs     = process_->get_registers().data_.regs;
+  auto             from     = size;
+  if (snapshot < snapshots_.size())
+  {
+    regs = snapshots_[snapshot];
+    from = snapshot * snapshot_interval_;
+  }
+
+  std::uint64_t fields[register_fields];
+  std::memcpy(fields, &regs, sizeof(regs));
+  for (auto record = from; record-- > position;)
+  {
+    auto offset = register_offsets_[record];
+    auto mask   = register_undo_[offset++];
+    for (; mask != 0; mask &= mask - 1)
+    {
+      fields[__builtin_ctzll(mask)] = register_undo_[offset++];
+    }
+  }
+  std::memcpy(&regs, fields, sizeof(regs));
+
+  // Each byte goes back to the value saved by its earliest write past the target, so overlapping
+  // writes are merged into runs and every run is restored once, oldest write painted last
+  struct undo_write
+  {
+    std::uint64_t    address;
+    std::uint64_t    size;
+    const std::byte* data;
+    std::uint64_t    record;
+  };
+  std::vector<undo_write> writes;
+  for (auto offset = memory_offsets_[position]; offset < memory_undo_.size();)
+  {
+    write_header header;
+    std::memcpy(&header, memory_undo_.data() + offset, sizeof(header));
+    auto data = memory_undo_.data() + offset + sizeof(header);
+    writes.push_back({header.address, header.size, data, writes.size()});
+    offset += sizeof(header) + header.size;
+  }
+  std::sort(begin(writes),
+            end(writes),
+            [](auto& lhs, auto& rhs) { return lhs.address < rhs.address; });
+
+  std::vector<std::pair<std::size_t, std::size_t>> runs;
+  std::size_t                                      run_bytes = 0;
+  for (std::size_t first = 0; first < writes.size();)
+  {
+    auto last = first + 1;
+    auto high = writes[first].address + writes[first].size;
+    for (; last < writes.size() and writes[last].address <= high; ++last)
+    {
+      high = std::max(high, writes[last].address + writes[last].size);
+    }
+    runs.emplace_back(first, last);
+    run_bytes += high - writes[first].address;
+    first = last;
+  }
+
+  std::vector<std::byte>                                   values;
+  std::vector<std::pair<virt_addr, span<const std::byte>>> regions;
+  values.reserve(run_bytes);
+  for (auto [first, last] : runs)
+  {
+    auto low  = writes[first].address;
+    auto base = values.size();
+    std::sort(writes.data() + first,
+              writes.data() + last,
+              [](auto& lhs, auto& rhs) { return lhs.record > rhs.record; });
+    for (auto write = writes.data() + first; write != writes.data() + last; ++write)
+    {
+      auto at = base + (write->address - low);
+      if (values.size() < at + write->size)
+      {
+        values.resize(at + write->size);
+      }
+      std::copy(write->data, write->data + write->size, values.data() + at);
+    }
+    auto run = span<const std::byte>{values.data() + base, values.data() + values.size()};
+    regions.emplace_back(virt_addr{low}, run);
+  }
+  process_->write_memory_regions(regions);
+
+  auto fprs = std::lower_bound(begin(fpr_undo_),
+                               end(fpr_undo_),
+                               position,
+                               [](auto& entry, std::uint64_t record)
+                               { return entry.first < record; });
+  if (fprs != end(fpr_undo_))
+  {
+    process_->write_fprs(fprs->second);
+    fpr_undo_.erase(fprs, end(fpr_undo_));
+  }
+  process_->write_gprs(regs);
+  process_->read_all_registers();
+
+  memory_undo_.resize(memory_offsets_[position]);
+  register_undo_.resize(register_offsets_[position]);
+  pcs_.resize(position);
+  register_offsets_.resize(position);
+  memory_offsets_.resize(position);
+  snapshots_.resize((position + snapshot_interval_ - 1) / snapshot_interval_);
+
+  return stopped_with(trap_reason);
+}
+
+std::size_t mdb::execution_log::memory_usage() const
+{
+  return pcs_.capacity() * sizeof(std::uint64_t) +
+         register_offsets_.capacity() * sizeof(std::size_t) +
+         memory_offsets_.capacity() * sizeof(std::size_t) +
+         register_undo_.capacity() * sizeof(std::uint64_t) + memory_undo_.capacity() +
+         snapshots_.capacity() * sizeof(user_regs_struct) +
+         fpr_undo_.capacity() * sizeof(fpr_undo_[0]) +
+         syscalls_.capacity() * sizeof(std::uint64_t);
+}
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <libmdb/bit.hpp>
+#include <libmdb/error.hpp>
+#include <libmdb/expression.hpp>
+#include <libmdb/process.hpp>
+#include <libmdb/register_info.hpp>
+
+class mdb::expression::parser
+{
+ public:
+  explicit parser(std::string_view text) : text_(text) {}
+
+  std::vector<instruction> parse()
+  {
+    parse_binary(0);
+    skip_whitespace();
+    if (pos_ != text_.size())
+    {
+      fail("unexpected '" + std::string(text_.substr(pos_)) + "'");
+    }
+    return std::move(code_);
+  }
+
+ private:
+  struct binary_operator
+  {
+    std::string_view token;
+    int              precedence;
+    opcode           op;
+  };
+
+  // Multi-character tokens come first so that "<<" is not read as "<"
+  static constexpr binary_operator binary_operators[] = {
+      {"||", 1, opcode::logical_or},
+      {"&&", 2, opcode::logical_and},
+      {"==", 6, opcode::equal},
+      {"!=", 6, opcode::not_equal},
+      {"<=", 7, opcode::less_equal},
+      {">=", 7, opcode::greater_equal},
+      {"<<", 8, opcode::shift_left},
+      {">>", 8, opcode::shift_right},
+      {"|", 3, opcode::bit_or},
+      {"^", 4, opcode::bit_xor},
+      {"&", 5, opcode::bit_and},
+      {"<", 7, opcode::less},
+      {">", 7, opcode::greater},
+      {"+", 9, opcode::add},
+      {"-", 9, opcode::subtract},
+      {"*", 10, opcode::multiply},
+      {"/", 10, opcode::divide},
+      {"%", 10, opcode::modulo},
+  };
+
+  [[noreturn]] void fail(const std::string& message) const
+  {
+    error::send("Invalid expression: " + message);
+    std::abort();
+  }
+
+  void skip_whitespace()
+  {
+    while (pos_ < text_.size() and std::isspace(static_cast<unsigned char>(text_[pos_])))
+    {
+      ++pos_;
+    }
+  }
+
+  bool consume(std::string_view token)
+  {
+    skip_whitespace();
+    if (text_.substr(pos_, token.size()) == token)
+    {
+      pos_ += token.size();
+      return true;
+    }
+    return false;
+  }
+
+  void expect(std::string_view token)
+  {
+    if (!consume(token))
+    {
+      fail("expected '" + std::string(token) + "'");
+    }
+  }
+
+  std::string_view word()
+  {
+    skip_whitespace();
+    auto start = pos_;
+    while (pos_ < text_.size() and
+           (std::isalnum(static_cast<unsigned char>(text_[pos_])) or text_[pos_] == '_'))
+    {
+      ++pos_;
+    }
+    return text_.substr(start, pos_ - start);
+  }
+
+  void emit(opcode op, std::uint8_t size = 0, std::uint64_t operand = 0)
+  {
+    switch (op)
+    {
+      case opcode::constant:
+      case opcode::read_register:
+        ++depth_;
+        break;
+      case opcode::load:
+      case opcode::negate:
+      case opcode::bit_not:
+      case opcode::logical_not:
+      case opcode::to_bool:
+        break;
+      default:
+        --depth_;
+        break;
+    }
+
+    if (depth_ > max_stack_depth)
+    {
+      fail("too deeply nested");
+    }
+    code_.push_back({op, size, operand});
+  }
+
+  const binary_operator* peek_binary_operator()
+  {
+    skip_whitespace();
+    for (auto& op : binary_operators)
+    {
+      if (text_.substr(pos_, op.token.size()) == op.token)
+      {
+        return &op;
+      }
+    }
+    return nullptr;
+  }
+
+  void parse_binary(int min_precedence)
+  {
+    parse_unary();
+    for (auto op = peek_binary_operator(); op and op->precedence >= min_precedence;
+         op      = peek_binary_operator())
+    {
+      pos_ += op->token.size();
+      if (op->op == opcode::logical_and or op->op == opcode::logical_or)
+      {
+        // The left-hand value stays on the stack as the result when the
+        // jump is taken, so the right-hand side is never evaluated
+        auto jump = code_.size();
+        emit(op->op);
+        parse_binary(op->precedence + 1);
+        emit(opcode::to_bool);
+        code_[jump].operand = code_.size();
+        continue;
+      }
+      parse_binary(op->precedence + 1);
+      emit(op->op);
+    }
+  }
+
+  void parse_unary()
+  {
+    if (consume("-"))
+    {
+      parse_unary();
+      emit(opcode::negate);
+    }
+    else if (consume("~"))
+    {
+      parse_unary();
+      emit(opcode::bit_not);
+    }
+    else if (consume("!"))
+    {
+      parse_unary();
+      emit(opcode::logical_not);
+    }
+    else if (consume("*"))
+    {
+      parse_unary();
+      emit(opcode::load, 8);
+    }
+    else
+    {
+      parse_primary();
+    }
+  }
+
+  void parse_primary()
+  {
+    if (consume("("))
+    {
+      parse_binary(0);
+      expect(")");
+      return;
+    }
+
+    auto token = word();
+    if (token.empty() and pos_ == text_.size())
+    {
+      fail("unexpected end");
+    }
+    if (token.empty())
+    {
+      fail("unexpected '" + std::string(1, text_[pos_]) + "'");
+    }
+
+    if (std::isdigit(static_cast<unsigned char>(token[0])))
+    {
+      emit(opcode::constant, 0, parse_number(token));
+    }
+    else if (auto size = load_size(token); size != 0 and consume("["))
+    {
+      parse_binary(0);
+      expect("]");
+      emit(opcode::load, size);
+    }
+    else
+    {
+      emit_register(token);
+    }
+  }
+
+  std::uint64_t parse_number(std::string_view token)
+  {
+    int base = 10;
+    if (token.size() > 2 and token[0] == '0' and (token[1] == 'x' or token[1] == 'X'))
+    {
+      token.remove_prefix(2);
+      base = 16;
+    }
+
+    std::uint64_t value;
+    auto          result = std::from_chars(token.data(), token.data() + token.size(), value, base);
+    if (result.ec != std::errc{} or result.ptr != token.data() + token.size())
+    {
+      fail("invalid number '" + std::string(token) + "'");
+    }
+    return value;
+  }
+
+  static std::uint8_t load_size(std::string_view token)
+  {
+    if (token == "u8")
+      return 1;
+    if (token == "u16")
+      return 2;
+    if (token == "u32")
+      return 4;
+    if (token == "u64")
+      return 8;
+    return 0;
+  }
+
+  void emit_register(std::string_view name)
+  {
+    auto it = std::find_if(std::begin(g_register_infos),
+                           std::end(g_register_infos),
+                           [=](auto& info) { return info.name == name; });
+    if (it == std::end(g_register_infos) or it->format != register_format::uint or
+        it->type == register_type::fpr or it->size > 8)
+    {
+      fail("unknown register '" + std::string(name) + "'");
+    }
+    emit(opcode::read_register, static_cast<std::uint8_t>(it->size), it->offset);
+  }
+
+  std::string_view         text_;
+  std::size_t              pos_   = 0;
+  std::size_t              depth_ = 0;
+  std::vector<instruction> code_;
+};
+
+std::uint64_t mdb::expression::apply(opcode op, std::uint64_t lhs, std::uint64_t rhs) const
+{
+  switch (op)
+  {
+    case opcode::add:
+      return lhs + rhs;
+    case opcode::subtract:
+      return lhs - rhs;
+    case opcode::multiply:
+      return lhs * rhs;
+    case opcode::divide:
+    case opcode::modulo:
+      if (rhs == 0)
+      {
+        error::send("Division by zero in expression '" + text_ + "'");
+      }
+      return op == opcode::divide ? lhs / rhs : lhs % rhs;
+    case opcode::bit_and:
+      return lhs & rhs;
+    case opcode::bit_or:
+      return lhs | rhs;
+    case opcode::bit_xor:
+      return lhs ^ rhs;
+    case opcode::shift_left:
+      return rhs < 64 ? lhs << rhs : 0;
+    case opcode::shift_right:
+      return rhs < 64 ? lhs >> rhs : 0;
+    case opcode::equal:
+      return lhs == rhs;
+    case opcode::not_equal:
+      return lhs != rhs;
+    case opcode::less:
+      return lhs < rhs;
+    case opcode::less_equal:
+      return lhs <= rhs;
+    case opcode::greater:
+      return lhs > rhs;
+    case opcode::greater_equal:
+      return lhs >= rhs;
+    default:
+      return 0;
+  }
+}
+
+mdb::expression mdb::expression::compile(std::string_view text)
+{
+  return expression(std::string(text), parser(text).parse());
+}
+
+std::uint64_t mdb::expression::evaluate(const process& proc) const
+{
+  std::array<std::uint64_t, max_stack_depth> stack;
+  std::size_t                                top  = 0;
+  auto                                       regs = as_bytes(proc.get_registers().data_);
+
+  for (std::size_t pc = 0; pc < code_.size(); ++pc)
+  {
+    auto& instr = code_[pc];
+    switch (instr.op)
+    {
+      case opcode::constant:
+        stack[top++] = instr.operand;
+        break;
+      case opcode::read_register:
+      {
+        std::uint64_t value = 0;
+        std::memcpy(&value, regs + instr.operand, instr.size);
+        stack[top++] = value;
+        break;
+      }
+      case opcode::load:
+      {
+        std::uint64_t value = 0;
+        proc.read_memory_into(virt_addr{stack[top - 1]}, {as_bytes(value), instr.size});
+        stack[top - 1] = value;
+        break;
+      }
+      case opcode::negate:
+        stack[top - 1] = -stack[top - 1];
+        break;
+      case opcode::bit_not:
+        stack[top - 1] = ~stack[top - 1];
+        break;
+      case opcode::logical_not:
+        stack[top - 1] = !stack[top - 1];
+        break;
+      case opcode::to_bool:
+        stack[top - 1] = stack[top - 1] != 0;
+        break;
+      case opcode::logical_and:
+      case opcode::logical_or:
+        if ((stack[top - 1] != 0) == (instr.op == opcode::logical_or))
+        {
+          stack[top - 1] = stack[top - 1] != 0;
+          pc             = instr.operand - 1;
+        }
+        else
+        {
+          --top;
+        }
+        break;
+      default:
+      {
+        auto rhs = stack[--top];
+        auto lhs = stack[top - 1];
+
+        stack[top - 1] = apply(instr.op, lhs, rhs);
+        break;
+      }
+    }
+  }
+
+  return stack[0];
+}
@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <libmdb/error.hpp>
+#include <libmdb/instruction_trace.hpp>
+
+namespace
+{
+constexpr char          trace_magic[8] = {'M', 'D', 'B', 'T', 'R', 'A', 'C', 'E'};
+constexpr std::uint32_t trace_version  = 1;
+constexpr std::uint8_t  keyframe_tag   = 1;
+constexpr std::size_t   max_registers  = 32;
+
+// Monotonic counters: the ring holds stream bytes [written - ring_size, written)
+struct trace_header
+{
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t register_count;
+  std::uint64_t ring_size;
+  std::uint64_t index_capacity;
+  std::uint64_t index_interval;
+  std::uint64_t written;
+  std::uint64_t instructions;
+  std::uint64_t keyframes;
+  std::uint32_t registers[max_registers];
+};
+
+struct index_entry
+{
+  std::uint64_t instruction;
+  std::uint64_t offset;
+};
+
+trace_header& header_of(mdb::mapped_file& file)
+{
+  return *reinterpret_cast<trace_header*>(file.data());
+}
+
+const trace_header& header_of(const mdb::mapped_file& file)
+{
+  return *reinterpret_cast<const trace_header*>(file.data());
+}
+
+index_entry* index_of(mdb::mapped_file& file)
+{
+  return reinterpret_cast<index_entry*>(file.data() + sizeof(trace_header));
+}
+
+const index_entry* index_of(const mdb::mapped_file& file)
+{
+  return reinterpret_cast<const index_entry*>(file.data() + sizeof(trace_header));
+}
+
+std::size_t ring_start(const trace_header& header)
+{
+  return sizeof(trace_header) + header.index_capacity * sizeof(index_entry);
+}
+
+void write_varint(std::vector<std::byte>& out, std::uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back(static_cast<std::byte>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<std::byte>(value));
+}
+
+std::uint64_t zigzag(std::int64_t value)
+{
+  return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t value)
+{
+  return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+std::uint64_t read_gpr(const user_regs_struct& regs, mdb::register_id id)
+{
+  std::uint64_t value;
+  auto          offset = mdb::register_info_by_id(id).offset - offsetof(user, regs);
+  std::memcpy(&value, reinterpret_cast<const std::byte*>(&regs) + offset, sizeof(value));
+  return value;
+}
+}  // namespace
+
+mdb::trace_recorder::trace_recorder(process&                     proc,
+                                    const std::filesystem::path& path,
+                                    trace_options                options)
+    : process_{&proc}, options_{std::move(options)}
+{
+  if (options_.index_interval == 0)
+  {
+    error::send("Index interval must be positive");
+  }
+  if (options_.ring_size < 4096)
+  {
+    error::send("Trace ring must hold at least 4096 bytes");
+  }
+  if (options_.registers.size() > max_registers)
+  {
+    error::send("Too many traced registers");
+  }
+  for (auto id : options_.registers)
+  {
+    if (register_info_by_id(id).type != register_type::gpr)
+    {
+      error::send("Only general purpose registers can be traced");
+    }
+  }
+
+  // Keyframes are index_interval instructions apart and every instruction takes at least a
+  // byte, so at most this many can share the ring
+  auto index_capacity = options_.ring_size / options_.index_interval + 2;
+  file_               = mapped_file::create(path,
+                                            sizeof(trace_header) +
+                                                index_capacity * sizeof(index_entry) +
+                                                options_.ring_size);
+
+  auto& header = header_of(*file_);
+  std::copy(std::begin(trace_magic), std::end(trace_magic), header.magic);
+  header.version        = trace_version;
+  header.register_count = static_cast<std::uint32_t>(options_.registers.size());
+  header.ring_size      = options_.ring_size;
+  header.index_capacity = index_capacity;
+  header.index_interval = options_.index_interval;
+  for (std::size_t i = 0; i < options_.registers.size(); ++i)
+  {
+    header.registers[i] = static_cast<std::uint32_t>(options_.registers[i]);
+  }
+  last_registers_.resize(options_.registers.size());
+}
+
+mdb::step_result mdb::trace_recorder::record(std::uint64_t            max_steps,
+                                             std::optional<virt_addr> until)
+{
+  previous_.reset();
+  return process_->step_instructions(
+      max_steps, until, [this](const user_regs_struct& regs) { observe(regs); });
+}
+
+std::uint64_t mdb::trace_recorder::instructions() const
+{
+  return header_of(*file_).instructions;
+}
+
+std::uint64_t mdb::trace_recorder::bytes_written() const
+{
+  return header_of(*file_).written;
+}
+
+void mdb::trace_recorder::observe(const user_regs_struct& regs)
+{
+  // An instruction's writes are only visible once the state after it is known
+  if (previous_)
+  {
+    append(*previous_, regs);
+  }
+  previous_ = regs;
+}
+
+void mdb::trace_recorder::append(const user_regs_struct& before, const user_regs_struct& after)
+{
+  auto pc       = before.rip;
+  auto decoding = decodings_.find(pc);
+  if (decoding == decodings_.end())
+  {
+    decoding =
+        decodings_.emplace(pc, disassembler(*process_).decode_memory_writes(virt_addr{pc})).first;
+  }
+
+  auto& header      = header_of(*file_);
+  bool  is_keyframe = header.instructions % options_.index_interval == 0;
+  scratch_.clear();
+
+  if (is_keyframe)
+  {
+    auto& slot = index_of(*file_)[header.keyframes % header.index_capacity];
+    slot       = index_entry{header.instructions, header.written};
+    ++header.keyframes;
+
+    scratch_.push_back(std::byte{keyframe_tag});
+    write_varint(scratch_, header.instructions);
+    write_varint(scratch_, pc);
+    for (std::size_t i = 0; i < options_.registers.size(); ++i)
+    {
+      last_registers_[i] = read_gpr(before, options_.registers[i]);
+      write_varint(scratch_, last_registers_[i]);
+    }
+    last_write_ = 0;
+  }
+  else
+  {
+    scratch_.push_back(std::byte{0});
+    write_varint(scratch_, zigzag(static_cast<std::int64_t>(pc - last_pc_)));
+
+    std::uint64_t                            changed  = 0;
+    std::array<std::uint64_t, max_registers> deltas;
+    std::size_t                              n_deltas = 0;
+    for (std::size_t i = 0; i < options_.registers.size(); ++i)
+    {
+      auto value = read_gpr(before, options_.registers[i]);
+      if (value != last_registers_[i])
+      {
+        changed |= std::uint64_t{1} << i;
+        deltas[n_deltas++] = zigzag(static_cast<std::int64_t>(value - last_registers_[i]));
+        last_registers_[i] = value;
+      }
+    }
+    write_varint(scratch_, changed);
+    for (std::size_t i = 0; i < n_deltas; ++i)
+    {
+      write_varint(scratch_, deltas[i]);
+    }
+  }
+  last_pc_ = pc;
+
+  auto& writes = decoding->second.writes;
+  write_varint(scratch_, writes.size());
+  for (auto& write : writes)
+  {
+    std::uint64_t address = after.rsp;
+    if (!write.is_stack_push)
+    {
+      address = static_cast<std::uint64_t>(write.displacement);
+      if (write.base)
+        address += read_gpr(before, *write.base);
+      if (write.index)
+        address += read_gpr(before, *write.index) * write.scale;
+      if (write.segment_base == disassembler::segment::fs)
+        address += before.fs_base;
+      if (write.segment_base == disassembler::segment::gs)
+        address += before.gs_base;
+    }
+
+    auto data = process_->read_memory(virt_addr{address}, write.size);
+    write_varint(scratch_, zigzag(static_cast<std::int64_t>(address - last_write_)));
+    write_varint(scratch_, data.size());
+    scratch_.insert(scratch_.end(), data.begin(), data.end());
+    last_write_ = address + data.size();
+  }
+
+  write_bytes(scratch_.data(), scratch_.size());
+  ++header.instructions;
+}
+
+void mdb::trace_recorder::write_bytes(const std::byte* data, std::size_t size)
+{
+  auto& header = header_of(*file_);
+  if (size > header.ring_size)
+  {
+    error::send("Trace entry does not fit in the ring");
+  }
+
+  auto ring  = file_->data() + ring_start(header);
+  auto start = header.written % header.ring_size;
+  auto first = std::min<std::size_t>(size, header.ring_size - start);
+  std::copy(data, data + first, ring + start);
+  std::copy(data + first, data + size, ring);
+  header.written += size;
+}
+
+mdb::trace_reader::trace_reader(const std::filesystem::path& path)
+    : file_{mapped_file::open(path)}
+{
+  if (file_->size() < sizeof(trace_header))
+  {
+    error::send(path.string() + " is not an instruction trace");
+  }
+
+  auto& header = header_of(*file_);
+  if (!std::equal(std::begin(trace_magic), std::end(trace_magic), header.magic) or
+      header.version != trace_version or header.register_count > max_registers or
+      file_->size() < ring_start(header) + header.ring_size)
+  {
+    error::send(path.string() + " is not an instruction trace");
+  }
+
+  for (std::size_t i = 0; i < header.register_count; ++i)
+  {
+    registers_.push_back(static_cast<register_id>(header.registers[i]));
+  }
+  last_registers_.resize(registers_.size());
+
+  if (first_instruction() < end_instruction())
+  {
+    seek(first_instruction());
+  }
+}
+
+std::uint64_t mdb::trace_reader::oldest_offset() const
+{
+  auto& header = header_of(*file_);
+  return header.written > header.ring_size ? header.written - header.ring_size : 0;
+}
+
+std::uint64_t mdb::trace_reader::first_instruction() const
+{
+  auto& header = header_of(*file_);
+  auto  index  = index_of(*file_);
+  auto  oldest = oldest_offset();
+
+  auto first =
+      header.keyframes > header.index_capacity ? header.keyframes - header.index_capacity : 0;
+  for (auto keyframe = first; keyframe < header.keyframes; ++keyframe)
+  {
+    auto& entry = index[keyframe % header.index_capacity];
+    if (entry.offset >= oldest)
+    {
+      return entry.instruction;
+    }
+  }
+  return header.instructions;
+}
+
+std::uint64_t mdb::trace_reader::end_instruction() const
+{
+  return header_of(*file_).instructions;
+}
+
+void mdb::trace_reader::seek(std::uint64_t instruction)
+{
+  if (instruction < first_instruction() or instruction >= end_instruction())
+  {
+    error::send("Instruction is not in the trace");
+  }
+
+  // Keyframes sit at multiples of the interval, so the one to start from is found directly
+  auto& header   = header_of(*file_);
+  auto  keyframe = instruction / header.index_interval;
+  auto& entry    = index_of(*file_)[keyframe % header.index_capacity];
+  offset_        = entry.offset;
+  instruction_   = entry.instruction;
+
+  while (instruction_ < instruction)
+  {
+    next();
+  }
+}
+
+std::optional<mdb::trace_entry> mdb::trace_reader::next()
+{
+  auto& header = header_of(*file_);
+  if (instruction_ >= header.instructions or offset_ >= header.written)
+  {
+    return std::nullopt;
+  }
+  if (offset_ < oldest_offset())
+  {
+    error::send("Trace position has been overwritten");
+  }
+
+  auto ring      = file_->data() + ring_start(header);
+  auto read_byte = [&] { return ring[offset_++ % header.ring_size]; };
+
+  trace_entry entry;
+  if (std::to_integer<std::uint8_t>(read_byte()) == keyframe_tag)
+  {
+    instruction_ = read_varint();
+    last_pc_     = read_varint();
+    for (auto& value : last_registers_)
+    {
+      value = read_varint();
+    }
+    last_write_ = 0;
+  }
+  else
+  {
+    last_pc_ += static_cast<std::uint64_t>(unzigzag(read_varint()));
+    auto changed = read_varint();
+    for (std::size_t i = 0; i < last_registers_.size(); ++i)
+    {
+      if (changed >> i & 1)
+      {
+        last_registers_[i] += static_cast<std::uint64_t>(unzigzag(read_varint()));
+      }
+    }
+  }
+  entry.instruction = instruction_++;
+  entry.pc          = virt_addr{last_pc_};
+  entry.registers   = last_registers_;
+
+  auto n_writes = read_varint();
+  for (std::uint64_t i = 0; i < n_writes; ++i)
+  {
+    traced_write write;
+    write.address = virt_addr{last_write_ + static_cast<std::uint64_t>(unzigzag(read_varint()))};
+    write.data.resize(read_varint());
+    for (auto& byte : write.data)
+    {
+      byte = read_byte();
+    }
+    last_write_ = write.address.addr() + write.data.size();
+    entry.writes.push_back(std::move(write));
+  }
+  return entry;
+}
+
+std::uint64_t mdb::trace_reader::read_varint()
+{
+  auto&         header = header_of(*file_);
+  auto          ring   = file_->data() + ring_start(header);
+  std::uint64_t value  = 0;
+  for (int shift = 0;; shift += 7)
+  {
+    // Ten bytes carry all 64 bits; a longer run only comes from a damaged file
+    if (shift >= 64)
+    {
+      error::send("Trace entry is corrupt");
+    }
+    auto byte = std::to_integer<std::uint64_t>(ring[offset_++ % header.ring_size]);
+    value |= (byte & 0x7f) << shift;
+    if (byte < 0x80)
+    {
+      return value;
+    }
+  }
+}
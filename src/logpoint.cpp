@@ -0,0 +1,187 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <libmdb/error.hpp>
+#include <libmdb/logpoint.hpp>
+#include <libmdb/process.hpp>
+
+mdb::log_sink::log_sink(int fd) : fd_(fd), buffer_(new char[capacity]) {}
+
+mdb::log_sink::~log_sink()
+{
+  if (used_ > 0)
+  {
+    ::write(fd_, buffer_.get(), used_);
+  }
+}
+
+void mdb::log_sink::set_output(int fd)
+{
+  flush();
+  fd_ = fd;
+}
+
+void mdb::log_sink::append(std::string_view text)
+{
+  if (used_ + text.size() > capacity)
+  {
+    flush();
+  }
+
+  if (text.size() > capacity)
+  {
+    if (::write(fd_, text.data(), text.size()) < 0)
+    {
+      error::send_errno("Could not write log output");
+    }
+    return;
+  }
+
+  std::memcpy(buffer_.get() + used_, text.data(), text.size());
+  used_ += text.size();
+}
+
+void mdb::log_sink::append_integer(std::uint64_t value, int base, bool is_signed)
+{
+  char digits[24];
+  auto result =
+      is_signed
+          ? std::to_chars(digits, digits + sizeof(digits), static_cast<std::int64_t>(value), base)
+          : std::to_chars(digits, digits + sizeof(digits), value, base);
+  append({digits, static_cast<std::size_t>(result.ptr - digits)});
+}
+
+void mdb::log_sink::flush()
+{
+  std::size_t written = 0;
+  while (written < used_)
+  {
+    auto ret = ::write(fd_, buffer_.get() + written, used_ - written);
+    if (ret < 0)
+    {
+      used_ = 0;
+      error::send_errno("Could not write log output");
+    }
+    written += static_cast<std::size_t>(ret);
+  }
+  used_ = 0;
+}
+
+mdb::logpoint mdb::logpoint::compile(std::string_view                format,
+                                     const std::vector<std::string>& arguments)
+{
+  std::string          literals;
+  std::vector<segment> segments;
+  std::size_t          literal_offset = 0;
+
+  auto end_segment = [&](conversion conv)
+  {
+    segments.push_back({literal_offset, literals.size() - literal_offset, conv});
+    literal_offset = literals.size();
+  };
+
+  for (std::size_t i = 0; i < format.size(); ++i)
+  {
+    auto c = format[i];
+    if ((c == '{' or c == '}') and i + 1 < format.size() and format[i + 1] == c)
+    {
+      literals += c;
+      ++i;
+    }
+    else if (c == '{')
+    {
+      auto close = format.find('}', i);
+      if (close == std::string_view::npos)
+      {
+        error::send("Unterminated format placeholder");
+      }
+
+      auto spec = format.substr(i + 1, close - i - 1);
+      if (spec.empty())
+        end_segment(conversion::unsigned_decimal);
+      else if (spec == ":d")
+        end_segment(conversion::signed_decimal);
+      else if (spec == ":x")
+        end_segment(conversion::hex);
+      else if (spec == ":#x")
+        end_segment(conversion::prefixed_hex);
+      else
+        error::send("Invalid format specifier '{" + std::string(spec) + "}'");
+
+      i = close;
+    }
+    else if (c == '}')
+    {
+      error::send("Unmatched '}' in format");
+    }
+    else
+    {
+      literals += c;
+    }
+  }
+  end_segment(conversion::none);
+
+  auto n_placeholders = std::count_if(
+      begin(segments), end(segments), [](auto& seg) { return seg.conv != conversion::none; });
+  if (static_cast<std::size_t>(n_placeholders) != arguments.size())
+  {
+    error::send("Format expects " + std::to_string(n_placeholders) + " arguments, got " +
+                std::to_string(arguments.size()));
+  }
+
+  std::vector<expression> compiled;
+  compiled.reserve(arguments.size());
+  for (auto& argument : arguments)
+  {
+    compiled.push_back(expression::compile(argument));
+  }
+
+  return logpoint(
+      std::string(format), std::move(literals), std::move(segments), std::move(compiled));
+}
+
+void mdb::logpoint::log(const process& proc, log_sink& sink) const
+{
+  auto argument = arguments_.begin();
+  for (auto& seg : segments_)
+  {
+    sink.append({literals_.data() + seg.literal_offset, seg.literal_size});
+    if (seg.conv == conversion::none)
+    {
+      continue;
+    }
+
+    std::uint64_t value;
+    try
+    {
+      value = (argument++)->evaluate(proc);
+    }
+    catch (const error&)
+    {
+      sink.append("<unreadable>");
+      continue;
+    }
+
+    switch (seg.conv)
+    {
+      case conversion::unsigned_decimal:
+        sink.append_integer(value, 10);
+        break;
+      case conversion::signed_decimal:
+        sink.append_integer(value, 10, /*is_signed=*/true);
+        break;
+      case conversion::prefixed_hex:
+        sink.append("0x");
+        sink.append_integer(value, 16);
+        break;
+      case conversion::hex:
+        sink.append_integer(value, 16);
+        break;
+      case conversion::none:
+        break;
+    }
+  }
+  sink.append("\n");
+}
@@ -0,0 +1,94 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libmdb/error.hpp>
+#include <libmdb/mapped_file.hpp>
+
+std::unique_ptr<mdb::mapped_file> mdb::mapped_file::create(const std::filesystem::path& path,
+                                                           std::size_t                  size)
+{
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    error::send_errno("Could not create " + path.string());
+  }
+
+  if (ftruncate(fd, static_cast<off_t>(size)) < 0)
+  {
+    close(fd);
+    error::send_errno("Could not size " + path.string());
+  }
+
+  void* ret = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ret == MAP_FAILED)
+  {
+    close(fd);
+    error::send_errno("Could not mmap " + path.string());
+  }
+
+  return std::unique_ptr<mapped_file>(
+      new mapped_file(fd, reinterpret_cast<std::byte*>(ret), size, /*writable=*/true));
+}
+
+std::unique_ptr<mdb::mapped_file> mdb::mapped_file::open(const std::filesystem::path& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    error::send_errno("Could not open " + path.string());
+  }
+
+  struct stat stats;
+  if (fstat(fd, &stats) < 0)
+  {
+    close(fd);
+    error::send_errno("Could not retrieve stats of " + path.string());
+  }
+
+  auto size = static_cast<std::size_t>(stats.st_size);
+  if (size == 0)
+  {
+    close(fd);
+    error::send(path.string() + " is empty");
+  }
+
+  void* ret = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (ret == MAP_FAILED)
+  {
+    close(fd);
+    error::send_errno("Could not mmap " + path.string());
+  }
+
+  return std::unique_ptr<mapped_file>(
+      new mapped_file(fd, reinterpret_cast<std::byte*>(ret), size, /*writable=*/false));
+}
+
+mdb::mapped_file::~mapped_file()
+{
+  munmap(data_, size_);
+  close(fd_);
+}
+
+void mdb::mapped_file::resize(std::size_t size)
+{
+  if (!writable_)
+  {
+    error::send("Cannot resize a read-only mapping");
+  }
+
+  if (ftruncate(fd_, static_cast<off_t>(size)) < 0)
+  {
+    error::send_errno("Could not resize mapped file");
+  }
+
+  void* ret = mremap(data_, size_, size, MREMAP_MAYMOVE);
+  if (ret == MAP_FAILED)
+  {
+    error::send_errno("Could not remap file");
+  }
+
+  data_ = reinterpret_cast<std::byte*>(ret);
+  size_ = size;
+}
@@ -1,12 +1,18 @@
 #include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/personality.h>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <fstream>
 #include <libmdb/bit.hpp>
+#include <libmdb/disassembler.hpp>
 #include <libmdb/error.hpp>
 #include <libmdb/pipe.hpp>
 #include <libmdb/process.hpp>
@@ -20,6 +26,8 @@ void exit_with_perror(mdb::pipe& channel, std::string const& prefix)
   exit(-1);
 }
 
+constexpr std::array<std::byte, 2> syscall_instruction = {std::byte{0x0f}, std::byte{0x05}};
+
 void set_ptrace_options(pid_t pid)
 {
   if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACESYSGOOD) < 0)
@@ -27,6 +35,78 @@ void set_ptrace_options(pid_t pid)
     mdb::error::send_errno("Failed to set TRACESYSGOOD option");
   }
 }
+
+// Protection of the mapping that holds the address, if any
+std::optional<int> find_protection(pid_t pid, std::uint64_t address)
+{
+  std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+  std::string   line;
+  while (std::getline(maps, line))
+  {
+    auto dash  = line.find('-');
+    auto space = line.find(' ');
+    auto low   = std::strtoull(line.c_str(), nullptr, 16);
+    auto high  = std::strtoull(line.c_str() + dash + 1, nullptr, 16);
+    if (low <= address and address < high)
+    {
+      auto perms = line.c_str() + space + 1;
+      return (perms[0] == 'r' ? PROT_READ : 0) | (perms[1] == 'w' ? PROT_WRITE : 0) |
+             (perms[2] == 'x' ? PROT_EXEC : 0);
+    }
+  }
+  return std::nullopt;
+}
+
+// Whether a direct call, or an ff /2 indirect call of matching length, ends right before the
+// address
+bool follows_call(const mdb::process& proc, mdb::virt_addr address)
+{
+  constexpr std::size_t max_call_size = 7;
+
+  std::vector<std::byte> code;
+  try
+  {
+    code = proc.read_memory_without_traps(address - max_call_size, max_call_size);
+  }
+  catch (const mdb::error&)
+  {
+    return false;
+  }
+  auto before = [&](std::size_t distance)
+  { return std::to_integer<unsigned>(code[max_call_size - distance]); };
+
+  if (before(5) == 0xe8)
+  {
+    return true;
+  }
+  for (std::size_t size = 2; size <= max_call_size; ++size)
+  {
+    auto modrm = before(size - 1);
+    if (before(size) != 0xff or (modrm >> 3 & 7) != 2)
+    {
+      continue;
+    }
+
+    auto        mod     = modrm >> 6;
+    auto        rm      = modrm & 7;
+    auto        has_sib = mod != 3 and rm == 4;
+    std::size_t length  = has_sib ? 3 : 2;
+    if (mod == 1)
+    {
+      length += 1;
+    }
+    else if (mod == 2 or (mod == 0 and rm == 5) or
+             (mod == 0 and has_sib and size >= 3 and (before(size - 2) & 7) == 5))
+    {
+      length += 4;
+    }
+    if (length == size)
+    {
+      return true;
+    }
+  }
+  return false;
+}
 }  // namespace
 
 std::unique_ptr<mdb::process> mdb::process::launch(std::filesystem::path path,
@@ -128,39 +208,284 @@ mdb::process::~process()
       waitpid(pid_, &status, 0);
     }
   }
+
+  for (auto& point : checkpoints_)
+  {
+    int status;
+    kill(point.pid, SIGKILL);
+    waitpid(point.pid, &status, __WALL);
+  }
 }
 
 mdb::stop_reason mdb::process::step_instruction()
 {
-  std::optional<breakpoint_site*> to_reenable;
+  std::optional<breakpoint_site*> to_rearm;
   auto                            pc = get_pc();
-  if (breakpoint_sites_.enabled_stoppoint_at_address(pc))
+  if (breakpoint_sites_.contains_address(pc) and breakpoint_sites_.get_by_address(pc).is_armed())
   {
     auto& bp = breakpoint_sites_.get_by_address(pc);
-    bp.disable();
-    to_reenable = &bp;
+    bp.disarm();
+    to_rearm = &bp;
   }
 
   if (ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr) < 0)
   {
     error::send_errno("Could not single step");
   }
+  stepping_   = true;
   auto reason = wait_on_signal();
+  stepping_   = false;
+
+  if (to_rearm)
+  {
+    to_rearm.value()->arm();
+  }
+  return reason;
+}
+
+mdb::step_result mdb::process::step_instructions(std::uint64_t            max_steps,
+                                                 std::optional<virt_addr> until,
+                                                 const step_observer&     observer)
+{
+  if (max_steps == 0)
+  {
+    error::send("Step count must be positive");
+  }
+  auto start = std::chrono::steady_clock::now();
+
+  auto stops = enabled_site_addresses();
+
+  bool watch_registers = false;
+  watchpoints_.for_each([&](watchpoint& point)
+                        { watch_registers = watch_registers or point.uses_debug_register(); });
+
+  auto rip_offset = register_info_by_id(register_id::rip).offset;
+  auto dr6_offset = register_info_by_id(register_id::dr6).offset;
+  auto peek_user  = [this](std::size_t offset)
+  {
+    errno      = 0;
+    auto value = ptrace(PTRACE_PEEKUSER, pid_, offset, nullptr);
+    if (errno != 0)
+    {
+      error::send_errno("Could not read user area");
+    }
+    return static_cast<std::uint64_t>(value);
+  };
+
+  auto& regs = get_registers().data_.regs;
+  if (observer)
+  {
+    observer(regs);
+  }
+
+  // The first step goes through step_instruction so that a breakpoint under pc is stepped over
+  auto          reason  = step_instruction();
+  std::uint64_t steps   = 1;
+  auto          pc      = get_pc().addr();
+  bool          need_pc = until or !stops.empty();
+  if (observer and reason.reason == process_state::stopped)
+  {
+    observer(regs);
+  }
+
+  // Puts stepping_ back however the loop is left
+  struct step_guard
+  {
+    ~step_guard()
+    {
+      stepping = false;
+    }
+
+    bool& stepping;
+  };
+  step_guard guard{stepping_};
+
+  stepping_ = true;
+  while (reason.reason == process_state::stopped and
+         reason.trap_reason == trap_type::single_step and steps < max_steps and
+         (!until or pc != until->addr()))
+  {
+    // Reaching a site counts as hitting it. Conditions, ignore counts and hit actions decide
+    // whether to stop; otherwise the instruction under it is stepped over and the loop goes on.
+    // Hit actions may add or remove sites, so the list of stops is rebuilt afterwards.
+    if (std::binary_search(begin(stops), end(stops), pc))
+    {
+      read_all_registers();
+      if (should_stop_at_breakpoint(breakpoint_sites_.get_by_address(virt_addr{pc})))
+      {
+        break;
+      }
+      reason    = step_instruction();
+      stepping_ = true;
+      pc        = get_pc().addr();
+      stops     = enabled_site_addresses();
+      need_pc   = until or !stops.empty();
+      ++steps;
+      if (observer and reason.reason == process_state::stopped)
+      {
+        observer(regs);
+      }
+      continue;
+    }
+
+    if (ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr) < 0)
+    {
+      error::send_errno("Could not single step");
+    }
+    int wait_status;
+    if (waitpid(pid_, &wait_status, 0) < 0)
+    {
+      error::send_errno("waitpid failed");
+    }
+
+    // A plain step needs nothing but the new pc; the register cache is refreshed at the end
+    if (WIFSTOPPED(wait_status) and WSTOPSIG(wait_status) == SIGTRAP and (wait_status >> 16) == 0)
+    {
+      if (observer)
+      {
+        if (ptrace(PTRACE_GETREGS, pid_, nullptr, &regs) < 0)
+        {
+          error::send_errno("Could not read GPR registers");
+        }
+        pc = regs.rip;
+      }
+      else if (need_pc)
+      {
+        pc = peek_user(rip_offset);
+      }
+      if (!watch_registers or (peek_user(dr6_offset) & 0b1111) == 0)
+      {
+        ++steps;
+        if (observer)
+        {
+          observer(regs);
+        }
+        continue;
+      }
+    }
+
+    reason = stop_reason(wait_status);
+    state_ = reason.reason;
+    if (state_ != process_state::stopped)
+    {
+      break;
+    }
+    read_all_registers();
+    augment_stop_reason(reason);
+    if (reason.info == SIGSEGV)
+    {
+      should_resume_from_fault(reason);
+    }
+    else if (reason.info == SIGTRAP)
+    {
+      should_resume_internally(reason);
+    }
+
+    pc = get_pc().addr();
+    if (reason.trap_reason == trap_type::single_step or
+        reason.trap_reason == trap_type::hardware_break or
+        reason.trap_reason == trap_type::software_watch)
+    {
+      ++steps;
+      if (observer)
+      {
+        observer(regs);
+      }
+    }
+  }
+
+  if (state_ == process_state::stopped)
+  {
+    read_all_registers();
+  }
+  log_sink_.flush();
+  return step_result{reason, steps, std::chrono::steady_clock::now() - start};
+}
+
+std::vector<std::uint64_t> mdb::process::enabled_site_addresses() const
+{
+  std::vector<std::uint64_t> ret;
+  breakpoint_sites_.for_each(
+      [&](const breakpoint_site& site)
+      {
+        if (site.is_armed())
+          ret.push_back(site.address().addr());
+      });
+  std::sort(begin(ret), end(ret));
+  return ret;
+}
+
+mdb::stop_reason mdb::process::step_over()
+{
+  auto pc    = get_pc();
+  auto instr = disassembler(*this).decode_extents(pc, 1).front();
+  if (!instr.is_call)
+  {
+    return step_instruction();
+  }
+
+  auto rsp = get_registers().read_by_id_as<std::uint64_t>(register_id::rsp);
+  return run_to_return(pc + instr.length, rsp);
+}
+
+mdb::stop_reason mdb::process::step_out()
+{
+  auto& regs = get_registers();
+  auto  rsp  = regs.read_by_id_as<std::uint64_t>(register_id::rsp);
+  auto  rbp  = regs.read_by_id_as<std::uint64_t>(register_id::rbp);
+  auto  code = read_memory_without_traps(get_pc(), 4);
+
+  // Without unwind tables the frame comes from rbp, except in the prologue and at ret
+  auto is_code = [&](std::initializer_list<std::uint8_t> bytes)
+  {
+    return std::equal(bytes.begin(),
+                      bytes.end(),
+                      code.begin(),
+                      [](auto byte, auto actual) { return std::byte{byte} == actual; });
+  };
+  std::uint64_t return_slot = rbp + 8;
+  if (is_code({0xf3, 0x0f, 0x1e, 0xfa}) or is_code({0x55}) or is_code({0xc3}))
+  {
+    return_slot = rsp;
+  }
+  else if (is_code({0x48, 0x89, 0xe5}))
+  {
+    return_slot = rsp + 8;
+  }
+
+  auto return_address = from_bytes<std::uint64_t>(read_memory(virt_addr{return_slot}, 8).data());
 
-  if (to_reenable)
+  // Without a frame pointer the slot holds anything at all; planting a trap there would
+  // write into data or the stack
+  auto protection = find_protection(pid_, return_address);
+  if (!protection or !(*protection & PROT_EXEC) or !follows_call(*this, virt_addr{return_address}))
   {
-    to_reenable.value()->enable();
+    error::send("Could not find the return address of the current frame");
   }
+  return run_to_return(virt_addr{return_address}, return_slot + 8);
+}
+
+mdb::stop_reason mdb::process::run_to_return(virt_addr return_address, std::uint64_t caller_rsp)
+{
+  // A recursive call returning to the same address has a deeper stack
+  auto hook = add_internal_hook(
+      return_address,
+      [this, caller_rsp](auto&)
+      { return get_registers().read_by_id_as<std::uint64_t>(register_id::rsp) >= caller_rsp; });
+
+  resume();
+  auto reason = wait_on_signal();
+  remove_internal_hook(return_address, hook);
   return reason;
 }
 
 void mdb::process::resume()
 {
   auto pc = get_pc();
-  if (breakpoint_sites_.enabled_stoppoint_at_address(pc))
+  if (breakpoint_sites_.contains_address(pc) and breakpoint_sites_.get_by_address(pc).is_armed())
   {
     auto& bp = breakpoint_sites_.get_by_address(pc);
-    bp.disable();
+    bp.disarm();
     if (ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr) < 0)
     {
       error::send_errno("Failed to single step");
@@ -170,9 +495,11 @@ void mdb::process::resume()
     {
       error::send_errno("waitpid failed");
     }
-    bp.enable();
+    bp.arm();
   }
 
+  schedule_hardware_stoppoints();
+
   auto request = syscall_catch_policy_.get_mode() == syscall_catch_policy::mode::none
                      ? PTRACE_CONT
                      : PTRACE_SYSCALL;
@@ -204,45 +531,128 @@ mdb::stop_reason::stop_reason(int wait_status)
 
 mdb::stop_reason mdb::process::wait_on_signal()
 {
-  int wait_status;
-  int options = 0;
-  if (waitpid(pid_, &wait_status, options) < 0)
-  {
-    error::send_errno("waitpid failed");
-  }
-  stop_reason reason(wait_status);
-  state_ = reason.reason;
-
-  if (is_attached_ and state_ == process_state::stopped)
+  while (true)
   {
-    read_all_registers();
-    augment_stop_reason(reason);
+    int wait_status;
+    int options = 0;
+    if (waitpid(pid_, &wait_status, options) < 0)
+    {
+      error::send_errno("waitpid failed");
+    }
+    stop_reason reason(wait_status);
+    state_ = reason.reason;
 
-    auto instr_begin = get_pc() - static_cast<std::int64_t>(1);
-    if (reason.info == SIGTRAP)
+    if (is_attached_ and state_ == process_state::stopped)
     {
-      if (reason.trap_reason == trap_type::software_break and
-          breakpoint_sites_.contains_address(instr_begin) and
-          breakpoint_sites_.get_by_address(instr_begin).is_enabled())
+      read_all_registers();
+      augment_stop_reason(reason);
+
+      if (reason.info == SIGSEGV and should_resume_from_fault(reason))
       {
-        set_pc(instr_begin);
+        resume();
+        continue;
       }
-      else if (reason.trap_reason == trap_type::hardware_break)
+      if (reason.info == SIGTRAP and should_resume_internally(reason))
       {
-        auto id = get_current_hardware_stoppoint();
-        if (id.index() == 1)
-        {
-          watchpoints_.get_by_id(std::get<1>(id)).update_data();
-        }
+        resume();
+        continue;
       }
-      else if (reason.trap_reason == trap_type::syscall)
+    }
+
+    log_sink_.flush();
+    return reason;
+  }
+}
+
+bool mdb::process::should_resume_internally(const stop_reason& reason)
+{
+  auto instr_begin = get_pc() - static_cast<std::int64_t>(1);
+  if (reason.trap_reason == trap_type::software_break and
+      breakpoint_sites_.contains_address(instr_begin) and
+      breakpoint_sites_.get_by_address(instr_begin).is_armed())
+  {
+    set_pc(instr_begin);
+    return !should_stop_at_breakpoint(breakpoint_sites_.get_by_address(instr_begin));
+  }
+  else if (reason.trap_reason == trap_type::hardware_break)
+  {
+    auto id = get_current_hardware_stoppoint();
+    if (id.index() == 0)
+    {
+      return !should_stop_at_breakpoint(breakpoint_sites_.get_by_address(get_pc()));
+    }
+    auto& point = watchpoints_.get_by_id(std::get<1>(id));
+    ++point.hit_count_;
+    point.update_data();
+    if (point.is_logging())
+    {
+      point.record_hit(pid_, get_pc());
+      return !stepping_;
+    }
+  }
+  else if (reason.trap_reason == trap_type::software_watch)
+  {
+    auto& point = watchpoints_.get_by_id(current_software_watchpoint_);
+    if (point.is_logging())
+    {
+      point.record_hit(pid_, get_pc());
+      return !stepping_;
+    }
+  }
+  else if (reason.trap_reason == trap_type::syscall)
+  {
+    return !should_stop_at_syscall(*reason.syscall_info);
+  }
+
+  return false;
+}
+
+bool mdb::process::should_stop_at_breakpoint(breakpoint_site& site)
+{
+  auto hooks_stop = site.run_internal_hooks();
+  if (site.is_internal())
+  {
+    if (!site.has_internal_hooks())
+    {
+      breakpoint_sites_.remove_by_address(site.address());
+    }
+    return hooks_stop;
+  }
+  if (!site.is_enabled())
+  {
+    return hooks_stop;
+  }
+
+  if (auto& condition = site.condition())
+  {
+    try
+    {
+      if (condition->evaluate(*this) == 0)
       {
-        reason = maybe_resume_from_syscall(reason);
+        return hooks_stop;
       }
     }
+    catch (const error&)
+    {
+      // A condition that cannot be evaluated stops so the user can see why
+      return true;
+    }
   }
 
-  return reason;
+  ++site.hit_count_;
+  if (site.ignore_count_ > 0)
+  {
+    --site.ignore_count_;
+    return hooks_stop;
+  }
+
+  site.run_hit_actions();
+  if (site.hits_until_disable_ and --*site.hits_until_disable_ == 0)
+  {
+    site.hits_until_disable_.reset();
+    site.disable();
+  }
+  return hooks_stop or !site.auto_continues();
 }
 
 void mdb::process::read_all_registers()
@@ -277,6 +687,16 @@ void mdb::process::write_user_area(std::size_t offset, std::uint64_t data)
   }
 }
 
+user_fpregs_struct mdb::process::read_fprs() const
+{
+  user_fpregs_struct fprs;
+  if (ptrace(PTRACE_GETFPREGS, pid_, nullptr, &fprs) < 0)
+  {
+    error::send_errno("Could not read FPR registers");
+  }
+  return fprs;
+}
+
 void mdb::process::write_fprs(const user_fpregs_struct& fprs)
 {
   if (ptrace(PTRACE_SETFPREGS, pid_, nullptr, &fprs) < 0)
@@ -293,43 +713,158 @@ void mdb::process::write_gprs(const user_regs_struct& gprs)
   }
 }
 
-mdb::breakpoint_site& mdb::process::create_breakpoint_site(virt_addr address,
-                                                           bool      hardware,
-                                                           bool      internal)
+mdb::breakpoint_site& mdb::process::create_breakpoint_site(virt_addr address, bool hardware)
 {
-  if (breakpoint_sites_.contains_address(address))
+  if (!tracepoints_.get_in_region(address, address + static_cast<std::int64_t>(1)).empty())
+  {
+    error::send("Address is patched by a tracepoint");
+  }
+  if (!breakpoint_sites_.contains_address(address))
+  {
+    return breakpoint_sites_.push(
+        std::unique_ptr<breakpoint_site>(new breakpoint_site(*this, address, hardware)));
+  }
+
+  auto& site = breakpoint_sites_.get_by_address(address);
+  if (!site.is_internal())
   {
     error::send("Breakpoint site already created at address " + std::to_string(address.addr()));
   }
-  return breakpoint_sites_.push(
-      std::unique_ptr<breakpoint_site>(new breakpoint_site(*this, address, hardware, internal)));
+
+  site.claim_for_user(hardware);
+  return site;
+}
+
+mdb::breakpoint_site::internal_hook_id mdb::process::add_internal_hook(
+    virt_addr address, breakpoint_site::internal_hook hook)
+{
+  if (!breakpoint_sites_.contains_address(address))
+  {
+    if (!tracepoints_.get_in_region(address, address + static_cast<std::int64_t>(1)).empty())
+    {
+      error::send("Address is patched by a tracepoint");
+    }
+    breakpoint_sites_.push(std::unique_ptr<breakpoint_site>(
+        new breakpoint_site(*this, address, /*is_hardware=*/false, /*is_internal=*/true)));
+  }
+  return breakpoint_sites_.get_by_address(address).add_internal_hook(std::move(hook));
+}
+
+void mdb::process::remove_internal_hook(virt_addr address, breakpoint_site::internal_hook_id id)
+{
+  auto& site = breakpoint_sites_.get_by_address(address);
+  if (state_ != process_state::stopped)
+  {
+    // There is no stopped process to take the trap out of
+    site.is_armed_ = false;
+  }
+  site.remove_internal_hook(id);
+  if (site.is_internal() and !site.has_internal_hooks() and !site.running_hooks_)
+  {
+    breakpoint_sites_.remove_by_address(address);
+  }
+}
+
+mdb::breakpoint_site& mdb::process::create_logpoint(virt_addr address, logpoint point)
+{
+  auto& site = create_breakpoint_site(address);
+  site.set_auto_continue(true);
+  site.add_hit_action([this, point = std::move(point)](auto&) { point.log(*this, log_sink_); });
+  return site;
 }
 
 std::vector<std::byte> mdb::process::read_memory(virt_addr address, std::size_t amount) const
 {
   std::vector<std::byte> ret(amount);
+  read_memory_into(address, {ret.data(), ret.size()});
+  return ret;
+}
+
+void mdb::process::read_memory_into(virt_addr address, span<std::byte> into) const
+{
+  constexpr std::size_t max_chunks = 16;
 
-  iovec              local_desc{ret.data(), ret.size()};
-  std::vector<iovec> remote_descs;
+  auto output = into.begin();
+  auto amount = into.size();
   while (amount > 0)
   {
-    auto up_to_next_page = 0x1000 - (address.addr() & 0xfff);
-    auto chunk_size      = std::min(amount, up_to_next_page);
-    remote_descs.push_back({reinterpret_cast<void*>(address.addr()), chunk_size});
-    amount -= chunk_size;
-    address += chunk_size;
+    std::array<iovec, max_chunks> remote_descs;
+    std::size_t                   n_chunks = 0;
+    std::size_t                   total    = 0;
+    while (amount > 0 and n_chunks < max_chunks)
+    {
+      auto up_to_next_page     = 0x1000 - (address.addr() & 0xfff);
+      auto chunk_size          = std::min(amount, up_to_next_page);
+      remote_descs[n_chunks++] = {reinterpret_cast<void*>(address.addr()), chunk_size};
+      amount -= chunk_size;
+      total += chunk_size;
+      address += static_cast<std::int64_t>(chunk_size);
+    }
+
+    iovec local_desc{output, total};
+    auto  read = process_vm_readv(pid_,
+                                 &local_desc,
+                                 /*liovcnt=*/1,
+                                 remote_descs.data(),
+                                 /*riovcnt=*/n_chunks,
+                                 /*flags=*/0);
+    if (read < 0 and errno != EFAULT)
+    {
+      error::send_errno("Could not read process memory");
+    }
+
+    // Pages protected by software watchpoints are only reachable through ptrace. The read
+    // fails outright when the first chunk is on one and stops short at a later one.
+    auto done = read < 0 ? std::size_t{0} : static_cast<std::size_t>(read);
+    if (done < total)
+    {
+      read_memory_with_ptrace(virt_addr{address.addr() - total + done},
+                              {output + done, total - done});
+    }
+    output += total;
+  }
+}
+
+void mdb::process::read_memory_with_ptrace(virt_addr address, span<std::byte> into) const
+{
+  auto peek = [this](virt_addr at, long& word)
+  {
+    errno = 0;
+    word  = ptrace(PTRACE_PEEKDATA, pid_, at, nullptr);
+    return errno == 0;
+  };
+
+  long        word;
+  std::size_t offset = 0;
+  for (; offset + 8 <= into.size(); offset += 8)
+  {
+    if (!peek(address + offset, word))
+    {
+      error::send_errno("Could not read process memory");
+    }
+    std::memcpy(into.begin() + offset, &word, 8);
+  }
+  if (offset == into.size())
+  {
+    return;
   }
 
-  if (process_vm_readv(pid_,
-                       &local_desc,
-                       /*liovcnt=*/1,
-                       remote_descs.data(),
-                       /*riovcnt=*/remote_descs.size(),
-                       /*flags=*/0) < 0)
+  // A whole word from the tail can run into an unmapped page; the word that ends with the
+  // last byte stays on the page the range ends on
+  auto remaining = into.size() - offset;
+  if (peek(address + offset, word))
+  {
+    std::memcpy(into.begin() + offset, &word, remaining);
+  }
+  else if (peek(address + (into.size() - 8), word))
+  {
+    auto tail = reinterpret_cast<const std::byte*>(&word) + (8 - remaining);
+    std::memcpy(into.begin() + offset, tail, remaining);
+  }
+  else
   {
     error::send_errno("Could not read process memory");
   }
-  return ret;
 }
 
 void mdb::process::write_memory(virt_addr address, span<const std::byte> data)
@@ -343,6 +878,13 @@ void mdb::process::write_memory(virt_addr address, span<const std::byte> data)
     {
       word = from_bytes<std::uint64_t>(data.begin() + written);
     }
+    else if (data.size() >= 8)
+    {
+      // A whole word from the tail can run into an unmapped page; the word that ends with the
+      // last byte stays on the page the range ends on
+      written = data.size() - 8;
+      word    = from_bytes<std::uint64_t>(data.begin() + written);
+    }
     else
     {
       auto read      = read_memory(address + static_cast<int64_t>(written), 8);
@@ -358,18 +900,81 @@ void mdb::process::write_memory(virt_addr address, span<const std::byte> data)
   }
 }
 
-std::vector<std::byte> mdb::process::read_memory_without_traps(virt_addr   address,
-                                                               std::size_t amount) const
+void mdb::process::write_memory_regions(
+    span<const std::pair<virt_addr, span<const std::byte>>> regions)
+{
+  constexpr std::size_t max_regions = 1024;
+
+  std::size_t next = 0;
+  while (next < regions.size())
+  {
+    std::array<iovec, max_regions> local_descs;
+    std::array<iovec, max_regions> remote_descs;
+    auto                           n_regions = std::min(regions.size() - next, max_regions);
+    std::size_t                    total     = 0;
+    for (std::size_t i = 0; i < n_regions; ++i)
+    {
+      auto& region    = regions[next + i];
+      local_descs[i]  = {const_cast<std::byte*>(region.second.begin()), region.second.size()};
+      remote_descs[i] = {reinterpret_cast<void*>(region.first.addr()), region.second.size()};
+      total += region.second.size();
+    }
+
+    auto written = process_vm_writev(pid_,
+                                     local_descs.data(),
+                                     /*liovcnt=*/n_regions,
+                                     remote_descs.data(),
+                                     /*riovcnt=*/n_regions,
+                                     /*flags=*/0);
+    if (written < 0 and errno != EFAULT)
+    {
+      error::send_errno("Failed to write memory");
+    }
+    auto done = written < 0 ? std::size_t{0} : static_cast<std::size_t>(written);
+    if (done == total)
+    {
+      next += n_regions;
+      continue;
+    }
+
+    // The call stops at the first page it cannot write, so finish that region through ptrace
+    // and carry on with the next one
+    for (; done >= regions[next].second.size(); ++next)
+    {
+      done -= regions[next].second.size();
+    }
+    auto& [address, data] = regions[next++];
+    write_memory(address + static_cast<std::int64_t>(done),
+                 {data.begin() + done, data.size() - done});
+  }
+}
+
+std::vector<std::byte> mdb::process::read_memory_without_traps(virt_addr   address,
+                                                               std::size_t amount) const
 {
   auto memory = read_memory(address, amount);
   auto sites  = breakpoint_sites_.get_in_region(address, address + amount);
   for (auto site : sites)
   {
-    if (!site->is_enabled() or site->is_hardware())
+    if (!site->is_armed() or site->uses_debug_register())
       continue;
     auto offset           = site->address() - address.addr();
     memory[offset.addr()] = site->saved_data_;
   }
+
+  for (auto point : tracepoints_.get_in_region(address, address + amount))
+  {
+    if (!point->is_enabled())
+      continue;
+    for (std::size_t i = 0; i < point->patch_size(); ++i)
+    {
+      auto offset = point->address().addr() + i - address.addr();
+      if (offset < amount)
+      {
+        memory[offset] = point->original_code_[i];
+      }
+    }
+  }
   return memory;
 }
 
@@ -438,11 +1043,12 @@ int mdb::process::set_hardware_stoppoint(virt_addr address, stoppoint_mode mode,
   auto mode_flag = encode_hardware_stoppoint_mode(mode);
   auto size_flag = encode_hardware_stoppoint_size(size);
 
-  auto enable_bit = (1 << (free_space * 2));
-  auto mode_bits  = (mode_flag << (free_space * 4 + 16));
-  auto size_bits  = (size_flag << (free_space * 4 + 18));
+  auto enable_bit = std::uint64_t{1} << (free_space * 2);
+  auto mode_bits  = static_cast<std::uint64_t>(mode_flag) << (free_space * 4 + 16);
+  auto size_bits  = static_cast<std::uint64_t>(size_flag) << (free_space * 4 + 18);
 
-  auto clear_mask = (0b11 << (free_space * 2)) | (0b1111 << (free_space * 4 + 16));
+  auto clear_mask =
+      (std::uint64_t{0b11} << (free_space * 2)) | (std::uint64_t{0b1111} << (free_space * 4 + 16));
   auto masked     = control & ~clear_mask;
 
   masked |= enable_bit | mode_bits | size_bits;
@@ -454,12 +1060,15 @@ int mdb::process::set_hardware_stoppoint(virt_addr address, stoppoint_mode mode,
 
 void mdb::process::clear_hardware_stoppoint(int index)
 {
+  debug_register_owners_[static_cast<std::size_t>(index)].reset();
+
   auto id = static_cast<int>(register_id::dr0) + index;
   get_registers().write_by_id(static_cast<register_id>(id), 0);
 
   auto control = get_registers().read_by_id_as<std::uint64_t>(register_id::dr7);
 
-  auto clear_mask = (0b11 << (index * 2)) | (0b1111 << (index * 4 + 16));
+  auto clear_mask =
+      (std::uint64_t{0b11} << (index * 2)) | (std::uint64_t{0b1111} << (index * 4 + 16));
   auto masked     = control & ~clear_mask;
 
   get_registers().write_by_id(register_id::dr7, masked);
@@ -473,15 +1082,731 @@ int mdb::process::set_watchpoint(watchpoint::id_type id,
   return set_hardware_stoppoint(address, mode, size);
 }
 
+namespace
+{
+template <class Stoppoint>
+bool has_software_fallback(const Stoppoint& point)
+{
+  if constexpr (std::is_same_v<Stoppoint, mdb::watchpoint>)
+  {
+    return point.mode() != mdb::stoppoint_mode::execute;
+  }
+  return true;
+}
+}  // namespace
+
+void mdb::process::schedule_hardware_stoppoints(std::optional<hardware_stoppoint> enabling)
+{
+  std::vector<hardware_stoppoint> wanted;
+  if (enabling)
+  {
+    wanted.push_back(*enabling);
+  }
+  breakpoint_sites_.for_each(
+      [&](breakpoint_site& site)
+      {
+        if (site.is_hardware() and site.is_armed())
+          wanted.push_back(&site);
+      });
+  watchpoints_.for_each(
+      [&](watchpoint& point)
+      {
+        if (point.is_hardware() and point.is_enabled())
+          wanted.push_back(&point);
+      });
+
+  // Points without a fallback must get a register, then pinned ones, then the most hit.
+  // Current owners win ties so that equal points do not trade places on every resume.
+  auto priority = [](const hardware_stoppoint& stoppoint)
+  {
+    return std::visit(
+        [](auto point)
+        {
+          return std::make_tuple(!has_software_fallback(*point),
+                                 point->is_pinned(),
+                                 point->hit_count(),
+                                 point->uses_debug_register());
+        },
+        stoppoint);
+  };
+  std::stable_sort(begin(wanted),
+                   end(wanted),
+                   [&](auto& lhs, auto& rhs) { return priority(lhs) > priority(rhs); });
+
+  auto in_registers = std::min(wanted.size(), debug_register_owners_.size());
+  for (auto i = in_registers; i < wanted.size(); ++i)
+  {
+    if (!std::visit([](auto point) { return has_software_fallback(*point); }, wanted[i]))
+    {
+      error::send("No remaining hardware debug registers");
+    }
+  }
+
+  // Evict first so that the freed registers are available to the winners
+  for (auto i = in_registers; i < wanted.size(); ++i)
+  {
+    std::visit([this](auto point) { move_to_trap(*point); }, wanted[i]);
+  }
+  for (std::size_t i = 0; i < in_registers; ++i)
+  {
+    std::visit([this](auto point) { move_to_debug_register(*point); }, wanted[i]);
+  }
+}
+
+void mdb::process::release_hardware_stoppoint(hardware_stoppoint stoppoint)
+{
+  std::visit(
+      [this](auto point)
+      {
+        if (point->uses_debug_register())
+        {
+          clear_hardware_stoppoint(point->hardware_register_index_);
+          point->hardware_register_index_ = -1;
+        }
+        else if (point->is_degraded_)
+        {
+          point->remove_trap();
+          point->is_degraded_ = false;
+        }
+      },
+      stoppoint);
+}
+
+template <class Stoppoint>
+void mdb::process::move_to_debug_register(Stoppoint& point)
+{
+  if (point.uses_debug_register())
+  {
+    return;
+  }
+  if (point.is_degraded_)
+  {
+    point.remove_trap();
+    point.is_degraded_ = false;
+  }
+
+  int index;
+  if constexpr (std::is_same_v<Stoppoint, breakpoint_site>)
+  {
+    index = set_hardware_breakpoint(point.id(), point.address());
+  }
+  else
+  {
+    index = set_watchpoint(point.id(), point.address(), point.mode(), point.size());
+  }
+  point.hardware_register_index_                       = index;
+  debug_register_owners_[static_cast<std::size_t>(index)] = &point;
+}
+
+template <class Stoppoint>
+void mdb::process::move_to_trap(Stoppoint& point)
+{
+  if (point.uses_debug_register())
+  {
+    clear_hardware_stoppoint(point.hardware_register_index_);
+    point.hardware_register_index_ = -1;
+  }
+  if (!point.is_degraded_)
+  {
+    point.install_trap();
+    point.is_degraded_ = true;
+  }
+}
+
 mdb::watchpoint& mdb::process::create_watchpoint(virt_addr      address,
                                                  stoppoint_mode mode,
-                                                 std::size_t    size)
+                                                 std::size_t    size,
+                                                 bool           hardware)
 {
   if (watchpoints_.contains_address(address))
   {
     error::send("Watchpoint already created at address " + std::to_string(address.addr()));
   }
-  return watchpoints_.push(std::unique_ptr<watchpoint>(new watchpoint(*this, address, mode, size)));
+  return watchpoints_.push(
+      std::unique_ptr<watchpoint>(new watchpoint(*this, address, mode, size, hardware)));
+}
+
+namespace
+{
+constexpr std::uint64_t page_size = 0x1000;
+
+std::uint64_t page_of(std::uint64_t address)
+{
+  return address & ~(page_size - 1);
+}
+
+int read_page_protection(pid_t pid, std::uint64_t page)
+{
+  auto protection = find_protection(pid, page);
+  if (!protection)
+  {
+    mdb::error::send("Watched address is not mapped");
+  }
+  return *protection;
+}
+}  // namespace
+
+void mdb::process::protect_watched_pages(const watchpoint& point)
+{
+  auto first = page_of(point.address().addr());
+  auto last  = page_of(point.address().addr() + point.size() - 1);
+  for (auto page = first; page <= last; page += page_size)
+  {
+    auto [it, inserted] = protected_pages_.try_emplace(page);
+    if (inserted)
+    {
+      it->second.original_protection = read_page_protection(pid_, page);
+      it->second.applied_protection  = it->second.original_protection;
+    }
+    if (point.mode() == stoppoint_mode::read_write)
+      ++it->second.access_watches;
+    else
+      ++it->second.write_watches;
+  }
+  apply_page_protection(first, last);
+}
+
+void mdb::process::unprotect_watched_pages(const watchpoint& point)
+{
+  auto first = page_of(point.address().addr());
+  auto last  = page_of(point.address().addr() + point.size() - 1);
+  for (auto page = first; page <= last; page += page_size)
+  {
+    auto& state = protected_pages_.at(page);
+    if (point.mode() == stoppoint_mode::read_write)
+      --state.access_watches;
+    else
+      --state.write_watches;
+  }
+  apply_page_protection(first, last);
+}
+
+void mdb::process::apply_page_protection(std::uint64_t first_page, std::uint64_t last_page)
+{
+  auto wanted = [](const protected_page& state)
+  {
+    if (state.access_watches > 0)
+      return PROT_NONE;
+    if (state.write_watches > 0)
+      return state.original_protection & ~PROT_WRITE;
+    return state.original_protection;
+  };
+
+  // Neighbouring pages that need the same protection share one mprotect call
+  auto run_start = first_page;
+  auto run_prot  = -1;
+  auto flush     = [&](std::uint64_t end)
+  {
+    if (run_prot >= 0 and end > run_start)
+    {
+      auto ret = inject_syscall(SYS_mprotect, run_start, end - run_start, run_prot);
+      if (ret < 0)
+      {
+        error::send(std::string("Could not protect watched pages: ") +
+                    std::strerror(static_cast<int>(-ret)));
+      }
+    }
+  };
+
+  for (auto page = first_page; page <= last_page; page += page_size)
+  {
+    auto& state = protected_pages_.at(page);
+    auto  prot  = wanted(state);
+    auto  dirty = prot != state.applied_protection;
+    state.applied_protection = prot;
+
+    auto want = dirty ? prot : -1;
+    if (want != run_prot)
+    {
+      flush(page);
+      run_start = page;
+      run_prot  = want;
+    }
+  }
+  flush(last_page + page_size);
+
+  for (auto page = first_page; page <= last_page; page += page_size)
+  {
+    auto it = protected_pages_.find(page);
+    if (it->second.access_watches == 0 and it->second.write_watches == 0)
+    {
+      protected_pages_.erase(it);
+    }
+  }
+}
+
+bool mdb::process::should_resume_from_fault(stop_reason& reason)
+{
+  siginfo_t info;
+  if (ptrace(PTRACE_GETSIGINFO, pid_, nullptr, &info) < 0)
+  {
+    error::send_errno("Failed to get signal info");
+  }
+
+  auto fault = reinterpret_cast<std::uint64_t>(info.si_addr);
+  if (info.si_code != SEGV_ACCERR or !protected_pages_.count(page_of(fault)))
+  {
+    return false;
+  }
+
+  // Let the access through with the page's real protection, then put the watch back
+  std::vector<std::uint64_t> opened;
+  std::vector<int>           deferred_signals;
+  auto                       pc                 = get_pc();
+  bool                       hit_debug_register = false;
+  for (int attempts = 0; attempts < 4; ++attempts)
+  {
+    auto page  = page_of(fault);
+    auto state = protected_pages_.find(page);
+    if (state == protected_pages_.end())
+    {
+      break;
+    }
+    inject_syscall(SYS_mprotect, page, page_size, state->second.original_protection);
+    state->second.applied_protection = state->second.original_protection;
+    opened.push_back(page);
+
+    int wait_status;
+    while (true)
+    {
+      if (ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr) < 0)
+      {
+        error::send_errno("Could not single step");
+      }
+      if (waitpid(pid_, &wait_status, 0) < 0)
+      {
+        error::send_errno("waitpid failed");
+      }
+      if (!WIFSTOPPED(wait_status))
+      {
+        state_ = WIFEXITED(wait_status) ? process_state::exited : process_state::terminated;
+        reason = stop_reason(wait_status);
+        return false;
+      }
+
+      // Anything else raced with the step; hold on to it and resend once the watch is back
+      auto signal = WSTOPSIG(wait_status);
+      if (signal == SIGTRAP or signal == SIGSEGV)
+      {
+        break;
+      }
+      deferred_signals.push_back(signal);
+    }
+    read_all_registers();
+    if (WSTOPSIG(wait_status) == SIGTRAP)
+    {
+      auto status        = get_registers().read_by_id_as<std::uint64_t>(register_id::dr6);
+      hit_debug_register = (status & 0b1111) != 0;
+    }
+    if (WSTOPSIG(wait_status) != SIGSEGV or get_pc() != pc)
+    {
+      break;
+    }
+
+    // The same instruction touched a second watched page
+    if (ptrace(PTRACE_GETSIGINFO, pid_, nullptr, &info) < 0)
+    {
+      error::send_errno("Failed to get signal info");
+    }
+    fault = reinterpret_cast<std::uint64_t>(info.si_addr);
+  }
+
+  for (auto page : opened)
+  {
+    apply_page_protection(page, page);
+  }
+  for (auto signal : deferred_signals)
+  {
+    kill(pid_, signal);
+  }
+
+  // A fault on a page that only lost PROT_WRITE can only have been a store
+  auto faulting_page = protected_pages_.find(page_of(fault));
+  bool was_store     = faulting_page != protected_pages_.end() and
+                   faulting_page->second.access_watches == 0;
+
+  // Every touched watchpoint refreshes its snapshot so that a change is reported only once
+  bool hit = false;
+  watchpoints_.for_each(
+      [&](watchpoint& point)
+      {
+        auto on_opened_page = std::any_of(
+            begin(opened),
+            end(opened),
+            [&](auto page)
+            { return point.overlaps(virt_addr{page}, virt_addr{page + page_size}); });
+        auto uses_pages = !point.is_hardware() or point.is_degraded_;
+        if (!uses_pages or !point.is_enabled() or !on_opened_page)
+        {
+          return;
+        }
+
+        // Like a debug register, a write watch reports a store even when it leaves the value
+        // as it was. That takes knowing the fault was a store and only the start of the access
+        // is known, so otherwise a write watch goes by the value changing.
+        auto changed = point.update_data();
+        auto touched = (point.mode() == stoppoint_mode::read_write or was_store) and
+                       point.overlaps(virt_addr{fault}, virt_addr{fault + 1});
+        if ((changed or touched) and !hit)
+        {
+          hit                          = true;
+          current_software_watchpoint_ = point.id();
+          ++point.hit_count_;
+        }
+      });
+
+  if (hit)
+  {
+    reason.info        = SIGTRAP;
+    reason.trap_reason = trap_type::software_watch;
+    return false;
+  }
+  // The stepped instruction may also have tripped a hardware stoppoint
+  if (hit_debug_register)
+  {
+    reason.info        = SIGTRAP;
+    reason.trap_reason = trap_type::hardware_break;
+    return false;
+  }
+  if (stepping_)
+  {
+    reason.info        = SIGTRAP;
+    reason.trap_reason = trap_type::single_step;
+    return false;
+  }
+  return true;
+}
+
+mdb::tracepoint& mdb::process::create_tracepoint(virt_addr                                address,
+                                                 std::optional<tracepoint::address_range> function)
+{
+  return tracepoints_.push(std::unique_ptr<tracepoint>(new tracepoint(*this, address, function)));
+}
+
+mdb::tracepoint_buffer& mdb::process::get_tracepoint_buffer()
+{
+  if (!tracepoint_buffer_)
+  {
+    tracepoint_buffer_.reset(new tracepoint_buffer(*this, tracepoint_buffer::default_capacity));
+  }
+  return *tracepoint_buffer_;
+}
+
+mdb::region_watch& mdb::process::create_region_watch(virt_addr address, std::size_t size)
+{
+  return region_watches_.push(
+      std::unique_ptr<region_watch>(new region_watch(*this, address, size)));
+}
+
+void mdb::process::collect_dirty_pages()
+{
+  auto proc_path = "/proc/" + std::to_string(pid_);
+  if (!region_watch::soft_dirty_supported())
+  {
+    // Without soft-dirty tracking every page has to be compared
+    region_watches_.for_each([](region_watch& watch)
+                             { watch.dirty_pages_.assign(watch.dirty_pages_.size(), true); });
+    return;
+  }
+
+  auto pagemap = open((proc_path + "/pagemap").c_str(), O_RDONLY);
+  if (pagemap < 0)
+  {
+    error::send_errno("Could not open pagemap");
+  }
+
+  std::vector<std::uint64_t> entries;
+  region_watches_.for_each(
+      [&](region_watch& watch)
+      {
+        if (!watch.is_enabled())
+          return;
+
+        entries.resize(watch.page_count());
+        auto bytes  = entries.size() * sizeof(std::uint64_t);
+        auto offset = watch.first_page() / page_size * sizeof(std::uint64_t);
+        if (pread(pagemap, entries.data(), bytes, static_cast<off_t>(offset)) !=
+            static_cast<ssize_t>(bytes))
+        {
+          close(pagemap);
+          error::send_errno("Could not read pagemap");
+        }
+        for (std::size_t i = 0; i < entries.size(); ++i)
+        {
+          if (entries[i] >> 55 & 1)
+            watch.dirty_pages_[i] = true;
+        }
+      });
+  close(pagemap);
+
+  std::ofstream clear_refs(proc_path + "/clear_refs");
+  clear_refs << "4";
+  if (!clear_refs.flush())
+  {
+    error::send("Could not clear soft-dirty bits");
+  }
+}
+
+std::int64_t mdb::process::inject_syscall_with(std::uint64_t                       number,
+                                              const std::array<std::uint64_t, 6>& args)
+{
+  if (state_ != process_state::stopped)
+  {
+    error::send("Syscalls can only be injected into a stopped process");
+  }
+  if (expecting_syscall_exit_)
+  {
+    error::send("Cannot inject a syscall while stopped at a syscall entry");
+  }
+
+  auto saved_regs = get_registers().data_.regs;
+  auto pc         = get_pc();
+
+  auto saved_code = read_memory(pc, syscall_instruction.size());
+  write_memory(pc, {syscall_instruction.data(), syscall_instruction.size()});
+
+  auto regs = saved_regs;
+  regs.rax  = number;
+  regs.rdi  = args[0];
+  regs.rsi  = args[1];
+  regs.rdx  = args[2];
+  regs.r10  = args[3];
+  regs.r8   = args[4];
+  regs.r9   = args[5];
+  regs.rip  = pc;
+  // A stop inside an interrupted syscall leaves orig_rax set, which would make the kernel
+  // restart that call instead of running ours. The saved value is restored afterwards.
+  regs.orig_rax = static_cast<std::uint64_t>(-1);
+  write_gprs(regs);
+
+  std::vector<int> deferred_signals;
+  user_regs_struct result;
+  while (true)
+  {
+    if (ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr) < 0)
+    {
+      error::send_errno("Could not single step injected syscall");
+    }
+
+    int wait_status;
+    if (waitpid(pid_, &wait_status, 0) < 0)
+    {
+      error::send_errno("waitpid failed");
+    }
+    if (!WIFSTOPPED(wait_status))
+    {
+      state_ = WIFEXITED(wait_status) ? process_state::exited : process_state::terminated;
+      error::send("Process ended during injected syscall");
+    }
+
+    // ptrace event stops (such as fork notifications) arrive before the syscall returns
+    auto signal = WSTOPSIG(wait_status);
+    if (signal == SIGTRAP and (wait_status >> 16) != 0)
+    {
+      continue;
+    }
+
+    if (signal != SIGTRAP)
+    {
+      // Anything else raced with the step; hold on to it and resend once we are done
+      deferred_signals.push_back(signal);
+    }
+
+    if (ptrace(PTRACE_GETREGS, pid_, nullptr, &result) < 0)
+    {
+      error::send_errno("Could not read GPR registers");
+    }
+    if (result.rip == pc.addr() + syscall_instruction.size())
+    {
+      break;
+    }
+    if (result.rip != pc.addr())
+    {
+      write_memory(pc, {saved_code.data(), saved_code.size()});
+      write_gprs(saved_regs);
+      error::send("Injected syscall did not complete");
+    }
+  }
+
+  write_memory(pc, {saved_code.data(), saved_code.size()});
+  write_gprs(saved_regs);
+
+  for (auto signal : deferred_signals)
+  {
+    kill(pid_, signal);
+  }
+
+  // A signal that interrupts the injected call leaves a kernel-internal restart code behind
+  auto ret = static_cast<std::int64_t>(result.rax);
+  if (ret <= -512 and ret >= -516)
+  {
+    ret = -EINTR;
+  }
+  return ret;
+}
+
+pid_t mdb::process::fork_stopped_copy()
+{
+  if (ptrace(PTRACE_SETOPTIONS, pid_, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK) < 0)
+  {
+    error::send_errno("Failed to set TRACEFORK option");
+  }
+  auto ret = inject_syscall(SYS_fork);
+  set_ptrace_options(pid_);
+  if (ret < 0)
+  {
+    error::send(std::string("Could not fork the inferior: ") +
+                std::strerror(static_cast<int>(-ret)));
+  }
+  auto child = static_cast<pid_t>(ret);
+
+  // The child is attached automatically and starts in a SIGSTOP, still forking its own children
+  int status;
+  if (waitpid(child, &status, __WALL) < 0)
+  {
+    error::send_errno("waitpid failed");
+  }
+  set_ptrace_options(child);
+  return child;
+}
+
+mdb::checkpoint::id_type mdb::process::create_checkpoint()
+{
+  if (state_ != process_state::stopped)
+  {
+    error::send("Checkpoints can only be taken of a stopped process");
+  }
+  // The copy would keep the patches and go on writing to the ring after they are removed
+  if (!tracepoints_.empty())
+  {
+    error::send("Checkpoints cannot be taken while tracepoints are set");
+  }
+
+  checkpoint point;
+  point.id         = next_checkpoint_id_++;
+  point.regs       = get_registers().data_.regs;
+  point.fprs       = get_registers().data_.i387;
+  point.code_at_pc = read_memory(get_pc(), syscall_instruction.size());
+  breakpoint_sites_.for_each(
+      [&](breakpoint_site& site)
+      {
+        if (site.is_armed() and !site.uses_debug_register())
+          point.traps.emplace_back(site.address(), site.saved_data_);
+      });
+  for (auto& [page, state] : protected_pages_)
+  {
+    point.page_protections[page]     = state.applied_protection;
+    point.original_protections[page] = state.original_protection;
+  }
+
+  point.pid = fork_stopped_copy();
+  checkpoints_.push_back(std::move(point));
+  return checkpoints_.back().id;
+}
+
+void mdb::process::restore_checkpoint(checkpoint::id_type id)
+{
+  auto point = std::find_if(checkpoints_.begin(),
+                            checkpoints_.end(),
+                            [id](auto& candidate) { return candidate.id == id; });
+  if (point == checkpoints_.end())
+  {
+    error::send("No such checkpoint");
+  }
+  if (!tracepoints_.empty())
+  {
+    error::send("Tracepoints must be removed before restoring a checkpoint");
+  }
+
+  // Debug registers are not inherited by fork, so they are carried over by hand
+  if (state_ == process_state::stopped)
+  {
+    read_all_registers();
+  }
+  auto debug_registers = get_registers().data_.u_debugreg;
+
+  if (state_ != process_state::exited and state_ != process_state::terminated)
+  {
+    int status;
+    kill(pid_, SIGKILL);
+    waitpid(pid_, &status, __WALL);
+  }
+
+  pid_                    = point->pid;
+  state_                  = process_state::stopped;
+  terminate_on_end_       = true;
+  expecting_syscall_exit_ = false;
+  write_gprs(point->regs);
+  write_fprs(point->fprs);
+  write_memory(virt_addr{point->regs.rip}, {point->code_at_pc.data(), point->code_at_pc.size()});
+  read_all_registers();
+
+  // The copy may predate the ring, so the next tracepoint maps a fresh one
+  tracepoint_buffer_.reset();
+
+  // A fresh copy takes the checkpoint's place so it can be restored again
+  point->pid = fork_stopped_copy();
+
+  // Bring the copy's breakpoints and page protections in line with the current ones
+  std::map<std::uint64_t, std::byte> traps;
+  for (auto [address, original] : point->traps)
+  {
+    traps.emplace(address.addr(), original);
+  }
+  breakpoint_sites_.for_each(
+      [&](breakpoint_site& site)
+      {
+        if (!site.is_armed() or site.uses_debug_register())
+          return;
+        if (!traps.erase(site.address().addr()))
+        {
+          auto int3 = std::byte{0xcc};
+          write_memory(site.address(), {&int3, 1});
+        }
+      });
+  for (auto [address, original] : traps)
+  {
+    write_memory(virt_addr{address}, {&original, 1});
+  }
+
+  auto pages = point->page_protections;
+  for (auto& [page, state] : protected_pages_)
+  {
+    pages.emplace(page, state.original_protection);
+  }
+  for (auto [page, had] : pages)
+  {
+    auto current = protected_pages_.find(page);
+    auto wanted  = current != protected_pages_.end() ? current->second.applied_protection
+                                                     : point->original_protections.at(page);
+    if (had != wanted)
+    {
+      inject_syscall(SYS_mprotect, page, page_size, wanted);
+    }
+  }
+
+  for (int i = 0; i < 4; ++i)
+  {
+    write_user_area(offsetof(user, u_debugreg) + i * 8, debug_registers[i]);
+  }
+  write_user_area(offsetof(user, u_debugreg) + 7 * 8, debug_registers[7]);
+  read_all_registers();
+}
+
+void mdb::process::delete_checkpoint(checkpoint::id_type id)
+{
+  auto point = std::find_if(checkpoints_.begin(),
+                            checkpoints_.end(),
+                            [id](auto& candidate) { return candidate.id == id; });
+  if (point == checkpoints_.end())
+  {
+    error::send("No such checkpoint");
+  }
+
+  int status;
+  kill(point->pid, SIGKILL);
+  waitpid(point->pid, &status, __WALL);
+  checkpoints_.erase(point);
 }
 
 void mdb::process::augment_stop_reason(mdb::stop_reason& reason)
@@ -553,39 +1878,38 @@ mdb::process::get_current_hardware_stoppoint() const
 {
   auto& regs   = get_registers();
   auto  status = regs.read_by_id_as<std::uint64_t>(register_id::dr6);
-  auto  index  = __builtin_ctzll(status);
-
-  auto id   = static_cast<int>(register_id::dr0) + index;
-  auto addr = virt_addr(regs.read_by_id_as<std::uint64_t>(static_cast<register_id>(id)));
-
-  using ret = std::variant<mdb::breakpoint_site::id_type, mdb::watchpoint::id_type>;
-  if (breakpoint_sites_.contains_address(addr))
+  auto  hits   = status & 0b1111;
+  auto  index  = hits == 0 ? std::size_t{0} : static_cast<std::size_t>(__builtin_ctzll(hits));
+  if (hits == 0 or !debug_register_owners_[index])
   {
-    auto site_id = breakpoint_sites_.get_by_address(addr).id();
-    return ret{std::in_place_index<0>, site_id};
-  }
-  else
-  {
-    auto watch_id = watchpoints_.get_by_address(addr).id();
-    return ret{std::in_place_index<1>, watch_id};
+    error::send("No stoppoint owns the triggered debug register");
   }
+
+  using ret = std::variant<mdb::breakpoint_site::id_type, mdb::watchpoint::id_type>;
+  return std::visit(
+      [](auto point)
+      {
+        if constexpr (std::is_same_v<decltype(point), breakpoint_site*>)
+        {
+          return ret{std::in_place_index<0>, point->id()};
+        }
+        else
+        {
+          return ret{std::in_place_index<1>, point->id()};
+        }
+      },
+      *debug_register_owners_[index]);
 }
 
-mdb::stop_reason mdb::process::maybe_resume_from_syscall(const stop_reason& reason)
+bool mdb::process::should_stop_at_syscall(const syscall_information& info) const
 {
   if (syscall_catch_policy_.get_mode() == syscall_catch_policy::mode::some)
   {
     auto& to_catch = syscall_catch_policy_.get_to_catch();
-    auto  found    = std::find(begin(to_catch), end(to_catch), reason.syscall_info->id);
-
-    if (found == end(to_catch))
-    {
-      resume();
-      return wait_on_signal();
-    }
+    return std::find(begin(to_catch), end(to_catch), info.id) != end(to_catch);
   }
 
-  return reason;
+  return true;
 }
 
 std::unordered_map<int, std::uint64_t> mdb::process::get_auxv() const
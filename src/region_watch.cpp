@@ -0,0 +1,162 @@
+#include <emmintrin.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <libmdb/error.hpp>
+#include <libmdb/process.hpp>
+#include <libmdb/region_watch.hpp>
+
+namespace
+{
+constexpr std::uint64_t page_size = 0x1000;
+
+auto get_next_id()
+{
+  static mdb::region_watch::id_type id = 0;
+  return ++id;
+}
+
+// Finds the next differing (or matching) byte at or after pos, comparing 16 bytes at a time
+std::size_t find_difference(const std::byte* lhs,
+                            const std::byte* rhs,
+                            std::size_t      pos,
+                            std::size_t      size,
+                            bool             want_difference)
+{
+  for (; pos + 16 <= size; pos += 16)
+  {
+    auto lhs_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + pos));
+    auto rhs_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + pos));
+
+    auto equal  = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(lhs_block, rhs_block)));
+    auto wanted = want_difference ? ~equal & 0xffff : equal;
+    if (wanted != 0)
+    {
+      return pos + static_cast<std::size_t>(__builtin_ctz(wanted));
+    }
+  }
+  for (; pos < size; ++pos)
+  {
+    if ((lhs[pos] != rhs[pos]) == want_difference)
+    {
+      return pos;
+    }
+  }
+  return size;
+}
+}  // namespace
+
+mdb::region_watch::region_watch(process& proc, virt_addr address, std::size_t size)
+    : id_{get_next_id()}, process_{&proc}, address_{address}, size_{size}, is_enabled_{false}
+{
+  if (size_ == 0)
+  {
+    error::send("Watched region must not be empty");
+  }
+}
+
+bool mdb::region_watch::soft_dirty_supported()
+{
+  // Fresh mappings are born soft-dirty when the kernel tracks the bit at all
+  static bool supported = []
+  {
+    auto page = static_cast<char*>(
+        mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (page == MAP_FAILED)
+    {
+      return false;
+    }
+    page[0] = 1;
+
+    std::uint64_t entry  = 0;
+    auto          fd     = open("/proc/self/pagemap", O_RDONLY);
+    auto          offset = reinterpret_cast<std::uint64_t>(page) / page_size * sizeof(entry);
+    auto          read   = pread(fd, &entry, sizeof(entry), static_cast<off_t>(offset));
+    close(fd);
+    munmap(page, page_size);
+    return read == sizeof(entry) and (entry >> 55 & 1) != 0;
+  }();
+  return supported;
+}
+
+std::uint64_t mdb::region_watch::first_page() const
+{
+  return address_.addr() & ~(page_size - 1);
+}
+
+std::size_t mdb::region_watch::page_count() const
+{
+  auto last_page = (address_.addr() + size_ - 1) & ~(page_size - 1);
+  return (last_page - first_page()) / page_size + 1;
+}
+
+void mdb::region_watch::enable()
+{
+  if (is_enabled_)
+  {
+    return;
+  }
+
+  // Other regions keep what they have seen before the bits are cleared for this one
+  process_->collect_dirty_pages();
+  snapshot_ = process_->read_memory(address_, size_);
+  dirty_pages_.assign(page_count(), false);
+  is_enabled_ = true;
+}
+
+void mdb::region_watch::disable()
+{
+  is_enabled_ = false;
+  snapshot_.clear();
+  dirty_pages_.clear();
+}
+
+std::vector<mdb::memory_change> mdb::region_watch::changes()
+{
+  if (!is_enabled_)
+  {
+    error::send("Region watch is disabled");
+  }
+  process_->collect_dirty_pages();
+
+  std::vector<memory_change> changes;
+  last_compared_pages_ = 0;
+  for (std::size_t page = 0; page < dirty_pages_.size();)
+  {
+    if (!dirty_pages_[page])
+    {
+      ++page;
+      continue;
+    }
+
+    auto run_end = page;
+    while (run_end < dirty_pages_.size() and dirty_pages_[run_end])
+    {
+      ++run_end;
+    }
+    last_compared_pages_ += run_end - page;
+
+    auto low  = std::max(first_page() + page * page_size, address_.addr());
+    auto high = std::min(first_page() + run_end * page_size, address_.addr() + size_);
+    auto now  = process_->read_memory(virt_addr{low}, high - low);
+    auto old  = snapshot_.data() + (low - address_.addr());
+
+    for (auto start = find_difference(old, now.data(), 0, now.size(), true); start < now.size();)
+    {
+      auto end = find_difference(old, now.data(), start, now.size(), false);
+      changes.push_back(memory_change{virt_addr{low + start},
+                                      {old + start, old + end},
+                                      {now.begin() + static_cast<std::ptrdiff_t>(start),
+                                       now.begin() + static_cast<std::ptrdiff_t>(end)}});
+      start = find_difference(old, now.data(), end, now.size(), true);
+    }
+
+    std::copy(now.begin(), now.end(), old);
+    page = run_end;
+  }
+
+  std::fill(dirty_pages_.begin(), dirty_pages_.end(), false);
+  return changes;
+}
@@ -1,5 +1,10 @@
+#include <link.h>
+
+#include <algorithm>
+#include <libmdb/bit.hpp>
 #include <libmdb/target.hpp>
 #include <libmdb/types.hpp>
+#include <string>
 
 namespace
 {
@@ -11,6 +16,54 @@ std::unique_ptr<mdb::elf> create_loaded_elf(const mdb::process&          proc,
   obj->notify_loaded(mdb::virt_addr(auxv[AT_ENTRY] - obj->get_header().e_entry));
   return obj;
 }
+
+// Reads a page at a time so the read never runs into an unmapped page past the string
+std::string read_string(const mdb::process& proc, mdb::virt_addr address)
+{
+  constexpr std::uint64_t page_size = 0x1000;
+
+  std::string ret;
+  while (true)
+  {
+    auto amount = page_size - address.addr() % page_size;
+    auto data   = proc.read_memory(address, amount);
+    auto end    = std::find(data.begin(), data.end(), std::byte{0});
+    std::transform(data.begin(),
+                   end,
+                   std::back_inserter(ret),
+                   [](auto byte) { return static_cast<char>(byte); });
+    if (end != data.end())
+    {
+      return ret;
+    }
+    address += static_cast<std::int64_t>(amount);
+  }
+}
+
+// Aliases of one definition share an address
+void add_function_definitions(const mdb::elf&                      obj,
+                              const std::vector<const Elf64_Sym*>& symbols,
+                              std::vector<mdb::virt_addr>&         addresses)
+{
+  for (auto symbol : symbols)
+  {
+    if (ELF64_ST_TYPE(symbol->st_info) == STT_FUNC and symbol->st_shndx != SHN_UNDEF and
+        symbol->st_value != 0)
+    {
+      auto address = mdb::file_addr{obj, symbol->st_value}.to_virt_addr();
+      if (std::find(begin(addresses), end(addresses), address) == end(addresses))
+      {
+        addresses.push_back(address);
+      }
+    }
+  }
+}
+
+// A demangled function name always has its parameter list and usually a scope
+bool looks_like_cpp(std::string_view name)
+{
+  return name.find('(') != std::string_view::npos or name.find("::") != std::string_view::npos;
+}
 }  // namespace
 
 std::unique_ptr<mdb::target> mdb::target::launch(std::filesystem::path path,
@@ -18,7 +71,9 @@ std::unique_ptr<mdb::target> mdb::target::launch(std::filesystem::path path,
 {
   auto proc = process::launch(path, true, stdout_replacement);
   auto obj  = create_loaded_elf(*proc, path);
-  return std::unique_ptr<target>(new target(std::move(proc), std::move(obj)));
+  auto tgt  = std::unique_ptr<target>(new target(std::move(proc), std::move(obj)));
+  tgt->resolve_dynamic_linker_rendezvous();
+  return tgt;
 }
 
 std::unique_ptr<mdb::target> mdb::target::attach(pid_t pid)
@@ -26,5 +81,213 @@ std::unique_ptr<mdb::target> mdb::target::attach(pid_t pid)
   auto elf_path = std::filesystem::path("/proc/") / std::to_string(pid) / "exe";
   auto proc     = process::attach(pid);
   auto obj      = create_loaded_elf(*proc, elf_path);
-  return std::unique_ptr<target>(new target(std::move(proc), std::move(obj)));
-}
\ No newline at end of file
+  auto tgt      = std::unique_ptr<target>(new target(std::move(proc), std::move(obj)));
+  tgt->resolve_dynamic_linker_rendezvous();
+  return tgt;
+}
+
+void mdb::target::resolve_dynamic_linker_rendezvous()
+{
+  auto dynamic = elf_->get_section(".dynamic");
+  if (!dynamic)
+  {
+    return;
+  }
+
+  // The loader fills in DT_DEBUG before it hands control to the entry point
+  auto start   = file_addr{*elf_, dynamic.value()->sh_addr}.to_virt_addr();
+  auto entries = process_->read_memory(start, dynamic.value()->sh_size);
+  for (std::size_t offset = 0; offset + sizeof(Elf64_Dyn) <= entries.size();
+       offset += sizeof(Elf64_Dyn))
+  {
+    auto entry = from_bytes<Elf64_Dyn>(entries.data() + offset);
+    if (entry.d_tag == DT_NULL)
+    {
+      break;
+    }
+    if (entry.d_tag == DT_DEBUG and entry.d_un.d_ptr != 0)
+    {
+      rendezvous_address_ = virt_addr{entry.d_un.d_ptr};
+    }
+  }
+
+  // Runs once whether or not the user also has a breakpoint at the entry point
+  auto entry_point = virt_addr{process_->get_auxv()[AT_ENTRY]};
+  if (!rendezvous_address_ and !entry_hook_)
+  {
+    entry_hook_ = process_->add_internal_hook(entry_point,
+                                              [this, entry_point](auto&)
+                                              {
+                                                process_->remove_internal_hook(entry_point,
+                                                                               *entry_hook_);
+                                                resolve_dynamic_linker_rendezvous();
+                                                return false;
+                                              });
+  }
+  if (!rendezvous_address_)
+  {
+    return;
+  }
+
+  // The loader calls r_brk before and after every change to the list of objects
+  auto debug = read_rendezvous();
+  process_->add_internal_hook(virt_addr{debug.r_brk},
+                              [this](auto&)
+                              {
+                                reload_dynamic_libraries();
+                                return false;
+                              });
+  reload_dynamic_libraries();
+}
+
+r_debug mdb::target::read_rendezvous() const
+{
+  return from_bytes<r_debug>(process_->read_memory(*rendezvous_address_, sizeof(r_debug)).data());
+}
+
+void mdb::target::reload_dynamic_libraries()
+{
+  if (!rendezvous_address_)
+  {
+    return;
+  }
+
+  auto debug = read_rendezvous();
+  if (debug.r_state != r_debug::RT_CONSISTENT)
+  {
+    return;
+  }
+
+  std::vector<std::pair<std::filesystem::path, virt_addr>> loaded;
+  for (auto entry = reinterpret_cast<std::uint64_t>(debug.r_map); entry != 0;)
+  {
+    auto map =
+        from_bytes<link_map>(process_->read_memory(virt_addr{entry}, sizeof(link_map)).data());
+    auto name_address = reinterpret_cast<std::uint64_t>(map.l_name);
+    auto name         = name_address ? read_string(*process_, virt_addr{name_address})
+                                     : std::string();
+
+    // The executable has no name, and the vDSO has no file behind it
+    if (!name.empty() and std::filesystem::exists(name))
+    {
+      loaded.emplace_back(name, virt_addr{map.l_addr});
+    }
+    entry = reinterpret_cast<std::uint64_t>(map.l_next);
+  }
+
+  std::vector<const elf*> unloaded;
+  elves_.for_each(
+      [&](const elf& obj)
+      {
+        auto still_loaded = std::find_if(begin(loaded),
+                                         end(loaded),
+                                         [&](auto& object)
+                                         {
+                                           return object.first == obj.path() and
+                                                  object.second == obj.load_bias();
+                                         });
+        if (&obj != elf_ and still_loaded == end(loaded))
+        {
+          unloaded.push_back(&obj);
+        }
+      });
+  for (auto obj : unloaded)
+  {
+    elves_.remove(*obj);
+  }
+
+  std::vector<const elf*> newly_loaded;
+  for (auto& [path, bias] : loaded)
+  {
+    auto existing = elves_.get_elf_by_path(path);
+    if (!existing or existing->load_bias() != bias)
+    {
+      auto obj = std::make_unique<elf>(path);
+      obj->notify_loaded(bias);
+      newly_loaded.push_back(&elves_.push(std::move(obj)));
+    }
+  }
+  resolve_pending_breakpoints(newly_loaded);
+}
+
+std::vector<mdb::breakpoint_site*> mdb::target::create_function_breakpoint(
+    std::string name, bool is_hardware, breakpoint_setup setup)
+{
+  pending_breakpoints_.push_back({std::move(name), is_hardware, std::move(setup)});
+
+  std::vector<const elf*> loaded;
+  elves_.for_each([&](const elf& obj) { loaded.push_back(&obj); });
+  return resolve_pending_breakpoints(loaded);
+}
+
+mdb::tracepoint& mdb::target::create_tracepoint(virt_addr address)
+{
+  std::optional<tracepoint::address_range> function;
+  if (auto obj = elves_.get_elf_containing_address(address))
+  {
+    auto symbol = obj->get_symbol_containing_address(address);
+    if (symbol and ELF64_ST_TYPE(symbol.value()->st_info) == STT_FUNC)
+    {
+      auto low = file_addr{*obj, symbol.value()->st_value}.to_virt_addr();
+      function.emplace(low, low + symbol.value()->st_size);
+    }
+  }
+  return process_->create_tracepoint(address, function);
+}
+
+std::vector<mdb::breakpoint_site*> mdb::target::resolve_pending_breakpoints(
+    const std::vector<const elf*>& loaded)
+{
+  std::vector<breakpoint_site*> created;
+  if (pending_breakpoints_.empty() or loaded.empty())
+  {
+    return created;
+  }
+
+  // Sites are all created before any is enabled, while the loader is stopped short of
+  // running the new objects' initializers
+  for (auto it = pending_breakpoints_.begin(); it != pending_breakpoints_.end();)
+  {
+    // Every object's hash table is probed before any demangled names, whose index a freshly
+    // loaded object may still be building
+    std::vector<virt_addr> addresses;
+    for (auto obj : loaded)
+    {
+      add_function_definitions(*obj, obj->get_symbols_by_raw_name(it->name), addresses);
+    }
+    if (addresses.empty() and looks_like_cpp(it->name))
+    {
+      for (auto obj : loaded)
+      {
+        add_function_definitions(*obj, obj->get_symbols_by_demangled_name(it->name), addresses);
+      }
+    }
+    if (addresses.empty())
+    {
+      ++it;
+      continue;
+    }
+
+    // A user breakpoint already at a definition is shared and takes on this one's setup
+    auto& sites = process_->breakpoint_sites();
+    for (auto address : addresses)
+    {
+      auto  existing = sites.contains_address(address) ? &sites.get_by_address(address) : nullptr;
+      auto& site     = existing and !existing->is_internal()
+                           ? *existing
+                           : process_->create_breakpoint_site(address, it->is_hardware);
+      if (it->setup)
+      {
+        it->setup(site);
+      }
+      created.push_back(&site);
+    }
+    it = pending_breakpoints_.erase(it);
+  }
+
+  for (auto site : created)
+  {
+    site->enable();
+  }
+  return created;
+}
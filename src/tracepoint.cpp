@@ -0,0 +1,401 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <libmdb/bit.hpp>
+#include <libmdb/disassembler.hpp>
+#include <libmdb/error.hpp>
+#include <libmdb/process.hpp>
+#include <libmdb/tracepoint.hpp>
+
+namespace
+{
+auto get_next_id()
+{
+  static mdb::tracepoint::id_type id = 0;
+  return ++id;
+}
+
+// Shared between mdb and the inferior. Producers reserve room through used before they claim
+// a position from head, so a claimed slot is always free; the consumer-owned tail lives on its
+// own cache line.
+struct ring_header
+{
+  std::uint64_t head;
+  std::uint64_t capacity;
+  std::uint64_t mask;
+  std::uint64_t dropped;
+  std::uint64_t used;
+  std::uint64_t padding0[3];
+  std::uint64_t tail;
+  std::uint64_t padding1[7];
+};
+static_assert(sizeof(ring_header) == 128);
+
+// A slot is published by storing its position + 1 in sequence after the record is written,
+// so a claimed slot whose writer is still running is never read
+struct ring_slot
+{
+  mdb::tracepoint_record record;
+  std::uint64_t          sequence;
+};
+static_assert(sizeof(mdb::tracepoint_record) == 152);
+static_assert(sizeof(ring_slot) == 160);
+
+constexpr std::size_t jump_size       = 5;
+constexpr std::size_t code_chunk_size = 0x10000;
+constexpr std::size_t red_zone_size   = 128;
+
+// Position-independent trampoline prologue. Steps over the red zone, reserves room and claims
+// the next ring position with lock xadd, fills a tracepoint_record from the live registers,
+// publishes the slot and restores everything it clobbered. The claimed position is parked in
+// the timestamp field until rdtsc is done with rdx. The ring address and tracepoint id are
+// patched in at the offsets below.
+constexpr std::uint8_t trampoline_template[] = {
+    0x48, 0x8d, 0x64, 0x24, 0x80,                    // lea    rsp, [rsp-0x80]
+    0x9c,                                            // pushfq
+    0x50,                                            // push   rax
+    0x51,                                            // push   rcx
+    0x52,                                            // push   rdx
+    0x48, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0,              // movabs rax, <ring>
+    0xb9, 0x01, 0x00, 0x00, 0x00,                    // mov    ecx, 1
+    0xf0, 0x48, 0x0f, 0xc1, 0x48, 0x20,              // lock xadd [rax+0x20], rcx ; used
+    0x48, 0x3b, 0x48, 0x08,                          // cmp    rcx, [rax+0x8]       ; capacity
+    0x0f, 0x83, 0xb3, 0x00, 0x00, 0x00,              // jae    full
+    0xb9, 0x01, 0x00, 0x00, 0x00,                    // mov    ecx, 1
+    0xf0, 0x48, 0x0f, 0xc1, 0x08,                    // lock xadd [rax], rcx      ; head
+    0x48, 0x89, 0xca,                                // mov    rdx, rcx
+    0x48, 0x23, 0x50, 0x10,                          // and    rdx, [rax+0x10]      ; mask
+    0x48, 0x69, 0xd2, 0xa0, 0x00, 0x00, 0x00,        // imul   rdx, rdx, 160
+    0x48, 0x8d, 0x94, 0x10, 0x80, 0x00, 0x00, 0x00,  // lea    rdx, [rax+rdx+0x80]
+    0x48, 0x89, 0x4a, 0x08,                          // mov    [rdx+0x8], rcx       ; position
+    0x48, 0xc7, 0x02, 0, 0, 0, 0,                    // mov    qword [rdx], <id>
+    0x48, 0x89, 0x5a, 0x20,                          // mov    [rdx+0x20], rbx
+    0x48, 0x89, 0x72, 0x38,                          // mov    [rdx+0x38], rsi
+    0x48, 0x89, 0x7a, 0x40,                          // mov    [rdx+0x40], rdi
+    0x48, 0x89, 0x6a, 0x48,                          // mov    [rdx+0x48], rbp
+    0x4c, 0x89, 0x42, 0x58,                          // mov    [rdx+0x58], r8
+    0x4c, 0x89, 0x4a, 0x60,                          // mov    [rdx+0x60], r9
+    0x4c, 0x89, 0x52, 0x68,                          // mov    [rdx+0x68], r10
+    0x4c, 0x89, 0x5a, 0x70,                          // mov    [rdx+0x70], r11
+    0x4c, 0x89, 0x62, 0x78,                          // mov    [rdx+0x78], r12
+    0x4c, 0x89, 0xaa, 0x80, 0x00, 0x00, 0x00,        // mov    [rdx+0x80], r13
+    0x4c, 0x89, 0xb2, 0x88, 0x00, 0x00, 0x00,        // mov    [rdx+0x88], r14
+    0x4c, 0x89, 0xba, 0x90, 0x00, 0x00, 0x00,        // mov    [rdx+0x90], r15
+    0x48, 0x8b, 0x4c, 0x24, 0x18,                    // mov    rcx, [rsp+0x18]      ; rflags
+    0x48, 0x89, 0x4a, 0x10,                          // mov    [rdx+0x10], rcx
+    0x48, 0x8b, 0x4c, 0x24, 0x10,                    // mov    rcx, [rsp+0x10]      ; rax
+    0x48, 0x89, 0x4a, 0x18,                          // mov    [rdx+0x18], rcx
+    0x48, 0x8b, 0x4c, 0x24, 0x08,                    // mov    rcx, [rsp+0x8]       ; rcx
+    0x48, 0x89, 0x4a, 0x28,                          // mov    [rdx+0x28], rcx
+    0x48, 0x8b, 0x0c, 0x24,                          // mov    rcx, [rsp]           ; rdx
+    0x48, 0x89, 0x4a, 0x30,                          // mov    [rdx+0x30], rcx
+    0x48, 0x8d, 0x8c, 0x24, 0xa0, 0x00, 0x00, 0x00,  // lea    rcx, [rsp+0xa0]      ; rsp
+    0x48, 0x89, 0x4a, 0x50,                          // mov    [rdx+0x50], rcx
+    0x48, 0x89, 0xd1,                                // mov    rcx, rdx
+    0x0f, 0x31,                                      // rdtsc
+    0x48, 0xc1, 0xe2, 0x20,                          // shl    rdx, 32
+    0x48, 0x09, 0xd0,                                // or     rax, rdx
+    0x48, 0x8b, 0x51, 0x08,                          // mov    rdx, [rcx+0x8]       ; position
+    0x48, 0x89, 0x41, 0x08,                          // mov    [rcx+0x8], rax
+    0x48, 0xff, 0xc2,                                // inc    rdx
+    0x48, 0x89, 0x91, 0x98, 0x00, 0x00, 0x00,        // mov    [rcx+0x98], rdx  ; publish
+    0xeb, 0x0a,                                      // jmp    done
+    0xf0, 0x48, 0xff, 0x48, 0x20,                    // full: lock dec qword [rax+0x20]
+    0xf0, 0x48, 0xff, 0x40, 0x18,                    // lock inc qword [rax+0x18]
+    0x5a,                                            // done: pop rdx
+    0x59,                                            // pop    rcx
+    0x58,                                            // pop    rax
+    0x9d,                                            // popfq
+    0x48, 0x8d, 0xa4, 0x24, 0x80, 0x00, 0x00, 0x00,  // lea    rsp, [rsp+0x80]
+};
+static_assert(sizeof(trampoline_template) == 0xf1);
+constexpr std::size_t trampoline_ring_offset = 0x0b;
+constexpr std::size_t trampoline_id_offset   = 0x4f;
+
+// jmp qword [rip+0] followed by the absolute return address
+constexpr std::uint8_t absolute_jump[] = {0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+
+constexpr std::array<mdb::register_id, 16> record_registers = {
+    mdb::register_id::rax, mdb::register_id::rbx, mdb::register_id::rcx, mdb::register_id::rdx,
+    mdb::register_id::rsi, mdb::register_id::rdi, mdb::register_id::rbp, mdb::register_id::rsp,
+    mdb::register_id::r8,  mdb::register_id::r9,  mdb::register_id::r10, mdb::register_id::r11,
+    mdb::register_id::r12, mdb::register_id::r13, mdb::register_id::r14, mdb::register_id::r15};
+
+std::uint64_t check_syscall(std::int64_t ret, const std::string& what)
+{
+  if (ret < 0 and ret > -4096)
+  {
+    mdb::error::send(what + ": " + std::strerror(static_cast<int>(-ret)));
+  }
+  return static_cast<std::uint64_t>(ret);
+}
+
+bool within_jump_range(mdb::virt_addr from, mdb::virt_addr to)
+{
+  auto distance = static_cast<std::int64_t>(to.addr() - from.addr());
+  constexpr std::int64_t limit = (std::int64_t(1) << 31) - std::int64_t(code_chunk_size);
+  return -limit < distance and distance < limit;
+}
+
+std::vector<std::pair<std::uint64_t, std::uint64_t>> read_mappings(pid_t pid)
+{
+  std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> ret;
+  std::string                                          line;
+  while (std::getline(maps, line))
+  {
+    auto dash = line.find('-');
+    auto low  = std::strtoull(line.c_str(), nullptr, 16);
+    auto high = std::strtoull(line.c_str() + dash + 1, nullptr, 16);
+    ret.emplace_back(low, high);
+  }
+  std::sort(begin(ret), end(ret));
+  return ret;
+}
+
+ring_header& header_of(mdb::mapped_file& ring)
+{
+  return *reinterpret_cast<ring_header*>(ring.data());
+}
+}  // namespace
+
+std::uint64_t mdb::tracepoint_record::read(register_id id) const
+{
+  auto it = std::find(begin(record_registers), end(record_registers), id);
+  if (it == end(record_registers))
+  {
+    error::send("Register is not recorded by tracepoints");
+  }
+  return gprs[static_cast<std::size_t>(it - begin(record_registers))];
+}
+
+mdb::tracepoint::tracepoint(process& proc, virt_addr address, std::optional<address_range> function)
+    : id_{get_next_id()}, process_{&proc}, address_{address}, is_enabled_{false}
+{
+  disassembler dis(proc);
+  auto         extents = dis.decode_extents(address, jump_size);
+
+  std::size_t patch_size = 0;
+  for (auto& extent : extents)
+  {
+    if (extent.is_position_dependent)
+    {
+      error::send("Cannot relocate position-dependent instruction for tracepoint");
+    }
+    patch_size += extent.length;
+  }
+
+  auto end = address + patch_size;
+
+  // A branch to any instruction after the first would land in the middle of the jump
+  if (extents.size() > 1)
+  {
+    if (!function)
+    {
+      error::send("Cannot check for branches into a tracepoint outside a known function");
+    }
+    for (auto target : dis.find_branch_targets(function->first, function->second))
+    {
+      if (address < target and target < end)
+      {
+        error::send("Tracepoint would patch over a branch target");
+      }
+    }
+  }
+
+  if (!proc.breakpoint_sites().get_in_region(address, end).empty() or
+      !proc.tracepoints().get_in_region(address, end).empty())
+  {
+    error::send("Tracepoint would overlap an existing stoppoint");
+  }
+  original_code_ = proc.read_memory_without_traps(address, patch_size);
+
+  auto& buffer = proc.get_tracepoint_buffer();
+  auto  size   = sizeof(trampoline_template) + patch_size + sizeof(absolute_jump) + 8;
+  trampoline_  = buffer.allocate_code(address, size);
+
+  std::vector<std::byte> code(size);
+  std::memcpy(code.data(), trampoline_template, sizeof(trampoline_template));
+  std::memcpy(code.data() + trampoline_ring_offset, &buffer.inferior_address_, 8);
+  auto id = static_cast<std::uint32_t>(id_);
+  std::memcpy(code.data() + trampoline_id_offset, &id, sizeof(id));
+
+  auto pos = code.data() + sizeof(trampoline_template);
+  std::memcpy(pos, original_code_.data(), patch_size);
+  pos += patch_size;
+  std::memcpy(pos, absolute_jump, sizeof(absolute_jump));
+  pos += sizeof(absolute_jump);
+  auto resume_address = address.addr() + patch_size;
+  std::memcpy(pos, &resume_address, 8);
+
+  proc.write_memory(trampoline_, {code.data(), code.size()});
+}
+
+void mdb::tracepoint::enable()
+{
+  if (is_enabled_)
+  {
+    return;
+  }
+
+  auto pc = process_->get_pc();
+  if (address_ < pc and pc < address_ + patch_size())
+  {
+    error::send("Cannot patch tracepoint while stopped inside it");
+  }
+
+  std::vector<std::byte> patch(patch_size(), std::byte{0xcc});
+  auto displacement = static_cast<std::int32_t>(trampoline_.addr() - (address_.addr() + jump_size));
+  patch[0]          = std::byte{0xe9};
+  std::memcpy(patch.data() + 1, &displacement, sizeof(displacement));
+
+  process_->write_memory(address_, {patch.data(), patch.size()});
+  is_enabled_ = true;
+}
+
+void mdb::tracepoint::disable()
+{
+  if (!is_enabled_)
+  {
+    return;
+  }
+
+  auto pc = process_->get_pc();
+  if (address_ < pc and pc < address_ + patch_size())
+  {
+    error::send("Cannot unpatch tracepoint while stopped inside it");
+  }
+
+  process_->write_memory(address_, {original_code_.data(), original_code_.size()});
+  is_enabled_ = false;
+}
+
+mdb::tracepoint_buffer::tracepoint_buffer(process& proc, std::size_t capacity)
+    : process_(&proc), capacity_(capacity)
+{
+  if (capacity == 0 or (capacity & (capacity - 1)) != 0)
+  {
+    error::send("Tracepoint buffer capacity must be a power of two");
+  }
+
+  auto dir  = std::filesystem::is_directory("/dev/shm") ? std::filesystem::path("/dev/shm")
+                                                        : std::filesystem::temp_directory_path();
+  auto path = dir / ("mdb-tracepoints-" + std::to_string(getpid()) + "-" +
+                     std::to_string(proc.pid()));
+  auto size = sizeof(ring_header) + capacity * sizeof(ring_slot);
+  ring_     = mapped_file::create(path, size);
+
+  auto& header    = header_of(*ring_);
+  header.capacity = capacity;
+  header.mask     = capacity - 1;
+
+  // The path is staged below the inferior's red zone, which nothing live can occupy
+  auto& name         = path.native();
+  auto  sp           = proc.get_registers().read_by_id_as<std::uint64_t>(register_id::rsp);
+  auto  name_address = virt_addr{(sp - red_zone_size - name.size() - 1) & ~std::uint64_t(0xf)};
+  auto  name_bytes   = reinterpret_cast<const std::byte*>(name.c_str());
+  proc.write_memory(name_address, {name_bytes, name.size() + 1});
+
+  auto fd = proc.inject_syscall(SYS_openat, AT_FDCWD, name_address.addr(), O_RDWR | O_CLOEXEC);
+  std::filesystem::remove(path);
+  check_syscall(fd, "Inferior could not open tracepoint buffer");
+
+  auto address = proc.inject_syscall(SYS_mmap, 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  proc.inject_syscall(SYS_close, fd);
+  inferior_address_ = virt_addr{check_syscall(address, "Inferior could not map tracepoint buffer")};
+}
+
+std::size_t mdb::tracepoint_buffer::drain(
+    const std::function<void(const tracepoint_record&)>& callback)
+{
+  auto& header = header_of(*ring_);
+  auto  slots  = reinterpret_cast<const ring_slot*>(ring_->data() + sizeof(ring_header));
+
+  // Threads the inferior did not stop may still be filling the slots they claimed; reading
+  // ends at the first of them and picks up from there next time
+  auto head = __atomic_load_n(&header.head, __ATOMIC_ACQUIRE);
+  auto tail = header.tail;
+  auto i    = tail;
+  for (; i != head; ++i)
+  {
+    auto& slot = slots[i & header.mask];
+    if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != i + 1)
+    {
+      break;
+    }
+    callback(slot.record);
+  }
+  __atomic_store_n(&header.tail, i, __ATOMIC_RELEASE);
+  __atomic_fetch_sub(&header.used, i - tail, __ATOMIC_RELEASE);
+
+  return i - tail;
+}
+
+std::uint64_t mdb::tracepoint_buffer::dropped() const
+{
+  auto& header = *reinterpret_cast<const ring_header*>(ring_->data());
+  return __atomic_load_n(&header.dropped, __ATOMIC_RELAXED);
+}
+
+mdb::virt_addr mdb::tracepoint_buffer::allocate_code(virt_addr near, std::size_t size)
+{
+  for (auto& chunk : code_chunks_)
+  {
+    if (chunk.used + size <= code_chunk_size and within_jump_range(near, chunk.address))
+    {
+      auto ret = chunk.address + chunk.used;
+      chunk.used += (size + 15) & ~std::size_t(15);
+      return ret;
+    }
+  }
+
+  // Pick the free gap closest to the patch site so that a rel32 jump can reach it
+  auto                         mappings = read_mappings(process_->pid());
+  std::optional<std::uint64_t> best;
+  auto distance = [&](std::uint64_t addr) { return addr > near ? addr - near : near - addr; };
+  for (std::size_t i = 1; i < mappings.size(); ++i)
+  {
+    auto low  = mappings[i - 1].second;
+    auto high = mappings[i].first;
+    if (high - low < code_chunk_size)
+    {
+      continue;
+    }
+
+    auto candidate = high <= near ? high - code_chunk_size : low;
+    if (within_jump_range(near, virt_addr{candidate}) and
+        (!best or distance(candidate) < distance(*best)))
+    {
+      best = candidate;
+    }
+  }
+  if (!best)
+  {
+    error::send("No free address space within jump range of tracepoint");
+  }
+
+  auto address = check_syscall(
+      process_->inject_syscall(SYS_mmap,
+                               *best,
+                               code_chunk_size,
+                               PROT_READ | PROT_EXEC,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                               -1,
+                               0),
+      "Inferior could not map trampoline page");
+  if (address != *best)
+  {
+    process_->inject_syscall(SYS_munmap, address, code_chunk_size);
+    error::send("Inferior could not map trampoline page near tracepoint");
+  }
+
+  code_chunks_.push_back({virt_addr{address}, (size + 15) & ~std::size_t(15)});
+  return virt_addr{address};
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <libmdb/error.hpp>
 #include <libmdb/process.hpp>
 #include <libmdb/watchpoint.hpp>
@@ -12,13 +13,30 @@ auto get_next_id()
 }
 }  // namespace mdb
 
-mdb::watchpoint::watchpoint(process& proc, virt_addr address, stoppoint_mode mode, std::size_t size)
-    : process_{&proc}, address_{address}, mode_{mode}, size_{size}, is_enabled_{false}
+mdb::watchpoint::watchpoint(process&       proc,
+                            virt_addr      address,
+                            stoppoint_mode mode,
+                            std::size_t    size,
+                            bool           is_hardware)
+    : process_{&proc},
+      address_{address},
+      mode_{mode},
+      size_{size},
+      is_enabled_{false},
+      is_hardware_{is_hardware}
 {
-  if (address.addr() & (size - 1) != 0)
+  if (is_hardware_ and (address.addr() & (size - 1)) != 0)
   {
     error::send("Watchpoint must be aligned to size");
   }
+  if (!is_hardware_ and mode_ == stoppoint_mode::execute)
+  {
+    error::send("Software watchpoints cannot watch execution");
+  }
+  if (size_ == 0)
+  {
+    error::send("Watchpoint size must be positive");
+  }
 
   id_ = get_next_id();
   update_data();
@@ -31,8 +49,15 @@ void mdb::watchpoint::enable()
     return;
   }
 
-  hardware_register_index_ = process_->set_watchpoint(id_, address_, mode_, size_);
-  is_enabled_              = true;
+  if (is_hardware_)
+  {
+    process_->schedule_hardware_stoppoints(this);
+  }
+  else
+  {
+    install_trap();
+  }
+  is_enabled_ = true;
 }
 
 void mdb::watchpoint::disable()
@@ -42,14 +67,80 @@ void mdb::watchpoint::disable()
     return;
   }
 
-  process_->clear_hardware_stoppoint(hardware_register_index_);
+  if (is_hardware_)
+  {
+    process_->release_hardware_stoppoint(this);
+  }
+  else
+  {
+    remove_trap();
+  }
   is_enabled_ = false;
 }
 
-void mdb::watchpoint::update_data()
+void mdb::watchpoint::set_pinned(bool pinned)
+{
+  is_pinned_ = pinned;
+  if (is_enabled_ and is_hardware_)
+  {
+    process_->schedule_hardware_stoppoints();
+  }
+}
+
+void mdb::watchpoint::install_trap()
+{
+  process_->protect_watched_pages(*this);
+}
+
+void mdb::watchpoint::remove_trap()
+{
+  process_->unprotect_watched_pages(*this);
+}
+
+bool mdb::watchpoint::update_data()
 {
   std::uint64_t new_data = 0;
   auto          read     = process_->read_memory(address_, size_);
-  memcpy(&new_data, read.data(), size_);
+  memcpy(&new_data, read.data(), std::min(size_, sizeof(new_data)));
   previous_data_ = std::exchange(data_, new_data);
-}
\ No newline at end of file
+
+  bool changed = read != contents_;
+  contents_    = std::move(read);
+  return changed;
+}
+
+void mdb::watchpoint::start_logging(std::size_t capacity)
+{
+  if (capacity == 0)
+  {
+    error::send("History capacity must be positive");
+  }
+  history_.assign(capacity, watch_record{});
+  recorded_ = 0;
+}
+
+void mdb::watchpoint::stop_logging()
+{
+  history_.clear();
+  recorded_ = 0;
+}
+
+std::vector<mdb::watch_record> mdb::watchpoint::history() const
+{
+  auto size  = std::min<std::uint64_t>(recorded_, history_.size());
+  auto first = recorded_ - size;
+
+  std::vector<watch_record> ordered;
+  ordered.reserve(size);
+  for (auto i = first; i < recorded_; ++i)
+  {
+    ordered.push_back(history_[i % history_.size()]);
+  }
+  return ordered;
+}
+
+void mdb::watchpoint::record_hit(pid_t tid, virt_addr pc)
+{
+  history_[recorded_++ % history_.size()] =
+      watch_record{std::chrono::system_clock::now(), tid, pc, previous_data_, data_};
+}
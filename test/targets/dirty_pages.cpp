@@ -0,0 +1,20 @@
+#include <signal.h>
+#include <unistd.h>
+
+alignas(4096) char heap[64 * 4096];
+
+int main()
+{
+  auto address = &heap;
+  write(STDOUT_FILENO, &address, sizeof(void*));
+  raise(SIGTRAP);
+
+  heap[5 * 4096 + 100]   = 1;
+  heap[5 * 4096 + 101]   = 2;
+  heap[40 * 4096 + 4095] = 3;
+  heap[41 * 4096]        = 4;
+  raise(SIGTRAP);
+
+  heap[7] = heap[7];
+  raise(SIGTRAP);
+}
@@ -0,0 +1,20 @@
+#include <cstdio>
+
+extern "C" int exported_add(int lhs, int rhs)
+{
+  return lhs + rhs;
+}
+
+extern "C"
+{
+int exported_counter = 0;
+}
+
+namespace exported
+{
+int scale(int value)
+{
+  std::puts("scaling");
+  return value * 3;
+}
+}  // namespace exported
@@ -0,0 +1,24 @@
+#include <cstdio>
+
+__attribute__((noinline)) double scale(double value, int times)
+{
+  for (int i = 0; i < times; ++i)
+  {
+    value *= 1.5;
+  }
+  return value;
+}
+
+__attribute__((noinline)) long raw_getpid()
+{
+  long ret;
+  asm volatile("syscall" : "=a"(ret) : "a"(39) : "rcx", "r11", "memory");
+  return ret;
+}
+
+int main()
+{
+  auto scaled = scale(2.0, 4);
+  auto pid    = raw_getpid();
+  std::printf("%f %ld\n", scaled, pid);
+}
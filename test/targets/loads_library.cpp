@@ -0,0 +1,34 @@
+#include <dlfcn.h>
+
+#include <cstdio>
+
+extern "C" int exported_add(int lhs, int rhs);
+
+extern "C" __attribute__((noinline)) void after_unload()
+{
+  std::puts("unloaded");
+}
+
+int main()
+{
+  std::printf("%d\n", exported_add(1, 2));
+
+  auto handle = dlopen("libexported_sysv.so", RTLD_NOW);
+  if (!handle)
+  {
+    return 1;
+  }
+  auto add = reinterpret_cast<int (*)(int, int)>(dlsym(handle, "exported_add"));
+  std::printf("%d\n", add(3, 4));
+  dlclose(handle);
+
+  after_unload();
+
+  auto plugin = dlopen("libplugin.so", RTLD_NOW);
+  if (!plugin)
+  {
+    return 1;
+  }
+  auto get = reinterpret_cast<int (*)()>(dlsym(plugin, "plugin_get"));
+  std::printf("%d\n", get());
+}
@@ -0,0 +1,12 @@
+extern "C" __attribute__((noinline)) int plugin_initial_value()
+{
+  return 42;
+}
+
+// Dynamically initialized, so plugin_initial_value runs with the library's initializers
+int plugin_value = plugin_initial_value();
+
+extern "C" int plugin_get()
+{
+  return plugin_value;
+}
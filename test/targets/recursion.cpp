@@ -0,0 +1,9 @@
+int fib(int n)
+{
+  return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+int main()
+{
+  return fib(10) == 55 ? 0 : 1;
+}
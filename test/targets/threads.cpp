@@ -0,0 +1,27 @@
+#include <thread>
+#include <vector>
+
+int count(int thread, int i)
+{
+  return thread + i;
+}
+
+int main()
+{
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < 4; ++thread)
+  {
+    threads.emplace_back(
+        [thread]
+        {
+          for (int i = 0; i < 10000; ++i)
+          {
+            count(thread, i);
+          }
+        });
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+}
@@ -0,0 +1,24 @@
+#include <signal.h>
+#include <unistd.h>
+
+alignas(4096) int buffer[2048];
+
+int main()
+{
+  auto address = &buffer;
+  write(STDOUT_FILENO, &address, sizeof(void*));
+  raise(SIGTRAP);
+
+  volatile int sum = 0;
+  for (int i = 0; i < 2048; ++i)
+  {
+    sum += buffer[i];
+  }
+  for (int i = 0; i < 2048; i += 64)
+  {
+    buffer[i] = i;
+  }
+  buffer[1500] = 7;
+
+  return sum;
+}
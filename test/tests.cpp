@@ -1,12 +1,23 @@
 #include <elf.h>
 #include <fcntl.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <csignal>
+#include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <libmdb/bit.hpp>
+#include <libmdb/call_tracer.hpp>
+#include <libmdb/disassembler.hpp>
+#include <libmdb/dwarf.hpp>
 #include <libmdb/error.hpp>
+#include <libmdb/execution_log.hpp>
+#include <libmdb/expression.hpp>
+#include <libmdb/instruction_trace.hpp>
+#include <libmdb/logpoint.hpp>
 #include <libmdb/pipe.hpp>
 #include <libmdb/process.hpp>
 #include <libmdb/syscalls.hpp>
@@ -16,6 +27,10 @@
 using namespace mdb;
 namespace
 {
+// An empty cache directory keeps the test run out of the user's real index cache; the cache
+// test points it at a directory of its own
+const int cache_disabled = setenv("MDB_CACHE_DIR", "", 1);
+
 bool process_exists(pid_t pid)
 {
   auto ret = kill(pid, 0);
@@ -447,6 +462,581 @@ TEST_CASE("Hardware breakpoint evades memory checksums", "[breakpoint]")
   REQUIRE(to_string_view(channel.read()) == "Putting pineapple on pizza...\n");
 }
 
+TEST_CASE("Step over and step out run calls at full speed", "[step]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto main = elf.get_symbols_by_name("main").at(0);
+  auto rsp  = [&] { return proc.get_registers().read_by_id_as<std::uint64_t>(register_id::rsp); };
+  auto eax  = [&] { return proc.get_registers().read_by_id_as<std::uint32_t>(register_id::eax); };
+
+  auto& main_site = proc.create_breakpoint_site(file_addr{elf, main->st_value}.to_virt_addr());
+  main_site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  proc.breakpoint_sites().remove_by_id(main_site.id());
+
+  while (!disassembler(proc).decode_extents(proc.get_pc(), 1).front().is_call)
+  {
+    proc.step_instruction();
+  }
+  auto call_pc  = proc.get_pc();
+  auto call_rsp = rsp();
+  auto n_sites  = proc.breakpoint_sites().size();
+  auto reason   = proc.step_over();
+
+  REQUIRE(reason.trap_reason == trap_type::software_break);
+  REQUIRE(proc.get_pc() == call_pc + std::int64_t{5});
+  REQUIRE(rsp() == call_rsp);
+  REQUIRE(eax() == 55);
+  REQUIRE(proc.breakpoint_sites().size() == n_sites);
+}
+
+TEST_CASE("Step out returns to the calling frame", "[step]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto fib = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto rsp = [&] { return proc.get_registers().read_by_id_as<std::uint64_t>(register_id::rsp); };
+  auto edi = [&] { return proc.get_registers().read_by_id_as<std::uint32_t>(register_id::edi); };
+
+  auto& site = proc.create_breakpoint_site(file_addr{elf, fib->st_value}.to_virt_addr());
+  site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(edi() == 9);
+  proc.breakpoint_sites().remove_by_id(site.id());
+
+  // From the entry of fib(9) back into fib(10), then from the body of fib(10) into main
+  auto entry_rsp = rsp();
+  auto n_sites   = proc.breakpoint_sites().size();
+  proc.step_out();
+  REQUIRE(rsp() == entry_rsp + 8);
+  REQUIRE(proc.read_memory(proc.get_pc() - std::int64_t{5}, 1)[0] == std::byte{0xe8});
+  REQUIRE(elf.get_symbol_containing_address(proc.get_pc()).value() == fib);
+
+  // A frame pointer that leads to a stack address instead of a return address is refused
+  // before any trap is planted
+  auto          rbp      = proc.get_registers().read_by_id_as<std::uint64_t>(register_id::rbp);
+  std::uint64_t fake_rbp = rsp() - 64;
+  std::uint64_t not_code = rsp();
+  proc.write_memory(virt_addr{fake_rbp + 8}, {as_bytes(not_code), sizeof(not_code)});
+  proc.get_registers().write_by_id(register_id::rbp, fake_rbp);
+  REQUIRE_THROWS_AS(proc.step_out(), error);
+  REQUIRE(proc.breakpoint_sites().size() == n_sites);
+  proc.get_registers().write_by_id(register_id::rbp, rbp);
+
+  auto reason = proc.step_out();
+  REQUIRE(reason.reason == process_state::stopped);
+  REQUIRE(proc.get_registers().read_by_id_as<std::uint32_t>(register_id::eax) == 55);
+  REQUIRE(elf.get_symbol_containing_address(proc.get_pc()).value() ==
+          elf.get_symbols_by_name("main").at(0));
+  REQUIRE(proc.breakpoint_sites().size() == n_sites);
+}
+
+TEST_CASE("Fast stepping counts the same instructions as single steps", "[step]")
+{
+  auto run_to_call = [](target& target)
+  {
+    auto& proc = target.get_process();
+    auto  main = target.get_elf().get_symbols_by_name("main").at(0);
+    auto& site =
+        proc.create_breakpoint_site(file_addr{target.get_elf(), main->st_value}.to_virt_addr());
+    site.enable();
+    proc.resume();
+    proc.wait_on_signal();
+    proc.breakpoint_sites().remove_by_id(site.id());
+
+    while (!disassembler(proc).decode_extents(proc.get_pc(), 1).front().is_call)
+    {
+      proc.step_instruction();
+    }
+    return proc.get_pc() + std::int64_t{5};
+  };
+
+  auto  fast      = target::launch("targets/recursion");
+  auto& fast_proc = fast->get_process();
+  auto  after     = run_to_call(*fast);
+
+  REQUIRE(fast_proc.step_instructions(10).steps == 10);
+  auto result = fast_proc.step_instructions(1'000'000, after);
+  REQUIRE(result.reason.trap_reason == trap_type::single_step);
+  REQUIRE(fast_proc.get_pc() == after);
+  REQUIRE(fast_proc.get_registers().read_by_id_as<std::uint32_t>(register_id::eax) == 55);
+  REQUIRE_THROWS_AS(fast_proc.step_instructions(0), error);
+
+  auto  slow      = target::launch("targets/recursion");
+  auto& slow_proc = slow->get_process();
+  run_to_call(*slow);
+
+  std::uint64_t steps = 0;
+  while (slow_proc.get_pc() != after)
+  {
+    slow_proc.step_instruction();
+    ++steps;
+  }
+  REQUIRE(steps == result.steps + 10);
+}
+
+TEST_CASE("Fast stepping honors breakpoint conditions and hit actions", "[step]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+  auto  fib    = file_addr{elf, elf.get_symbols_by_name("_Z3fibi").at(0)->st_value}.to_virt_addr();
+  auto  main   = file_addr{elf, elf.get_symbols_by_name("main").at(0)->st_value}.to_virt_addr();
+
+  auto& main_site = proc.create_breakpoint_site(main);
+  main_site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  proc.breakpoint_sites().remove_by_id(main_site.id());
+
+  // A site whose condition does not hold is passed until it does
+  auto& site = proc.create_breakpoint_site(fib);
+  site.set_condition(expression::compile("edi == 1"));
+  site.enable();
+  auto result = proc.step_instructions(1'000'000);
+  REQUIRE(result.reason.trap_reason == trap_type::single_step);
+  REQUIRE(proc.get_pc() == fib);
+  REQUIRE(proc.get_registers().read_by_id_as<std::uint32_t>(register_id::edi) == 1);
+  REQUIRE(site.hit_count() == 1);
+
+  // An auto-continuing site runs its actions and is stepped over without ending the run
+  int calls = 0;
+  site.set_condition(std::nullopt);
+  site.set_auto_continue(true);
+  site.add_hit_action([&](auto&) { ++calls; });
+  result = proc.step_instructions(1'000'000);
+  REQUIRE(result.reason.reason == process_state::exited);
+  REQUIRE(calls > 1);
+  REQUIRE(site.hit_count() == static_cast<std::uint64_t>(calls) + 1);
+}
+
+TEST_CASE("Single-step throughput", "[.benchmark][step]")
+{
+  auto proc = process::launch("targets/run_endlessly");
+
+  BENCHMARK("step_instruction x1000")
+  {
+    for (int i = 0; i < 1000; ++i)
+    {
+      proc->step_instruction();
+    }
+  };
+  BENCHMARK("step_instructions(1000)")
+  {
+    return proc->step_instructions(1000).steps;
+  };
+}
+
+TEST_CASE("Instruction traces record registers and memory writes", "[trace]")
+{
+  struct recording
+  {
+    std::uint64_t steps;
+    std::uint64_t rsp;
+  };
+  auto record_fib = [](const std::filesystem::path& path, trace_options options)
+  {
+    auto  target = target::launch("targets/recursion");
+    auto& proc   = target->get_process();
+    auto& elf    = target->get_elf();
+
+    auto  fib  = elf.get_symbols_by_name("_Z3fibi").at(0);
+    auto& site = proc.create_breakpoint_site(file_addr{elf, fib->st_value}.to_virt_addr());
+    site.enable();
+    proc.resume();
+    proc.wait_on_signal();
+    proc.breakpoint_sites().remove_by_id(site.id());
+
+    auto rsp    = proc.get_registers().read_by_id_as<std::uint64_t>(register_id::rsp);
+    auto caller = from_bytes<std::uint64_t>(proc.read_memory(virt_addr{rsp}, 8).data());
+
+    trace_recorder recorder(proc, path, options);
+    auto           result = recorder.record(1'000'000, virt_addr{caller});
+    REQUIRE(recorder.instructions() == result.steps);
+    return recording{result.steps, rsp};
+  };
+
+  auto path    = std::filesystem::temp_directory_path() / "mdb_instruction_trace_test";
+  auto options = trace_options{};
+  options.index_interval = 64;
+  auto full              = record_fib(path, options);
+
+  std::vector<trace_entry> entries;
+  {
+    trace_reader reader(path);
+    REQUIRE(reader.first_instruction() == 0);
+    REQUIRE(reader.end_instruction() == full.steps);
+    while (auto entry = reader.next())
+    {
+      REQUIRE(entry->instruction == entries.size());
+      entries.push_back(std::move(*entry));
+    }
+  }
+  REQUIRE(entries.size() == full.steps);
+  REQUIRE(entries[0].registers[7] == full.rsp);
+
+  // push rbp saves the caller's frame, then the argument is spilled below it
+  auto first_write = [&](std::size_t size)
+  {
+    for (auto& entry : entries)
+      for (auto& write : entry.writes)
+        if (write.data.size() == size)
+          return write;
+    FAIL("No write of the requested size");
+    return traced_write{};
+  };
+  auto push = first_write(8);
+  REQUIRE(push.address.addr() == full.rsp - 8);
+  REQUIRE(from_bytes<std::uint64_t>(push.data.data()) == entries[0].registers[6]);
+  REQUIRE(from_bytes<std::uint32_t>(first_write(4).data.data()) == 10);
+
+  // A small ring keeps only the tail, reachable from its surviving keyframes
+  options.ring_size      = 4096;
+  options.index_interval = 16;
+  auto tail              = record_fib(path, options);
+  REQUIRE(tail.steps == full.steps);
+
+  trace_reader reader(path);
+  REQUIRE(reader.first_instruction() > 0);
+  REQUIRE(reader.first_instruction() % 16 == 0);
+  REQUIRE(reader.end_instruction() == full.steps);
+  REQUIRE_THROWS_AS(reader.seek(0), error);
+
+  for (auto instruction :
+       {reader.first_instruction(), reader.first_instruction() + 5, full.steps - 1})
+  {
+    reader.seek(instruction);
+    auto entry = reader.next();
+    REQUIRE(entry);
+    auto& expected = entries[instruction];
+    REQUIRE(entry->instruction == instruction);
+    REQUIRE(entry->pc == expected.pc);
+    REQUIRE(entry->registers == expected.registers);
+    REQUIRE(entry->writes.size() == expected.writes.size());
+    for (std::size_t i = 0; i < entry->writes.size(); ++i)
+    {
+      REQUIRE(entry->writes[i].address == expected.writes[i].address);
+      REQUIRE(entry->writes[i].data == expected.writes[i].data);
+    }
+  }
+  REQUIRE(!reader.next());
+
+  // A run of continuation bytes longer than any 64-bit value is reported, not shifted in. The
+  // 192-byte header and the 258 index entries come before the ring.
+  {
+    std::fstream      file(path, std::ios::in | std::ios::out | std::ios::binary);
+    std::vector<char> garbage(4096, '\xff');
+    file.seekp(192 + 258 * 16);
+    file.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+  }
+  trace_reader corrupt(path);
+  auto         read_first = [&]
+  {
+    corrupt.seek(corrupt.first_instruction());
+    return corrupt.next();
+  };
+  REQUIRE_THROWS_AS(read_first(), error);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Reverse execution restores registers and memory", "[reverse]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto  main       = elf.get_symbols_by_name("main").at(0);
+  auto  main_entry = file_addr{elf, main->st_value}.to_virt_addr();
+  auto& main_site  = proc.create_breakpoint_site(main_entry);
+  main_site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  proc.breakpoint_sites().remove_by_id(main_site.id());
+
+  struct state
+  {
+    virt_addr              pc;
+    std::uint64_t          rsp;
+    std::uint64_t          rdi;
+    std::uint64_t          rbp;
+    std::vector<std::byte> stack;
+
+    bool operator==(const state& other) const
+    {
+      return pc == other.pc and rsp == other.rsp and rdi == other.rdi and rbp == other.rbp and
+             stack == other.stack;
+    }
+  };
+  auto capture = [&]
+  {
+    auto& regs = proc.get_registers();
+    auto  rsp  = regs.read_by_id_as<std::uint64_t>(register_id::rsp);
+    return state{proc.get_pc(),
+                 rsp,
+                 regs.read_by_id_as<std::uint64_t>(register_id::rdi),
+                 regs.read_by_id_as<std::uint64_t>(register_id::rbp),
+                 proc.read_memory(virt_addr{rsp - 256}, 512)};
+  };
+
+  execution_log log(proc, 16);
+  auto          fib  = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto&         site = proc.create_breakpoint_site(file_addr{elf, fib->st_value}.to_virt_addr());
+  site.enable();
+
+  std::vector<state> hits;
+  for (int i = 0; i < 5; ++i)
+  {
+    REQUIRE(log.resume().trap_reason == trap_type::software_break);
+    hits.push_back(capture());
+  }
+  REQUIRE(hits[0].rdi == 10);
+  REQUIRE(hits[1].rdi == 9);
+
+  REQUIRE(log.reverse_continue().trap_reason == trap_type::software_break);
+  REQUIRE(capture() == hits[3]);
+  REQUIRE(log.reverse_continue().trap_reason == trap_type::software_break);
+  REQUIRE(capture() == hits[2]);
+
+  std::vector<state> steps{capture()};
+  for (int i = 0; i < 20; ++i)
+  {
+    log.step();
+    steps.push_back(capture());
+  }
+  for (int i = 19; i >= 0; --i)
+  {
+    log.reverse_step();
+    REQUIRE(capture() == steps[i]);
+  }
+
+  // A write watchpoint stops reverse execution at the instruction that wrote to it
+  auto  argument = virt_addr{hits[0].rsp - 8 - 0x14};
+  auto& point    = proc.create_watchpoint(argument, stoppoint_mode::write, 4);
+  point.enable();
+  site.disable();
+  log.reverse_continue();
+  REQUIRE(log.last_watchpoint() == point.id());
+  REQUIRE(elf.get_symbol_containing_address(proc.get_pc()).value() == fib);
+  REQUIRE(proc.read_memory_as<std::uint32_t>(argument) != 10);
+  log.step();
+  REQUIRE(proc.read_memory_as<std::uint32_t>(argument) == 10);
+  proc.watchpoints().remove_by_id(point.id());
+
+  // Without other stops reverse execution runs back to where recording began
+  log.reverse_continue();
+  REQUIRE(proc.get_pc() == main_entry);
+  REQUIRE(log.size() == 0);
+  REQUIRE_THROWS_AS(log.reverse_step(), error);
+
+  site.enable();
+  REQUIRE(log.resume().trap_reason == trap_type::software_break);
+  REQUIRE(capture() == hits[0]);
+}
+
+TEST_CASE("Recording runs internal sites and passes over them", "[reverse]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto  main      = elf.get_symbols_by_name("main").at(0);
+  auto& main_site = proc.create_breakpoint_site(file_addr{elf, main->st_value}.to_virt_addr());
+  main_site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  proc.breakpoint_sites().remove_by_id(main_site.id());
+
+  auto fib   = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto entry = file_addr{elf, fib->st_value}.to_virt_addr();
+  auto path  = std::filesystem::temp_directory_path() / "mdb_recorded_call_trace_test";
+  {
+    call_tracer tracer(proc, path);
+    tracer.trace_function(entry, "fib");
+
+    auto  body = disassembler(proc).disassemble(2, entry).at(1).address;
+    auto& site = proc.create_breakpoint_site(body);
+    site.set_condition(expression::compile("edi == 0"));
+    site.enable();
+
+    execution_log log(proc);
+    REQUIRE(log.resume().trap_reason == trap_type::software_break);
+    REQUIRE(proc.get_pc() == body);
+    REQUIRE(site.hit_count() == 1);
+    REQUIRE(tracer.event_count() > 1);
+    tracer.finish();
+  }
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Reverse execution restores FPRs and refuses to cross system calls", "[reverse]")
+{
+  auto  target = target::launch("targets/floating_point");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto entry_of = [&](std::string_view name)
+  { return file_addr{elf, elf.get_symbols_by_name(name).at(0)->st_value}.to_virt_addr(); };
+  auto xmm0 = [&] { return proc.get_registers().read_by_id_as<byte128>(register_id::xmm0); };
+
+  auto& scale_site = proc.create_breakpoint_site(entry_of("_Z5scaledi"));
+  scale_site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  scale_site.disable();
+  REQUIRE(xmm0() == to_byte128(2.0));
+
+  execution_log log(proc);
+  auto& getpid_site = proc.create_breakpoint_site(entry_of("_Z10raw_getpidv"));
+  getpid_site.enable();
+  REQUIRE(log.resume().trap_reason == trap_type::software_break);
+  REQUIRE(xmm0() == to_byte128(10.125));
+
+  log.reverse_continue();
+  REQUIRE(proc.get_pc() == entry_of("_Z5scaledi"));
+  REQUIRE(xmm0() == to_byte128(2.0));
+
+  // What the kernel wrote is unknown, so history from before the syscall is out of reach
+  REQUIRE(log.resume().trap_reason == trap_type::software_break);
+  for (int i = 0; i < 8; ++i)
+  {
+    log.step();
+  }
+  log.reverse_step();
+  auto pc = proc.get_pc();
+  REQUIRE_THROWS_AS(log.reverse_continue(), error);
+  REQUIRE(proc.get_pc() == pc);
+}
+
+TEST_CASE("Checkpoints restore a forked copy of the process", "[checkpoint]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto fib   = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto entry = file_addr{elf, fib->st_value}.to_virt_addr();
+  auto edi   = [&] { return proc.get_registers().read_by_id_as<std::uint32_t>(register_id::edi); };
+
+  auto& entry_site = proc.create_breakpoint_site(entry);
+  entry_site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(edi() == 10);
+
+  auto original = proc.pid();
+  auto id       = proc.create_checkpoint();
+  REQUIRE(proc.checkpoints().size() == 1);
+  REQUIRE(proc.get_pc() == entry);
+
+  // The copy was taken with a trap at the entry; restoring must move it to the new site
+  proc.breakpoint_sites().remove_by_id(entry_site.id());
+  auto  second      = disassembler(proc).disassemble(2, entry)[1].address;
+  auto& second_site = proc.create_breakpoint_site(second);
+  second_site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(edi() == 9);
+
+  for (int round = 0; round < 2; ++round)
+  {
+    auto before = proc.pid();
+    proc.restore_checkpoint(id);
+    REQUIRE(proc.pid() != before);
+    REQUIRE(proc.pid() != original);
+    REQUIRE(proc.get_pc() == entry);
+    REQUIRE(edi() == 10);
+    REQUIRE(proc.read_memory(entry, 1)[0] != std::byte{0xcc});
+
+    proc.resume();
+    auto reason = proc.wait_on_signal();
+    REQUIRE(reason.trap_reason == trap_type::software_break);
+    REQUIRE(proc.get_pc() == second);
+    REQUIRE(edi() == 10);
+  }
+
+  // A copy holding patched code would keep writing to a ring no one reads
+  auto  main  = elf.get_symbols_by_name("main").at(0);
+  auto& point = target->create_tracepoint(file_addr{elf, main->st_value}.to_virt_addr());
+  REQUIRE_THROWS_AS(proc.create_checkpoint(), error);
+  REQUIRE_THROWS_AS(proc.restore_checkpoint(id), error);
+  proc.tracepoints().remove_by_id(point.id());
+
+  proc.breakpoint_sites().remove_by_id(second_site.id());
+  proc.resume();
+  auto reason = proc.wait_on_signal();
+  REQUIRE(reason.reason == process_state::exited);
+  REQUIRE(reason.info == 0);
+
+  proc.delete_checkpoint(id);
+  REQUIRE(proc.checkpoints().empty());
+  REQUIRE_THROWS_AS(proc.restore_checkpoint(id), error);
+}
+
+TEST_CASE("Hardware stoppoints share the debug registers", "[breakpoint]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto fib   = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto start = file_addr{elf, fib->st_value}.to_virt_addr();
+
+  std::vector<breakpoint_site*> sites;
+  for (auto& instr : disassembler(proc).disassemble(6, start))
+  {
+    sites.push_back(&proc.create_breakpoint_site(instr.address, true));
+  }
+  sites.back()->set_pinned(true);
+  for (auto site : sites)
+  {
+    site->enable();
+  }
+
+  auto in_registers = [&]
+  {
+    return std::count_if(
+        begin(sites), end(sites), [](auto site) { return site->uses_debug_register(); });
+  };
+  REQUIRE(in_registers() == 4);
+  REQUIRE(sites.back()->uses_debug_register());
+
+  int stops = 0;
+  proc.resume();
+  for (auto reason = proc.wait_on_signal(); reason.reason == process_state::stopped;
+       reason      = proc.wait_on_signal())
+  {
+    auto& site = proc.breakpoint_sites().get_by_address(proc.get_pc());
+    if (reason.trap_reason == trap_type::hardware_break)
+    {
+      REQUIRE(site.uses_debug_register());
+      REQUIRE(std::get<0>(proc.get_current_hardware_stoppoint()) == site.id());
+    }
+    else
+    {
+      REQUIRE(reason.trap_reason == trap_type::software_break);
+    }
+    ++stops;
+    proc.resume();
+  }
+
+  REQUIRE(stops == 6 * 177);
+  REQUIRE(
+      std::all_of(begin(sites), end(sites), [](auto site) { return site->hit_count() == 177; }));
+  REQUIRE(sites.back()->uses_debug_register());
+  REQUIRE(in_registers() == 4);
+}
+
 TEST_CASE("Watchpoint detects read", "[watchpoint]")
 {
   bool      close_on_exec = false;
@@ -537,4 +1127,909 @@ TEST_CASE("ELF parser works", "[elf]")
   sym  = elf.get_symbol_at_address(virt_addr{0xcafecafe + entry});
   name = elf.get_string(sym.value()->st_name);
   REQUIRE(name == "_start");
-}
\ No newline at end of file
+}
+
+TEST_CASE("Section header tables outside the file are rejected", "[elf]")
+{
+  std::ifstream     in("targets/hello_mdb", std::ios::binary);
+  std::vector<char> image{std::istreambuf_iterator<char>(in), {}};
+  auto              path = std::filesystem::temp_directory_path() / "mdb_malformed_elf_test";
+
+  auto open_files = []
+  { return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), {}); };
+  auto before = open_files();
+
+  // A count of zero sends the parser to the first header for the real count
+  for (auto [offset, count] : {std::pair<std::uint64_t, std::uint16_t>{image.size() - 8, 0},
+                               {image.size() + 0x1000, 0},
+                               {~std::uint64_t{0} - 0x100, 4}})
+  {
+    Elf64_Ehdr header;
+    std::memcpy(&header, image.data(), sizeof(header));
+    header.e_shoff = offset;
+    header.e_shnum = count;
+    auto copy      = image;
+    std::memcpy(copy.data(), &header, sizeof(header));
+    std::ofstream(path, std::ios::binary).write(copy.data(), copy.size());
+
+    REQUIRE_THROWS_AS(mdb::elf(path), error);
+  }
+  REQUIRE(open_files() == before);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Addresses translate through allocated sections only", "[elf]")
+{
+  mdb::elf elf("targets/hello_mdb");
+  elf.notify_loaded(virt_addr{0x555555554000});
+  auto text = elf.get_section(".text").value();
+
+  auto first = file_addr{elf, text->sh_addr};
+  auto last  = first + static_cast<std::int64_t>(text->sh_size - 1);
+  REQUIRE(elf.get_section_containing_address(first) == text);
+  REQUIRE(elf.get_section_containing_address(last) == text);
+  REQUIRE(elf.get_section_containing_address(last.to_virt_addr()) == text);
+  REQUIRE(last.to_virt_addr().to_file_addr(elf) == last);
+  REQUIRE(elf.get_section_containing_address(last + 1) != text);
+
+  // Non-allocated sections such as .comment sit at address zero but are not in memory
+  REQUIRE(elf.get_section_containing_address(file_addr{elf, 0x10}) == nullptr);
+  REQUIRE(elf.get_section_containing_address(virt_addr{0x10}) == nullptr);
+}
+
+TEST_CASE("Symbols can be looked up by demangled name", "[elf]")
+{
+  mdb::elf elf("targets/recursion");
+  auto     fib = elf.get_symbols_by_name("_Z3fibi");
+  REQUIRE(fib.size() == 1);
+  REQUIRE(elf.get_symbols_by_name("fib(int)") == fib);
+  REQUIRE(elf.get_demangled_name(*fib.at(0)) == "fib(int)");
+  REQUIRE(elf.get_demangled_name(*elf.get_symbols_by_name("main").at(0)) == "main");
+  REQUIRE(elf.get_symbols_by_name("fib(long)").empty());
+}
+
+TEST_CASE("Stripped libraries look names up through their own hash tables", "[elf]")
+{
+  for (auto path : {"targets/libexported_gnu.so", "targets/libexported_sysv.so"})
+  {
+    mdb::elf elf(path);
+    REQUIRE(!elf.get_section(".symtab"));
+
+    auto add = elf.get_symbols_by_name("exported_add");
+    REQUIRE(add.size() == 1);
+    REQUIRE(elf.get_string(add[0]->st_name) == "exported_add");
+    REQUIRE(ELF64_ST_TYPE(add[0]->st_info) == STT_FUNC);
+    REQUIRE(elf.get_symbol_containing_address(file_addr{elf, add[0]->st_value + 1}) == add[0]);
+
+    REQUIRE(elf.get_symbols_by_name("exported_counter").size() == 1);
+    REQUIRE(elf.get_symbols_by_name("exported::scale(int)").size() == 1);
+    REQUIRE(elf.get_symbols_by_name("exported_missing").empty());
+
+    auto puts = elf.get_symbols_by_name("puts");
+    REQUIRE(puts.size() == 1);
+    REQUIRE(puts[0]->st_shndx == SHN_UNDEF);
+
+    for (auto name : elf.find_symbol_names_with_prefix("", 1000))
+    {
+      REQUIRE(!elf.get_symbols_by_name(name).empty());
+    }
+  }
+}
+
+TEST_CASE("Shared libraries are tracked as the loader maps and unmaps them", "[target]")
+{
+  auto  target = target::launch("targets/loads_library");
+  auto& proc   = target->get_process();
+  auto& elves  = target->get_elves();
+
+  auto loaded = [&](std::string_view name)
+  {
+    bool found = false;
+    elves.for_each([&](const elf& obj) { found |= obj.path().filename() == name; });
+    return found;
+  };
+  auto break_at = [&](const elf& obj, std::string_view name)
+  {
+    auto  symbol = obj.get_symbols_by_name(name).at(0);
+    auto& site   = proc.create_breakpoint_site(file_addr{obj, symbol->st_value}.to_virt_addr());
+    site.enable();
+    return site.id();
+  };
+
+  auto main = break_at(target->get_elf(), "main");
+  proc.resume();
+  proc.wait_on_signal();
+  proc.breakpoint_sites().remove_by_id(main);
+  REQUIRE(loaded("libexported_gnu.so"));
+  REQUIRE(!loaded("libexported_sysv.so"));
+
+  const elf* library = nullptr;
+  elves.for_each(
+      [&](const elf& obj)
+      {
+        if (obj.path().filename() == "libexported_gnu.so")
+          library = &obj;
+      });
+  auto add = library->get_symbols_by_name("exported_add").at(0);
+  break_at(*library, "exported_add");
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(elves.get_elf_containing_address(proc.get_pc()) == library);
+  REQUIRE(library->get_symbol_containing_address(proc.get_pc()).value() == add);
+
+  // The second call to exported_add resolves to the copy in the dlopen'd library
+  break_at(target->get_elf(), "after_unload");
+  proc.breakpoint_sites().remove_by_address(proc.get_pc());
+  auto dlclose_entry = virt_addr{};
+  elves.for_each(
+      [&](const elf& obj)
+      {
+        for (auto symbol : obj.get_symbols_by_name("dlclose"))
+        {
+          if (symbol->st_value != 0)
+            dlclose_entry = file_addr{obj, symbol->st_value}.to_virt_addr();
+        }
+      });
+  REQUIRE(dlclose_entry != virt_addr{});
+  proc.create_breakpoint_site(dlclose_entry).enable();
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(proc.get_pc() == dlclose_entry);
+  REQUIRE(loaded("libexported_sysv.so"));
+
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(target->get_elf().get_symbol_containing_address(proc.get_pc()).value() ==
+          target->get_elf().get_symbols_by_name("after_unload").at(0));
+  REQUIRE(!loaded("libexported_sysv.so"));
+  REQUIRE(loaded("libexported_gnu.so"));
+}
+
+TEST_CASE("User breakpoints share sites with the debugger's own", "[target]")
+{
+  auto  target = target::launch("targets/loads_library");
+  auto& proc   = target->get_process();
+  auto& sites  = proc.breakpoint_sites();
+
+  auto loaded = [&](std::string_view name)
+  {
+    bool found = false;
+    target->get_elves().for_each([&](const elf& obj) { found |= obj.path().filename() == name; });
+    return found;
+  };
+
+  // The loader's hook at the entry point still runs under the user's breakpoint
+  auto  entry = virt_addr{proc.get_auxv()[AT_ENTRY]};
+  auto& site  = proc.create_breakpoint_site(entry);
+  auto  id    = site.id();
+  REQUIRE(!site.is_internal());
+  site.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(proc.get_pc() == entry);
+  REQUIRE(loaded("libexported_gnu.so"));
+  sites.remove_by_id(id);
+  REQUIRE(!sites.contains_address(entry));
+
+  auto brk = virt_addr{};
+  sites.for_each(
+      [&](auto& internal)
+      {
+        if (internal.is_internal())
+          brk = internal.address();
+      });
+  REQUIRE(brk != virt_addr{});
+  auto& shared = proc.create_breakpoint_site(brk);
+  REQUIRE(!shared.is_internal());
+  REQUIRE_THROWS_AS(proc.create_breakpoint_site(brk), error);
+  shared.enable();
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(proc.get_pc() == brk);
+
+  // Removing the user's breakpoint leaves the debugger's hook in place
+  sites.remove_by_id(shared.id());
+  REQUIRE(sites.get_by_address(brk).is_internal());
+  REQUIRE(sites.get_by_address(brk).is_armed());
+  proc.resume();
+  REQUIRE(proc.wait_on_signal().reason == process_state::exited);
+}
+
+TEST_CASE("Pending breakpoints resolve when a library defining them loads", "[target]")
+{
+  auto  target = target::launch("targets/loads_library");
+  auto& proc   = target->get_process();
+
+  REQUIRE(target->create_function_breakpoint("exported_add").empty());
+  REQUIRE(target->create_function_breakpoint("plugin_initial_value").empty());
+  REQUIRE(target->pending_breakpoints().size() == 2);
+
+  auto function_at_pc = [&]
+  {
+    auto obj    = target->get_elves().get_elf_containing_address(proc.get_pc());
+    auto symbol = obj->get_symbol_containing_address(proc.get_pc()).value();
+    return std::string(obj->get_string(symbol->st_name));
+  };
+
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(function_at_pc() == "exported_add");
+  REQUIRE(target->pending_breakpoints().size() == 1);
+
+  proc.resume();
+  proc.wait_on_signal();
+  REQUIRE(function_at_pc() == "plugin_initial_value");
+  REQUIRE(target->pending_breakpoints().empty());
+
+  // Stopped inside the library's initializers, before they have stored their result
+  auto plugin  = target->get_elves().get_elf_containing_address(proc.get_pc());
+  auto value   = plugin->get_symbols_by_name("plugin_value").at(0);
+  auto address = file_addr{*plugin, value->st_value}.to_virt_addr();
+  REQUIRE(proc.read_memory_as<std::int32_t>(address) == 0);
+
+  // A breakpoint already at the definition is shared rather than left out
+  auto  get        = plugin->get_symbols_by_name("plugin_get").at(0);
+  auto& by_address = proc.create_breakpoint_site(file_addr{*plugin, get->st_value}.to_virt_addr());
+  auto  sites      = target->create_function_breakpoint("plugin_get");
+  REQUIRE(sites.size() == 1);
+  REQUIRE(sites[0] == &by_address);
+  REQUIRE(sites[0]->is_enabled());
+  REQUIRE(target->pending_breakpoints().empty());
+
+  // Names that look like C++ go on to the demangled names
+  REQUIRE(target->create_function_breakpoint("exported::scale(int)").size() == 1);
+  REQUIRE(target->create_function_breakpoint("exported::scale").empty());
+  REQUIRE(target->pending_breakpoints().size() == 1);
+}
+
+TEST_CASE("Symbol indexes are cached on disk by build ID", "[elf]")
+{
+  auto directory = std::filesystem::temp_directory_path() / "mdb_index_cache_test";
+  std::filesystem::remove_all(directory);
+  setenv("MDB_CACHE_DIR", directory.c_str(), 1);
+
+  for (auto path : {"targets/recursion", "targets/libexported_gnu.so"})
+  {
+    elf built(path);
+    REQUIRE(built.build_id().size() == 20);
+    REQUIRE(!built.index_loaded_from_cache());
+    // Names are only indexed, and the cache written, once something searches them
+    auto cache_path = directory / (built.build_id_string() + ".index");
+    REQUIRE(!std::filesystem::exists(cache_path));
+    auto demangled = built.find_symbol_names_containing("(", 1000);
+    REQUIRE(std::filesystem::exists(cache_path));
+
+    elf cached(path);
+    REQUIRE(cached.index_loaded_from_cache());
+    REQUIRE(cached.find_symbol_names_containing("(", 1000) == demangled);
+    for (auto name : built.find_symbol_names_with_prefix("", 10000))
+    {
+      auto from_built  = built.get_symbols_by_name(name);
+      auto from_cached = cached.get_symbols_by_name(name);
+      REQUIRE(from_built.size() == from_cached.size());
+      for (std::size_t i = 0; i < from_built.size(); ++i)
+      {
+        auto offset = from_built[i]->st_value;
+        REQUIRE(from_built[i]->st_name == from_cached[i]->st_name);
+        auto symbol = cached.get_symbol_containing_address(file_addr{cached, offset});
+        REQUIRE(symbol.has_value() ==
+                built.get_symbol_containing_address(file_addr{built, offset}).has_value());
+      }
+    }
+  }
+
+  // A damaged cache is rebuilt rather than trusted
+  for (auto& entry : std::filesystem::directory_iterator(directory))
+  {
+    std::filesystem::resize_file(entry.path(), 64);
+  }
+  elf rebuilt("targets/recursion");
+  REQUIRE(!rebuilt.index_loaded_from_cache());
+  REQUIRE(rebuilt.get_symbols_by_name("fib(int)").size() == 1);
+  REQUIRE(elf("targets/recursion").index_loaded_from_cache());
+
+  // So is one whose arrays point past the symbol table or the demangled names. The header's
+  // array table starts at byte 40; entries 2, 6 and 7 are the symbol indices and the
+  // demangled symbols and offsets.
+  auto cache_path = directory / (rebuilt.build_id_string() + ".index");
+  for (std::size_t array : {2, 6, 7})
+  {
+    {
+      std::fstream  file(cache_path, std::ios::in | std::ios::out | std::ios::binary);
+      std::uint64_t location[2];
+      file.seekg(static_cast<std::streamoff>(40 + 16 * array));
+      file.read(reinterpret_cast<char*>(location), sizeof(location));
+      REQUIRE(location[1] != 0);
+      std::vector<char> garbage(location[1], '\xff');
+      file.seekp(static_cast<std::streamoff>(location[0]));
+      file.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+    }
+    elf damaged("targets/recursion");
+    REQUIRE(!damaged.index_loaded_from_cache());
+    REQUIRE(damaged.get_symbols_by_name("fib(int)").size() == 1);
+  }
+  REQUIRE(elf("targets/recursion").index_loaded_from_cache());
+
+  setenv("MDB_CACHE_DIR", "", 1);
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Stripped DWARF is read from the separate debug file", "[dwarf]")
+{
+  namespace fs   = std::filesystem;
+  auto directory = fs::temp_directory_path() / "mdb_debug_file_test";
+  fs::remove_all(directory);
+  fs::create_directories(directory / "elsewhere");
+  fs::create_directories(directory / "corrupt");
+  setenv("MDB_DEBUG_FILE_DIRECTORY", (directory / "debug").c_str(), 1);
+
+  auto defines_fib = [](const elf& obj)
+  {
+    dwarf info(obj);
+    REQUIRE(!info.compile_units().empty());
+    for (auto& child : info.compile_units().front()->root().children())
+    {
+      if (child.contains(DW_AT_name) and child[DW_AT_name].as_string() == "fib")
+        return true;
+    }
+    return false;
+  };
+
+  // Found through .gnu_debuglink, next to the binary, only once DWARF is asked for
+  elf linked("targets/split_debug");
+  REQUIRE(!linked.get_section(".debug_info"));
+  REQUIRE(linked.debug_file_path().empty());
+  REQUIRE(defines_fib(linked));
+  REQUIRE(linked.debug_file_path() == fs::canonical("targets/split_debug.debug"));
+
+  // Found through the build ID under a debug directory
+  auto hex      = linked.build_id_string();
+  auto build_id = directory / "debug" / ".build-id" / hex.substr(0, 2);
+  fs::create_directories(build_id);
+  fs::copy_file("targets/split_debug.debug", build_id / (hex.substr(2) + ".debug"));
+  fs::copy_file("targets/split_debug", directory / "elsewhere" / "split_debug");
+  elf moved(directory / "elsewhere" / "split_debug");
+  REQUIRE(defines_fib(moved));
+  REQUIRE(moved.debug_file_path() == build_id / (hex.substr(2) + ".debug"));
+
+  // A debug link target whose CRC does not match is not used
+  fs::remove_all(directory / "debug");
+  fs::copy_file("targets/split_debug", directory / "corrupt" / "split_debug");
+  fs::copy_file("targets/split_debug.debug", directory / "corrupt" / "split_debug.debug");
+  {
+    std::fstream file(directory / "corrupt" / "split_debug.debug",
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(0, std::ios::end);
+    file.seekp(-1, std::ios::cur);
+    file.put('\x5a');
+  }
+  elf corrupt(directory / "corrupt" / "split_debug");
+  REQUIRE(corrupt.get_debug_section_contents(".debug_info").size() == 0);
+  REQUIRE(corrupt.debug_file_path().empty());
+
+  unsetenv("MDB_DEBUG_FILE_DIRECTORY");
+  fs::remove_all(directory);
+}
+
+TEST_CASE("Symbol names can be searched by prefix and substring", "[elf]")
+{
+  mdb::elf elf("targets/recursion");
+
+  auto fib = elf.find_symbol_names_with_prefix("fi", 10);
+  REQUIRE(std::find(fib.begin(), fib.end(), "fib(int)") != fib.end());
+  REQUIRE(std::is_sorted(fib.begin(), fib.end()));
+  auto mangled = elf.find_symbol_names_with_prefix("_Z3fib", 10);
+  REQUIRE(mangled == std::vector<std::string_view>{"_Z3fibi"});
+  REQUIRE(elf.find_symbol_names_with_prefix("no_such_symbol", 10).empty());
+
+  auto containing = elf.find_symbol_names_containing("ib", 100);
+  REQUIRE(std::find(containing.begin(), containing.end(), "_Z3fibi") != containing.end());
+  REQUIRE(std::find(containing.begin(), containing.end(), "fib(int)") != containing.end());
+  REQUIRE(std::is_sorted(containing.begin(), containing.end()));
+  REQUIRE(std::adjacent_find(containing.begin(), containing.end()) == containing.end());
+
+  REQUIRE(elf.find_symbol_names_containing("", 3).size() == 3);
+  auto demangled = elf.find_symbol_names_containing("fib(", 10);
+  REQUIRE(demangled == std::vector<std::string_view>{"fib(int)"});
+}
+
+TEST_CASE("Batch symbolization matches single lookups", "[elf]")
+{
+  mdb::elf elf("targets/recursion");
+  elf.notify_loaded(virt_addr{0x555555554000});
+  auto text  = elf.get_section(".text").value();
+  auto start = virt_addr{0x555555554000 + text->sh_addr};
+
+  std::vector<virt_addr> addresses;
+  for (std::uint64_t offset = 0; offset < text->sh_size; ++offset)
+  {
+    addresses.push_back(start + static_cast<std::int64_t>(offset));
+  }
+  auto reversed = addresses;
+  std::reverse(reversed.begin(), reversed.end());
+
+  for (auto& batch : {addresses, reversed})
+  {
+    auto symbols = elf.symbolize(batch);
+    REQUIRE(symbols.size() == batch.size());
+    for (std::size_t i = 0; i < batch.size(); ++i)
+    {
+      REQUIRE(symbols[i] == elf.get_symbol_containing_address(batch[i]));
+    }
+  }
+
+  auto fib = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto pc  = virt_addr{0x555555554000 + fib->st_value + 1};
+  REQUIRE(elf.symbolize(std::vector{pc}).at(0) == fib);
+  REQUIRE(elf.get_symbol_at_address(pc - std::int64_t{1}) == fib);
+  REQUIRE(!elf.get_symbol_at_address(pc));
+}
+
+TEST_CASE("Call tracer records entries and exits", "[tracer]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto fib  = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto path = std::filesystem::temp_directory_path() / "mdb_call_trace_test";
+  {
+    call_tracer tracer(proc, path, 1);
+    tracer.trace_function(file_addr{elf, fib->st_value}.to_virt_addr(), "fib");
+
+    proc.resume();
+    auto reason = proc.wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+  }
+
+  call_trace trace(path);
+  REQUIRE(trace.function_names().at(0) == "fib");
+  REQUIRE(trace.header().n_args == 1);
+
+  auto events = trace.events();
+  REQUIRE(events.size() == 2 * 177);
+  REQUIRE(events[0].kind == call_event_kind::entry);
+  REQUIRE(events[0].args[0] == 10);
+
+  auto& last = events[events.size() - 1];
+  REQUIRE(last.kind == call_event_kind::exit);
+  REQUIRE(last.args[0] == 55);
+
+  // A function table said to start past the end of the file is rejected
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    auto         offset = std::uint64_t{1} << 40;
+    file.seekp(offsetof(call_trace_header, function_table_offset));
+    file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+  }
+  REQUIRE_THROWS_AS(call_trace(path), error);
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Logpoints log and continue", "[breakpoint]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  bool      close_on_exec = false;
+  mdb::pipe channel(close_on_exec);
+  proc.get_log_sink().set_output(channel.get_write());
+
+  auto fib = elf.get_symbols_by_name("_Z3fibi").at(0);
+  proc.create_logpoint(file_addr{elf, fib->st_value}.to_virt_addr(),
+                       logpoint::compile("fib({}) from {:#x}", {"edi", "*rsp"}))
+      .enable();
+
+  proc.resume();
+  auto reason = proc.wait_on_signal();
+  REQUIRE(reason.reason == process_state::exited);
+
+  channel.close_write();
+  std::string output;
+  for (auto data = channel.read(); !data.empty(); data = channel.read())
+  {
+    output += to_string_view(data);
+  }
+
+  REQUIRE(std::count(begin(output), end(output), '\n') == 177);
+  REQUIRE(output.rfind("fib(10) from 0x", 0) == 0);
+
+  REQUIRE_THROWS_AS(logpoint::compile("{} {}", {"rax"}), error);
+  REQUIRE_THROWS_AS(logpoint::compile("{}", {"not_a_register"}), error);
+}
+
+TEST_CASE("Conditional breakpoints only stop when the condition holds", "[breakpoint]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  REQUIRE(expression::compile("(1 + 2 * 3) << 1 == 14 && !0").evaluate(proc) == 1);
+  REQUIRE(expression::compile("~0 >> 60 | 0x10").evaluate(proc) == 0x1f);
+  REQUIRE(expression::compile("-1 > 1 && 7 % 4 == 3").evaluate(proc) == 1);
+  REQUIRE_THROWS_AS(expression::compile("1 / (2 - 2)").evaluate(proc), error);
+  REQUIRE_THROWS_AS(expression::compile("1 +"), error);
+
+  auto  fib  = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto& site = proc.create_breakpoint_site(file_addr{elf, fib->st_value}.to_virt_addr());
+  site.set_condition(expression::compile("edi == 3"));
+  site.enable();
+
+  int hits = 0;
+  proc.resume();
+  for (auto reason = proc.wait_on_signal(); reason.reason == process_state::stopped;
+       reason      = proc.wait_on_signal())
+  {
+    REQUIRE(proc.get_registers().read_by_id_as<std::uint32_t>(register_id::edi) == 3);
+    ++hits;
+    proc.resume();
+  }
+  REQUIRE(hits == 21);
+}
+
+TEST_CASE("Logical operators guard loads that would fault", "[breakpoint]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  REQUIRE(expression::compile("0 && u64[0] == 5").evaluate(proc) == 0);
+  REQUIRE(expression::compile("2 || u64[0] == 5").evaluate(proc) == 1);
+  REQUIRE(expression::compile("0 || 3 && 4").evaluate(proc) == 1);
+  REQUIRE_THROWS_AS(expression::compile("1 && u64[0] == 5").evaluate(proc), error);
+
+  // Conditions that fail to evaluate stop, so an unguarded load here would
+  // stop on every call
+  auto  fib  = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto& site = proc.create_breakpoint_site(file_addr{elf, fib->st_value}.to_virt_addr());
+  site.set_condition(expression::compile("edi > 100 && u64[edi - 101] == 5"));
+  site.enable();
+
+  proc.resume();
+  REQUIRE(proc.wait_on_signal().reason == process_state::exited);
+  REQUIRE(site.hit_count() == 0);
+}
+
+TEST_CASE("Breakpoint hit counts, ignore counts and hit limits", "[breakpoint]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto  fib  = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto& site = proc.create_breakpoint_site(file_addr{elf, fib->st_value}.to_virt_addr());
+  site.set_ignore_count(5);
+  site.disable_after(3);
+  site.enable();
+  REQUIRE_THROWS_AS(site.disable_after(0), error);
+
+  std::vector<std::uint32_t> stopped_at;
+  proc.resume();
+  for (auto reason = proc.wait_on_signal(); reason.reason == process_state::stopped;
+       reason      = proc.wait_on_signal())
+  {
+    stopped_at.push_back(proc.get_registers().read_by_id_as<std::uint32_t>(register_id::edi));
+    proc.resume();
+  }
+
+  REQUIRE(stopped_at == std::vector<std::uint32_t>{5, 4, 3});
+  REQUIRE(site.hit_count() == 8);
+  REQUIRE(site.ignore_count() == 0);
+  REQUIRE(!site.is_enabled());
+}
+
+TEST_CASE("Tracepoints record hits without stopping", "[tracepoint]")
+{
+  auto  target = target::launch("targets/recursion");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto fib     = elf.get_symbols_by_name("_Z3fibi").at(0);
+  auto address = file_addr{elf, fib->st_value}.to_virt_addr();
+  auto code    = proc.read_memory(address, 8);
+
+  auto& point = target->create_tracepoint(address);
+  point.enable();
+  REQUIRE(point.patch_size() >= 5);
+  REQUIRE(proc.read_memory(address, 1)[0] == std::byte{0xe9});
+  REQUIRE(proc.read_memory_without_traps(address, 8) == code);
+  REQUIRE_THROWS_AS(proc.create_breakpoint_site(address), error);
+
+  proc.resume();
+  auto reason = proc.wait_on_signal();
+  REQUIRE(reason.reason == process_state::exited);
+  REQUIRE(reason.info == 0);
+
+  std::vector<std::uint64_t> arguments;
+  auto& buffer = proc.get_tracepoint_buffer();
+  auto  count  = buffer.drain(
+      [&](auto& record)
+      {
+        REQUIRE(record.tracepoint_id == static_cast<std::uint64_t>(point.id()));
+        arguments.push_back(record.read(register_id::rdi));
+      });
+
+  REQUIRE(count == 177);
+  REQUIRE(buffer.dropped() == 0);
+  REQUIRE(arguments[0] == 10);
+  REQUIRE(arguments[1] == 9);
+  REQUIRE(buffer.drain([](auto&) {}) == 0);
+}
+
+TEST_CASE("Tracepoints hit from several threads at once keep every record", "[tracepoint]")
+{
+  auto  target = target::launch("targets/threads");
+  auto& proc   = target->get_process();
+  auto& elf    = target->get_elf();
+
+  auto  count = elf.get_symbols_by_name("_Z5countii").at(0);
+  auto& point = target->create_tracepoint(file_addr{elf, count->st_value}.to_virt_addr());
+  point.enable();
+
+  proc.resume();
+  auto reason = proc.wait_on_signal();
+  REQUIRE(reason.reason == process_state::exited);
+  REQUIRE(reason.info == 0);
+
+  // A slot written by two threads, or claimed and never written, shows up as a missing or
+  // repeated pair
+  std::vector<std::vector<bool>> seen(4, std::vector<bool>(10000));
+  auto& buffer = proc.get_tracepoint_buffer();
+  auto  n      = buffer.drain(
+      [&](auto& record)
+      {
+        auto thread = record.read(register_id::rdi);
+        auto i      = record.read(register_id::rsi);
+        REQUIRE(thread < 4);
+        REQUIRE(i < 10000);
+        REQUIRE(!seen[thread][i]);
+        seen[thread][i] = true;
+      });
+  REQUIRE(n == 40000);
+  REQUIRE(buffer.dropped() == 0);
+}
+
+TEST_CASE("Injected syscalls run in the inferior and leave it untouched", "[syscall]")
+{
+  bool close_on_exec = false;
+  mdb::pipe channel(close_on_exec);
+  auto      proc = process::launch("targets/anti_debugger", true, channel.get_write());
+  channel.close_write();
+
+  proc->resume();
+  proc->wait_on_signal();
+
+  // Stop the inferior while it is blocked in sleep so that the call has to be restarted
+  proc->resume();
+  usleep(100'000);
+  kill(proc->pid(), SIGSTOP);
+  auto reason = proc->wait_on_signal();
+  REQUIRE(reason.info == SIGSTOP);
+
+  auto orig_rax = proc->get_registers().read_by_id_as<std::uint64_t>(register_id::orig_rax);
+  auto pc       = proc->get_pc();
+  REQUIRE(proc->inject_syscall(SYS_getpid) == proc->pid());
+  REQUIRE(proc->inject_syscall(SYS_close, -1) == -EBADF);
+  REQUIRE(proc->get_pc() == pc);
+  REQUIRE(proc->get_registers().read_by_id_as<std::uint64_t>(register_id::orig_rax) == orig_rax);
+
+  proc->resume();
+  reason = proc->wait_on_signal();
+  REQUIRE(reason.reason == process_state::stopped);
+  REQUIRE(reason.info == SIGTRAP);
+
+  proc->set_syscall_catch_policy(syscall_catch_policy::catch_all());
+  proc->resume();
+  reason = proc->wait_on_signal();
+  REQUIRE(reason.trap_reason == trap_type::syscall);
+  REQUIRE(reason.syscall_info->entry);
+  REQUIRE_THROWS_AS(proc->inject_syscall(SYS_getpid), error);
+}
+
+TEST_CASE("Syscall injection cost", "[.benchmark][syscall]")
+{
+  auto proc = process::launch("targets/run_endlessly");
+
+  BENCHMARK("inject getpid")
+  {
+    return proc->inject_syscall(SYS_getpid);
+  };
+}
+
+TEST_CASE("Software watchpoints go beyond the debug registers", "[watchpoint]")
+{
+  bool      close_on_exec = false;
+  mdb::pipe channel(close_on_exec);
+  auto      proc = process::launch("targets/watched_buffer", true, channel.get_write());
+  channel.close_write();
+
+  proc->resume();
+  proc->wait_on_signal();
+
+  auto buffer  = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+  auto element = [&](std::int64_t i) { return buffer + i * 4; };
+
+  auto& read_10    = proc->create_watchpoint(element(10), stoppoint_mode::read_write, 4, false);
+  auto& write_64   = proc->create_watchpoint(element(64), stoppoint_mode::write, 4, false);
+  auto& write_512  = proc->create_watchpoint(element(512), stoppoint_mode::write, 64, false);
+  auto& write_1500 = proc->create_watchpoint(element(1500), stoppoint_mode::write, 4, false);
+  auto& write_2000 = proc->create_watchpoint(element(2000), stoppoint_mode::write, 4, false);
+  for (auto point : {&read_10, &write_64, &write_512, &write_1500, &write_2000})
+  {
+    point->enable();
+  }
+  REQUIRE_THROWS_AS(proc->create_watchpoint(element(3), stoppoint_mode::execute, 1, false), error);
+
+  std::vector<watchpoint::id_type> hits;
+  proc->resume();
+  for (auto reason = proc->wait_on_signal(); reason.reason == process_state::stopped;
+       reason      = proc->wait_on_signal())
+  {
+    REQUIRE(reason.trap_reason == trap_type::software_watch);
+    hits.push_back(proc->get_current_software_watchpoint());
+    proc->resume();
+  }
+
+  REQUIRE(hits == std::vector{read_10.id(), write_64.id(), write_512.id(), write_1500.id()});
+  REQUIRE(write_1500.data() == 7);
+}
+
+TEST_CASE("Reads run on into pages protected for software watchpoints", "[watchpoint]")
+{
+  bool      close_on_exec = false;
+  mdb::pipe channel(close_on_exec);
+  auto      proc = process::launch("targets/watched_buffer", true, channel.get_write());
+  channel.close_write();
+
+  proc->resume();
+  proc->wait_on_signal();
+
+  // The buffer's second page, starting at element 1024, is the one protected
+  auto                   buffer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+  auto                   start  = buffer + std::int64_t{4096 - 100};
+  std::vector<std::byte> pattern(200);
+  for (std::size_t i = 0; i < pattern.size(); ++i)
+  {
+    pattern[i] = static_cast<std::byte>(i + 1);
+  }
+  proc->write_memory(start, {pattern.data(), pattern.size()});
+
+  auto& watch = proc->create_watchpoint(
+      buffer + std::int64_t{1500 * 4}, stoppoint_mode::read_write, 4, false);
+  watch.enable();
+  proc->resume();
+  REQUIRE(proc->wait_on_signal().trap_reason == trap_type::software_watch);
+  REQUIRE(proc->read_memory(start, pattern.size()) == pattern);
+}
+
+TEST_CASE("Batched writes fall back to ptrace only for protected pages", "[watchpoint]")
+{
+  bool      close_on_exec = false;
+  mdb::pipe channel(close_on_exec);
+  auto      proc = process::launch("targets/watched_buffer", true, channel.get_write());
+  channel.close_write();
+
+  proc->resume();
+  proc->wait_on_signal();
+  auto buffer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+  // The second page loses write access; the runs before, across and after it must all land
+  auto& watch = proc->create_watchpoint(
+      buffer + std::int64_t{1500 * 4}, stoppoint_mode::write, 4, false);
+  watch.enable();
+
+  std::vector<std::byte> pattern(300);
+  for (std::size_t i = 0; i < pattern.size(); ++i)
+  {
+    pattern[i] = static_cast<std::byte>(i + 1);
+  }
+  std::vector<std::pair<virt_addr, span<const std::byte>>> regions{
+      {buffer + std::int64_t{16}, {pattern.data(), 100}},
+      {buffer + std::int64_t{4096 - 50}, {pattern.data() + 100, 100}},
+      {buffer + std::int64_t{8192 - 100}, {pattern.data() + 200, 100}},
+  };
+  proc->write_memory_regions(regions);
+
+  for (auto& [address, data] : regions)
+  {
+    REQUIRE(proc->read_memory(address, data.size()) ==
+            std::vector<std::byte>(data.begin(), data.end()));
+  }
+}
+
+TEST_CASE("Software write watchpoints report stores of the same value", "[watchpoint]")
+{
+  bool      close_on_exec = false;
+  mdb::pipe channel(close_on_exec);
+  auto      proc = process::launch("targets/dirty_pages", true, channel.get_write());
+  channel.close_write();
+
+  proc->resume();
+  proc->wait_on_signal();
+  auto heap = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+  auto& watch = proc->create_watchpoint(heap + std::int64_t{7}, stoppoint_mode::write, 1, false);
+  watch.enable();
+  proc->resume();
+  REQUIRE(proc->wait_on_signal().trap_reason != trap_type::software_watch);
+
+  // heap[7] = heap[7]
+  proc->resume();
+  REQUIRE(proc->wait_on_signal().trap_reason == trap_type::software_watch);
+  REQUIRE(proc->get_current_software_watchpoint() == watch.id());
+  REQUIRE(watch.data() == 0);
+  REQUIRE(watch.hit_count() == 1);
+}
+
+TEST_CASE("Logging watchpoints record history without stopping", "[watchpoint]")
+{
+  bool      close_on_exec = false;
+  mdb::pipe channel(close_on_exec);
+  auto      proc = process::launch("targets/watched_buffer", true, channel.get_write());
+  channel.close_write();
+
+  proc->resume();
+  proc->wait_on_signal();
+
+  auto buffer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+  auto& write_64 = proc->create_watchpoint(buffer + std::int64_t{64 * 4}, stoppoint_mode::write, 4);
+  auto& reads    = proc->create_watchpoint(buffer, stoppoint_mode::read_write, 64 * 4, false);
+  write_64.start_logging();
+  reads.start_logging(8);
+  write_64.enable();
+  reads.enable();
+  REQUIRE_THROWS_AS(reads.start_logging(0), error);
+
+  proc->resume();
+  auto reason = proc->wait_on_signal();
+  REQUIRE(reason.reason == process_state::exited);
+
+  auto writes = write_64.history();
+  REQUIRE(writes.size() == 1);
+  REQUIRE(writes[0].tid == proc->pid());
+  REQUIRE(writes[0].old_value == 0);
+  REQUIRE(writes[0].new_value == 64);
+
+  REQUIRE(reads.hit_count() == 65);
+  REQUIRE(reads.history().size() == 8);
+  REQUIRE(reads.dropped_records() == 57);
+  REQUIRE(reads.history().front().timestamp <= reads.history().back().timestamp);
+}
+
+TEST_CASE("Region watches report what changed between stops", "[memory]")
+{
+  bool      close_on_exec = false;
+  mdb::pipe channel(close_on_exec);
+  auto      proc = process::launch("targets/dirty_pages", true, channel.get_write());
+  channel.close_write();
+
+  proc->resume();
+  proc->wait_on_signal();
+
+  auto  heap  = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+  auto& watch = proc->create_region_watch(heap, 64 * 4096);
+  watch.enable();
+  auto soft_dirty = region_watch::soft_dirty_supported();
+
+  proc->resume();
+  proc->wait_on_signal();
+
+  auto changes = watch.changes();
+  REQUIRE(changes.size() == 2);
+  REQUIRE(changes[0].address == heap + std::int64_t{5 * 4096 + 100});
+  REQUIRE(changes[0].old_data == std::vector<std::byte>(2));
+  REQUIRE(changes[0].new_data == std::vector<std::byte>{std::byte{1}, std::byte{2}});
+  REQUIRE(changes[1].address == heap + std::int64_t{40 * 4096 + 4095});
+  REQUIRE(changes[1].new_data == std::vector<std::byte>{std::byte{3}, std::byte{4}});
+  REQUIRE(watch.last_compared_pages() == (soft_dirty ? 3 : 64));
+
+  proc->resume();
+  proc->wait_on_signal();
+
+  REQUIRE(watch.changes().empty());
+  REQUIRE(watch.last_compared_pages() == (soft_dirty ? 1 : 64));
+}
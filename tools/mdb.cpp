@@ -9,14 +9,21 @@
 
 #include <algorithm>
 #include <charconv>
+#include <chrono>
 #include <csignal>
+#include <cstring>
 #include <iostream>
+#include <libmdb/call_tracer.hpp>
 #include <libmdb/disassembler.hpp>
 #include <libmdb/error.hpp>
+#include <libmdb/execution_log.hpp>
+#include <libmdb/instruction_trace.hpp>
 #include <libmdb/parse.hpp>
 #include <libmdb/process.hpp>
 #include <libmdb/syscalls.hpp>
 #include <libmdb/target.hpp>
+#include <limits>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -24,13 +31,35 @@
 
 namespace
 {
-mdb::process* g_mdb_process = nullptr;
+mdb::process*                       g_mdb_process = nullptr;
+const mdb::target*                  g_mdb_target  = nullptr;
+std::unique_ptr<mdb::call_tracer>   g_call_tracer;
+std::unique_ptr<mdb::execution_log> g_execution_log;
 
 void handle_sigint(int)
 {
   kill(g_mdb_process->pid(), SIGSTOP);
 }
 
+// The tracer's hooks live in the target's process, so every path that ends or replaces the
+// process closes the trace first
+void close_call_trace()
+{
+  if (!g_call_tracer)
+  {
+    return;
+  }
+  try
+  {
+    g_call_tracer->finish();
+  }
+  catch (const mdb::error& err)
+  {
+    std::cout << err.what() << '\n';
+  }
+  g_call_tracer.reset();
+}
+
 std::unique_ptr<mdb::target> attach(int argc, const char** argv)
 {
   // Passing PID
@@ -80,6 +109,21 @@ bool is_prefix(std::string_view str, std::string_view of)
   return std::equal(str.begin(), str.end(), of.begin());
 }
 
+template <class Stoppoint>
+std::string describe_hardware_placement(const Stoppoint& point)
+{
+  std::string placement = "hardware";
+  if (point.is_enabled() and !point.uses_debug_register())
+  {
+    placement += " (in software, registers full)";
+  }
+  if (point.is_pinned())
+  {
+    placement += ", pinned";
+  }
+  return placement;
+}
+
 std::string get_sigtrap_info(const mdb::process& process, mdb::stop_reason reason)
 {
   if (reason.trap_reason == mdb::trap_type::software_break)
@@ -87,17 +131,26 @@ std::string get_sigtrap_info(const mdb::process& process, mdb::stop_reason reaso
     auto& site = process.breakpoint_sites().get_by_address(process.get_pc());
     return fmt::format(" (breakpoint {})", site.id());
   }
-  if (reason.trap_reason == mdb::trap_type::hardware_break)
+  if (reason.trap_reason == mdb::trap_type::hardware_break or
+      reason.trap_reason == mdb::trap_type::software_watch)
   {
-    auto id = process.get_current_hardware_stoppoint();
-
-    if (id.index() == 0)
+    mdb::watchpoint::id_type watch_id;
+    if (reason.trap_reason == mdb::trap_type::software_watch)
+    {
+      watch_id = process.get_current_software_watchpoint();
+    }
+    else
     {
-      return fmt::format(" (breakpoint {})", std::get<0>(id));
+      auto id = process.get_current_hardware_stoppoint();
+      if (id.index() == 0)
+      {
+        return fmt::format(" (breakpoint {})", std::get<0>(id));
+      }
+      watch_id = std::get<1>(id);
     }
 
     std::string message;
-    auto&       point = process.watchpoints().get_by_id(std::get<1>(id));
+    auto&       point = process.watchpoints().get_by_id(watch_id);
     message += fmt::format(" (watchpoint {})", point.id());
 
     if (point.data() == point.previous_data())
@@ -140,16 +193,31 @@ std::string get_sigtrap_info(const mdb::process& process, mdb::stop_reason reaso
   return "";
 }
 
+std::optional<std::string> get_function_name(const mdb::target& target, mdb::virt_addr address)
+{
+  auto obj = target.get_elves().get_elf_containing_address(address);
+  if (!obj)
+  {
+    return std::nullopt;
+  }
+
+  auto func = obj->get_symbol_containing_address(address);
+  if (!func or ELF64_ST_TYPE(func.value()->st_info) != STT_FUNC)
+  {
+    return std::nullopt;
+  }
+  return obj->get_demangled_name(*func.value());
+}
+
 std::string get_signal_stop_reason(const mdb::target& target, mdb::stop_reason reason)
 {
   auto&       process = target.get_process();
   std::string message = fmt::format(
       "stopped with signal {} at {:#x}", sigabbrev_np(reason.info), process.get_pc().addr());
 
-  auto func = target.get_elf().get_symbol_containing_address(process.get_pc());
-  if (func and ELF64_ST_TYPE(func.value()->st_info) == STT_FUNC)
+  if (auto name = get_function_name(target, process.get_pc()))
   {
-    message += fmt::format(" ({})", target.get_elf().get_string(func.value()->st_name));
+    message += fmt::format(" ({})", *name);
   }
 
   if (reason.info == SIGTRAP)
@@ -211,17 +279,37 @@ void print_help(const std::vector<std::string>& args)
   if (args.size() == 1)
   {
     std::cerr << R"(Available commands:
-    breakpoint  - Commands for operating on breakpoints
-    continue    - Resume the process
-    disassemble - Disassemble machine code to assembly
-    memory      - Commands for operating on memory
-    register    - Commands for operating on registers
-    step        - Step over a single instruction
-    watchpoint  - Commands for operating on watchpoints
-    catchpoint  - Commands for operating on catchpoints
+    breakpoint       - Commands for operating on breakpoints
+    continue         - Resume the process
+    disassemble      - Disassemble machine code to assembly
+    memory           - Commands for operating on memory
+    register         - Commands for operating on registers
+    step             - Step a single instruction, or over and out of calls
+    watchpoint       - Commands for operating on watchpoints
+    catchpoint       - Commands for operating on catchpoints
+    trace            - Commands for tracing function calls
+    logpoint         - Print a formatted message whenever an address is hit
+    tracepoint       - Commands for operating on non-stopping tracepoints
+    record           - Record an instruction trace, or history for reverse execution
+    reverse-step     - Step one instruction backwards through recorded history
+    reverse-continue - Run backwards to the previous breakpoint or watchpoint write
+    checkpoint       - Commands for forked checkpoints of the process
+    restart          - Continue debugging from a checkpoint
+    symbols          - List symbol names containing some text
+    libraries        - List the loaded executable and shared libraries
 )";
   }
 
+  else if (is_prefix(args[1], "step"))
+  {
+    std::cerr << R"(Available commands:
+    step
+    step over
+    step out
+    step -n <number of instructions>
+    step until <address>
+)";
+  }
   else if (is_prefix(args[1], "register"))
   {
     std::cerr << R"(Available commands:
@@ -238,8 +326,13 @@ void print_help(const std::vector<std::string>& args)
     delete <id>
     disable <id>
     enable <id>
-    set <address>
-    set <address> -h
+    set <address or function>
+    set <address or function> -h
+    set <address or function> [-h] if <expression>
+    ignore <id> <number of hits>
+    limit <id> <number of hits, 0 for none>
+    pin <id>
+    unpin <id>
     )";
   }
   else if (is_prefix(args[1], "memory"))
@@ -248,6 +341,9 @@ void print_help(const std::vector<std::string>& args)
     read <address>
     read <address>> <number of bytes> 
     write <address> <bytes>
+    track <address> <number of bytes>
+    changes <id>
+    untrack <id>
     )";
   }
   else if (is_prefix(args[1], "disassemble"))
@@ -264,7 +360,12 @@ void print_help(const std::vector<std::string>& args)
     delete <id>
     disable <id>
     enable <id>
-    set <address> <write|rw|execute> <size>
+    set <address> <write|rw|execute> <size> [-s]
+    pin <id>
+    unpin <id>
+    log <id> [history size]
+    nolog <id>
+    history <id>
     )";
   }
   else if (is_prefix(args[1], "catchpoint"))
@@ -275,6 +376,54 @@ void print_help(const std::vector<std::string>& args)
     syscall <list of syscall IDs or names>
     )";
   }
+  else if (is_prefix(args[1], "trace"))
+  {
+    std::cerr << R"(Available commands:
+    open <file>
+    open <file> <number of arguments>
+    function <name or address>
+    close
+    )";
+  }
+  else if (is_prefix(args[1], "tracepoint"))
+  {
+    std::cerr << R"(Available commands:
+    list
+    dump
+    delete <id>
+    disable <id>
+    enable <id>
+    set <address or function>
+    )";
+  }
+  else if (is_prefix(args[1], "record"))
+  {
+    std::cerr << R"(Available commands:
+    record start
+    record stop
+    record info
+    record <file> -n <number of instructions>
+    record <file> until <address>
+    record show <file> [<first instruction>] [<number of instructions>]
+    )";
+  }
+  else if (is_prefix(args[1], "checkpoint") or is_prefix(args[1], "restart"))
+  {
+    std::cerr << R"(Available commands:
+    checkpoint
+    checkpoint list
+    checkpoint delete <id>
+    restart <id>
+    )";
+  }
+  else if (is_prefix(args[1], "logpoint"))
+  {
+    std::cerr << R"(Usage:
+    logpoint <address or function> "<format>" [, <expression>]...
+Placeholders: {} {:d} {:x} {:#x}
+Expressions: registers, constants, + - * (load), u8/u16/u32/u64[<address>]
+    )";
+  }
   else
   {
     std::cerr << "No help available on that\n";
@@ -424,8 +573,34 @@ void handle_register_command(mdb::process& process, const std::vector<std::strin
   }
 }
 
-void handle_breakpoint_command(mdb::process& process, const std::vector<std::string>& args)
+mdb::virt_addr resolve_function(const mdb::target& target, std::string_view text)
 {
+  if (text.size() > 2 and text[0] == '0' and text[1] == 'x')
+  {
+    auto address = mdb::to_integral<std::uint64_t>(text, 16);
+    if (!address)
+      mdb::error::send("Invalid address format");
+    return mdb::virt_addr{*address};
+  }
+
+  std::optional<mdb::virt_addr> found;
+  target.get_elves().for_each(
+      [&](const mdb::elf& elf)
+      {
+        for (auto symbol : elf.get_symbols_by_name(text))
+        {
+          if (!found and ELF64_ST_TYPE(symbol->st_info) == STT_FUNC and symbol->st_value != 0)
+            found = mdb::file_addr{elf, symbol->st_value}.to_virt_addr();
+        }
+      });
+  if (!found)
+    mdb::error::send("No function named " + std::string(text));
+  return *found;
+}
+
+void handle_breakpoint_command(mdb::target& target, const std::vector<std::string>& args)
+{
+  auto& process = target.get_process();
   if (args.size() < 2)
   {
     print_help({"help", "breakpoint"});
@@ -436,7 +611,9 @@ void handle_breakpoint_command(mdb::process& process, const std::vector<std::str
 
   if (is_prefix(command, "list"))
   {
-    if (process.breakpoint_sites().empty())
+    bool any_set = !target.pending_breakpoints().empty();
+    process.breakpoint_sites().for_each([&](auto& bp) { any_set |= !bp.is_internal(); });
+    if (!any_set)
     {
       fmt::print("No breakpoints set\n");
     }
@@ -450,12 +627,24 @@ void handle_breakpoint_command(mdb::process& process, const std::vector<std::str
             {
               return;
             }
-            fmt::print("{}: address = {:#x}, {}\n",
+            fmt::print("{}: address = {:#x}, {}{}, hits = {}{}{}{}{}\n",
                        bp.id(),
                        bp.address().addr(),
-                       bp.is_enabled() ? "enabled" : "disabled");
+                       bp.is_enabled() ? "enabled" : "disabled",
+                       bp.is_hardware() ? ", " + describe_hardware_placement(bp) : "",
+                       bp.hit_count(),
+                       bp.ignore_count() ? fmt::format(", ignoring {}", bp.ignore_count()) : "",
+                       bp.hits_until_disable()
+                           ? fmt::format(", disables after {}", *bp.hits_until_disable())
+                           : "",
+                       bp.auto_continues() ? ", continues" : "",
+                       bp.condition() ? " if " + bp.condition()->text() : "");
           });
     }
+    for (auto& pending : target.pending_breakpoints())
+    {
+      fmt::print("pending: {}{}\n", pending.name, pending.is_hardware ? ", hardware" : "");
+    }
 
     return;
   }
@@ -468,18 +657,11 @@ void handle_breakpoint_command(mdb::process& process, const std::vector<std::str
 
   if (is_prefix(command, "set"))
   {
-    auto address = mdb::to_integral<std::uint64_t>(args[2], 16);
-
-    if (!address)
-    {
-      fmt::print(stderr, "Breakpoint command expects address in hexadecimal, prefixed with '0x'\n");
-      return;
-    }
-
+    auto if_pos   = std::find(args.begin() + 3, args.end(), "if");
     bool hardware = false;
-    if (args.size() == 4)
+    for (auto it = args.begin() + 3; it != if_pos; ++it)
     {
-      if (args[3] == "-h")
+      if (*it == "-h")
       {
         hardware = true;
       }
@@ -489,7 +671,28 @@ void handle_breakpoint_command(mdb::process& process, const std::vector<std::str
       }
     }
 
-    process.create_breakpoint_site(mdb::virt_addr{*address}, hardware).enable();
+    std::optional<mdb::expression> condition;
+    if (if_pos != args.end())
+    {
+      condition =
+          mdb::expression::compile(fmt::format("{}", fmt::join(if_pos + 1, args.end(), " ")));
+    }
+
+    if (args[2].size() > 2 and args[2][0] == '0' and args[2][1] == 'x')
+    {
+      auto& site = process.create_breakpoint_site(resolve_function(target, args[2]), hardware);
+      site.set_condition(std::move(condition));
+      site.enable();
+      return;
+    }
+
+    auto n_pending = target.pending_breakpoints().size();
+    target.create_function_breakpoint(
+        args[2], hardware, [condition](auto& site) { site.set_condition(condition); });
+    if (target.pending_breakpoints().size() > n_pending)
+    {
+      fmt::print("No loaded object defines {}, breakpoint pending\n", args[2]);
+    }
     return;
   }
 
@@ -500,7 +703,30 @@ void handle_breakpoint_command(mdb::process& process, const std::vector<std::str
     return;
   }
 
-  if (is_prefix(command, "enable"))
+  if (is_prefix(command, "ignore") or is_prefix(command, "limit"))
+  {
+    auto count = args.size() == 4 ? mdb::to_integral<std::uint64_t>(args[3]) : std::nullopt;
+    if (!count)
+    {
+      print_help({"help", "breakpoint"});
+      return;
+    }
+
+    auto& site = process.breakpoint_sites().get_by_id(*id);
+    if (is_prefix(command, "ignore"))
+    {
+      site.set_ignore_count(*count);
+    }
+    else
+    {
+      site.disable_after(*count == 0 ? std::nullopt : count);
+    }
+  }
+  else if (is_prefix(command, "pin") or is_prefix(command, "unpin"))
+  {
+    process.breakpoint_sites().get_by_id(*id).set_pinned(is_prefix(command, "pin"));
+  }
+  else if (is_prefix(command, "enable"))
   {
     process.breakpoint_sites().get_by_id(*id).enable();
   }
@@ -555,6 +781,49 @@ void handle_memory_write_command(mdb::process& process, const std::vector<std::s
   process.write_memory(mdb::virt_addr{*address}, {data.data(), data.size()});
 }
 
+void handle_memory_track_command(mdb::process& process, const std::vector<std::string>& args)
+{
+  if (is_prefix(args[1], "track"))
+  {
+    auto address = mdb::to_integral<std::uint64_t>(args[2], 16);
+    auto size    = args.size() == 4 ? mdb::to_integral<std::size_t>(args[3]) : std::nullopt;
+    if (!address or !size)
+    {
+      print_help({"help", "memory"});
+      return;
+    }
+
+    auto& watch = process.create_region_watch(mdb::virt_addr{*address}, *size);
+    watch.enable();
+    fmt::print("Tracking region {}\n", watch.id());
+    return;
+  }
+
+  auto id = mdb::to_integral<mdb::region_watch::id_type>(args[2]);
+  if (!id)
+  {
+    std::cerr << "Command expects region id";
+    return;
+  }
+
+  if (is_prefix(args[1], "untrack"))
+  {
+    process.region_watches().remove_by_id(*id);
+    return;
+  }
+
+  auto& watch   = process.region_watches().get_by_id(*id);
+  auto  changes = watch.changes();
+  for (auto& change : changes)
+  {
+    fmt::print("{:#016x}: {:02x} -> {:02x}\n",
+               change.address.addr(),
+               fmt::join(change.old_data, " "),
+               fmt::join(change.new_data, " "));
+  }
+  fmt::print("{} changes in {} compared pages\n", changes.size(), watch.last_compared_pages());
+}
+
 void handle_memory_command(mdb::process& process, const std::vector<std::string>& args)
 {
   if (args.size() < 3)
@@ -570,6 +839,11 @@ void handle_memory_command(mdb::process& process, const std::vector<std::string>
   {
     handle_memory_write_command(process, args);
   }
+  else if (is_prefix(args[1], "track") or is_prefix(args[1], "changes") or
+           is_prefix(args[1], "untrack"))
+  {
+    handle_memory_track_command(process, args);
+  }
   else
   {
     print_help({"help", "memory"});
@@ -637,19 +911,22 @@ void handle_watchpoint_list(mdb::process& process, const std::vector<std::string
     process.watchpoints().for_each(
         [&](auto& point)
         {
-          fmt::print("{}: address = {:#x}, mode = {}, size = {}, {}\n",
+          fmt::print("{}: address = {:#x}, mode = {}, size = {}, {}, {}{}\n",
                      point.id(),
                      point.address().addr(),
                      stoppoint_mode_to_string(point.mode()),
                      point.size(),
-                     point.is_enabled() ? "enabled" : "disabled");
+                     point.is_hardware() ? describe_hardware_placement(point) : "software",
+                     point.is_enabled() ? "enabled" : "disabled",
+                     point.is_logging() ? ", logging" : "");
         });
   }
 }
 
 void handle_watchpoint_set(mdb::process& process, const std::vector<std::string>& args)
 {
-  if (args.size() != 5)
+  bool software = args.size() == 6 and args[5] == "-s";
+  if (args.size() != 5 and !software)
   {
     print_help({"help", "watchpoint"});
     return;
@@ -673,11 +950,34 @@ void handle_watchpoint_set(mdb::process& process, const std::vector<std::string>
   else if (mode_text == "execute")
     mode = mdb::stoppoint_mode::execute;
 
-  process.create_watchpoint(mdb::virt_addr{*address}, mode, *size).enable();
+  process.create_watchpoint(mdb::virt_addr{*address}, mode, *size, !software).enable();
 }
 
-void handle_watchpoint_command(mdb::process& process, const std::vector<std::string>& args)
+void handle_watchpoint_history(const mdb::target& target, const mdb::watchpoint& point)
 {
+  auto history = point.history();
+  for (auto& record : history)
+  {
+    auto writer  = get_function_name(target, record.pc).value_or("??");
+    auto elapsed = std::chrono::duration<double>(record.timestamp - history.front().timestamp);
+
+    fmt::print("+{:.6f}s tid {} pc {:#x} ({}): {:#x} -> {:#x}\n",
+               elapsed.count(),
+               record.tid,
+               record.pc.addr(),
+               writer,
+               record.old_value,
+               record.new_value);
+  }
+  fmt::print("{} records, {} dropped, {} hits\n",
+             history.size(),
+             point.dropped_records(),
+             point.hit_count());
+}
+
+void handle_watchpoint_command(mdb::target& target, const std::vector<std::string>& args)
+{
+  auto& process = target.get_process();
   if (args.size() < 2)
   {
     print_help({"help", "watchpoint"});
@@ -711,7 +1011,30 @@ void handle_watchpoint_command(mdb::process& process, const std::vector<std::str
     return;
   }
 
-  if (is_prefix(command, "enable"))
+  if (is_prefix(command, "pin") or is_prefix(command, "unpin"))
+  {
+    process.watchpoints().get_by_id(*id).set_pinned(is_prefix(command, "pin"));
+  }
+  else if (is_prefix(command, "log"))
+  {
+    auto capacity = args.size() == 4 ? mdb::to_integral<std::size_t>(args[3])
+                                     : mdb::watchpoint::default_history_capacity;
+    if (!capacity)
+    {
+      print_help({"help", "watchpoint"});
+      return;
+    }
+    process.watchpoints().get_by_id(*id).start_logging(*capacity);
+  }
+  else if (is_prefix(command, "nolog"))
+  {
+    process.watchpoints().get_by_id(*id).stop_logging();
+  }
+  else if (is_prefix(command, "history"))
+  {
+    handle_watchpoint_history(target, process.watchpoints().get_by_id(*id));
+  }
+  else if (is_prefix(command, "enable"))
   {
     process.watchpoints().get_by_id(*id).enable();
   }
@@ -739,6 +1062,391 @@ void handle_catchpoint_command(mdb::process& process, const std::vector<std::str
   }
 }
 
+// Parses "-n <count>" or "until <address>"
+std::optional<std::pair<std::uint64_t, std::optional<mdb::virt_addr>>> parse_step_limit(
+    mdb::target& target, const std::string& kind, const std::string& value)
+{
+  if (kind == "-n")
+  {
+    auto count = mdb::to_integral<std::uint64_t>(value);
+    if (!count)
+    {
+      return std::nullopt;
+    }
+    return std::pair{*count, std::optional<mdb::virt_addr>{}};
+  }
+  return std::pair{std::numeric_limits<std::uint64_t>::max(),
+                   std::optional{resolve_function(target, value)}};
+}
+
+void handle_step_count_command(mdb::target& target, const std::vector<std::string>& args)
+{
+  auto limit = parse_step_limit(target, args[1], args[2]);
+  if (!limit)
+  {
+    print_help({"help", "step"});
+    return;
+  }
+
+  auto result = target.get_process().step_instructions(limit->first, limit->second);
+  fmt::print("Stepped {} instructions in {:.3f} ms ({:.0f} steps/s)\n",
+             result.steps,
+             std::chrono::duration<double, std::milli>(result.elapsed).count(),
+             result.steps_per_second());
+  handle_stop(target, result.reason);
+}
+
+void handle_record_command(mdb::target& target, const std::vector<std::string>& args)
+{
+  if (args.size() == 2 and is_prefix(args[1], "start"))
+  {
+    g_execution_log = std::make_unique<mdb::execution_log>(target.get_process());
+    return;
+  }
+  if (args.size() == 2 and is_prefix(args[1], "stop"))
+  {
+    g_execution_log.reset();
+    return;
+  }
+  if (args.size() == 2 and is_prefix(args[1], "info"))
+  {
+    if (!g_execution_log)
+    {
+      fmt::print("Not recording\n");
+      return;
+    }
+    fmt::print("Recorded {} instructions in {} KiB\n",
+               g_execution_log->size(),
+               g_execution_log->memory_usage() / 1024);
+    return;
+  }
+  if (args.size() >= 3 and args.size() <= 5 and is_prefix(args[1], "show"))
+  {
+    mdb::trace_reader reader(args[2]);
+    auto              first = mdb::to_integral<std::uint64_t>(args.size() > 3 ? args[3] : "0");
+    auto              count = mdb::to_integral<std::uint64_t>(args.size() > 4 ? args[4] : "20");
+    if (!first or !count)
+    {
+      print_help({"help", "record"});
+      return;
+    }
+
+    reader.seek(std::max(*first, reader.first_instruction()));
+    for (auto entry = reader.next(); entry and *count > 0; entry = reader.next(), --*count)
+    {
+      fmt::print("{:>10} {:#018x}", entry->instruction, entry->pc.addr());
+      for (auto& write : entry->writes)
+      {
+        fmt::print(" [{:#x}] = {:02x}", write.address.addr(), fmt::join(write.data, ""));
+      }
+      fmt::print("\n");
+    }
+    return;
+  }
+
+  if (args.size() != 4 or (args[2] != "-n" and !is_prefix(args[2], "until")))
+  {
+    print_help({"help", "record"});
+    return;
+  }
+  auto limit = parse_step_limit(target, args[2], args[3]);
+  if (!limit)
+  {
+    print_help({"help", "record"});
+    return;
+  }
+
+  mdb::trace_recorder recorder(target.get_process(), args[1]);
+  auto                result = recorder.record(limit->first, limit->second);
+  fmt::print("Recorded {} instructions into {} bytes of {}\n",
+             recorder.instructions(),
+             recorder.bytes_written(),
+             args[1]);
+  handle_stop(target, result.reason);
+}
+
+void handle_checkpoint_command(mdb::target& target, const std::vector<std::string>& args)
+{
+  auto& process = target.get_process();
+  if (args.size() == 1)
+  {
+    auto id = process.create_checkpoint();
+    fmt::print("Checkpoint {} is process {}\n", id, process.checkpoints().back().pid);
+    return;
+  }
+
+  if (is_prefix(args[1], "list"))
+  {
+    if (process.checkpoints().empty())
+    {
+      fmt::print("No checkpoints\n");
+    }
+    for (auto& point : process.checkpoints())
+    {
+      fmt::print("{}: process {}, pc {:#x}\n", point.id, point.pid, point.regs.rip);
+    }
+    return;
+  }
+
+  auto id = args.size() == 3 ? mdb::to_integral<mdb::checkpoint::id_type>(args[2]) : std::nullopt;
+  if (!id or !is_prefix(args[1], "delete"))
+  {
+    print_help({"help", "checkpoint"});
+    return;
+  }
+  process.delete_checkpoint(*id);
+}
+
+void handle_symbols_command(const mdb::target& target, const std::vector<std::string>& args)
+{
+  if (args.size() != 2)
+  {
+    std::cerr << "Command expects text to search for\n";
+    return;
+  }
+
+  constexpr std::size_t         max_listed = 100;
+  std::vector<std::string_view> names;
+  target.get_elves().for_each(
+      [&](const mdb::elf& elf)
+      {
+        auto found = elf.find_symbol_names_containing(args[1], max_listed + 1);
+        names.insert(names.end(), found.begin(), found.end());
+      });
+  std::sort(begin(names), end(names));
+  names.erase(std::unique(begin(names), end(names)), end(names));
+  for (std::size_t i = 0; i < std::min(names.size(), max_listed); ++i)
+  {
+    fmt::print("{}\n", names[i]);
+  }
+  if (names.size() > max_listed)
+  {
+    fmt::print("(more than {} matches)\n", max_listed);
+  }
+}
+
+void handle_libraries_command(const mdb::target& target)
+{
+  target.get_elves().for_each(
+      [](const mdb::elf& elf)
+      {
+        auto [low, high] = elf.loaded_range();
+        fmt::print("{:#018x}-{:#018x} {}\n", low.addr(), high.addr(), elf.path().string());
+      });
+}
+
+void handle_restart_command(mdb::target& target, const std::vector<std::string>& args)
+{
+  auto id = args.size() == 2 ? mdb::to_integral<mdb::checkpoint::id_type>(args[1]) : std::nullopt;
+  if (!id)
+  {
+    print_help({"help", "restart"});
+    return;
+  }
+
+  auto& process = target.get_process();
+  close_call_trace();
+  process.restore_checkpoint(*id);
+  // The copy may have had a different set of libraries loaded
+  target.reload_dynamic_libraries();
+  if (g_execution_log)
+  {
+    // The recorded history belongs to the process that was just discarded
+    g_execution_log = std::make_unique<mdb::execution_log>(process);
+  }
+  fmt::print("Restored checkpoint {} as process {}\n", *id, process.pid());
+  print_disassembly(process, process.get_pc(), 5);
+}
+
+void handle_trace_command(mdb::target& target, const std::vector<std::string>& args)
+{
+  if (args.size() < 2)
+  {
+    print_help({"help", "trace"});
+    return;
+  }
+
+  if (is_prefix(args[1], "open") and (args.size() == 3 or args.size() == 4))
+  {
+    std::size_t n_args = 0;
+    if (args.size() == 4)
+    {
+      auto opt_n = mdb::to_integral<std::size_t>(args[3]);
+      if (!opt_n)
+        mdb::error::send("Invalid number of arguments");
+      n_args = *opt_n;
+    }
+    close_call_trace();
+    g_call_tracer = std::make_unique<mdb::call_tracer>(target.get_process(), args[2], n_args);
+  }
+  else if (is_prefix(args[1], "function") and args.size() == 3)
+  {
+    if (!g_call_tracer)
+      mdb::error::send("No trace file open");
+    auto id = g_call_tracer->trace_function(resolve_function(target, args[2]), args[2]);
+    fmt::print("Tracing {} as function {}\n", args[2], id);
+  }
+  else if (is_prefix(args[1], "close"))
+  {
+    if (g_call_tracer)
+    {
+      fmt::print("Wrote {} events\n", g_call_tracer->event_count());
+    }
+    close_call_trace();
+  }
+  else
+  {
+    print_help({"help", "trace"});
+  }
+}
+
+std::string parse_quoted(std::string_view& text)
+{
+  if (text.empty() or text[0] != '"')
+    mdb::error::send("Expected quoted format string");
+
+  std::string ret;
+  std::size_t i = 1;
+  for (; i < text.size() and text[i] != '"'; ++i)
+  {
+    if (text[i] != '\\' or i + 1 == text.size())
+    {
+      ret += text[i];
+      continue;
+    }
+
+    switch (text[++i])
+    {
+      case 'n':
+        ret += '\n';
+        break;
+      case 't':
+        ret += '\t';
+        break;
+      default:
+        ret += text[i];
+        break;
+    }
+  }
+
+  if (i == text.size())
+    mdb::error::send("Unterminated format string");
+  text.remove_prefix(i + 1);
+  return ret;
+}
+
+void handle_logpoint_command(mdb::target& target, std::string_view line)
+{
+  auto args = split(line, ' ');
+  if (args.size() < 3)
+  {
+    print_help({"help", "logpoint"});
+    return;
+  }
+
+  auto address = resolve_function(target, args[1]);
+
+  auto rest = line.substr(line.find(args[1]) + args[1].size());
+  rest.remove_prefix(std::min(rest.find_first_not_of(' '), rest.size()));
+  auto format = parse_quoted(rest);
+
+  std::vector<std::string> expressions;
+  if (rest.find_first_not_of(' ') != std::string_view::npos)
+  {
+    expressions = split(rest, ',');
+    if (expressions[0].find_first_not_of(' ') != std::string::npos)
+      mdb::error::send("Expected ',' after format string");
+    expressions.erase(expressions.begin());
+  }
+
+  auto& site =
+      target.get_process().create_logpoint(address, mdb::logpoint::compile(format, expressions));
+  site.enable();
+  fmt::print("Logpoint {} set at {:#x}\n", site.id(), address.addr());
+}
+
+void handle_tracepoint_command(mdb::target& target, const std::vector<std::string>& args)
+{
+  if (args.size() < 2)
+  {
+    print_help({"help", "tracepoint"});
+    return;
+  }
+
+  auto& process = target.get_process();
+  auto  command = args[1];
+
+  if (is_prefix(command, "list"))
+  {
+    if (process.tracepoints().empty())
+    {
+      fmt::print("No tracepoints set\n");
+      return;
+    }
+    process.tracepoints().for_each(
+        [](auto& point)
+        {
+          fmt::print("{}: address = {:#x}, trampoline = {:#x}, {}\n",
+                     point.id(),
+                     point.address().addr(),
+                     point.trampoline().addr(),
+                     point.is_enabled() ? "enabled" : "disabled");
+        });
+    return;
+  }
+
+  if (is_prefix(command, "dump"))
+  {
+    auto& buffer = process.get_tracepoint_buffer();
+    auto  count  = buffer.drain(
+        [](auto& record)
+        {
+          fmt::print("{}: tsc = {}, rdi = {:#x}, rsi = {:#x}, rsp = {:#x}\n",
+                     record.tracepoint_id,
+                     record.timestamp,
+                     record.read(mdb::register_id::rdi),
+                     record.read(mdb::register_id::rsi),
+                     record.read(mdb::register_id::rsp));
+        });
+    fmt::print("{} records, {} dropped\n", count, buffer.dropped());
+    return;
+  }
+
+  if (args.size() < 3)
+  {
+    print_help({"help", "tracepoint"});
+    return;
+  }
+
+  if (is_prefix(command, "set"))
+  {
+    auto& point = target.create_tracepoint(resolve_function(target, args[2]));
+    point.enable();
+    fmt::print("Tracepoint {} set at {:#x}\n", point.id(), point.address().addr());
+    return;
+  }
+
+  auto id = mdb::to_integral<mdb::tracepoint::id_type>(args[2]);
+  if (!id)
+  {
+    std::cerr << "Command expects tracepoint id";
+    return;
+  }
+
+  if (is_prefix(command, "enable"))
+  {
+    process.tracepoints().get_by_id(*id).enable();
+  }
+  else if (is_prefix(command, "disable"))
+  {
+    process.tracepoints().get_by_id(*id).disable();
+  }
+  else if (is_prefix(command, "delete"))
+  {
+    process.tracepoints().remove_by_id(*id);
+  }
+}
+
 void handle_command(std::unique_ptr<mdb::target>& target, std::string_view line)
 {
   auto args    = split(line, ' ');
@@ -747,13 +1455,21 @@ void handle_command(std::unique_ptr<mdb::target>& target, std::string_view line)
 
   if (is_prefix(command, "quit"))
   {
+    close_call_trace();
     exit(0);
   }
   else if (is_prefix(command, "continue"))
   {
-    process->resume();
-    auto reason = process->wait_on_signal();
-    handle_stop(*target, reason);
+    if (g_execution_log)
+    {
+      handle_stop(*target, g_execution_log->resume());
+    }
+    else
+    {
+      process->resume();
+      auto reason = process->wait_on_signal();
+      handle_stop(*target, reason);
+    }
   }
   else if (is_prefix(command, "register"))
   {
@@ -765,16 +1481,39 @@ void handle_command(std::unique_ptr<mdb::target>& target, std::string_view line)
   }
   else if (is_prefix(command, "breakpoint"))
   {
-    handle_breakpoint_command(*process, args);
+    handle_breakpoint_command(*target, args);
   }
   else if (is_prefix(command, "watchpoint"))
   {
-    handle_watchpoint_command(*process, args);
+    handle_watchpoint_command(*target, args);
   }
   else if (is_prefix(command, "step"))
   {
-    auto reason = process->step_instruction();
-    handle_stop(*target, reason);
+    if (g_execution_log and args.size() > 1)
+    {
+      mdb::error::send("Only single steps are recorded; use record stop first");
+    }
+
+    if (g_execution_log)
+    {
+      handle_stop(*target, g_execution_log->step());
+    }
+    else if (args.size() > 1 and is_prefix(args[1], "over"))
+    {
+      handle_stop(*target, process->step_over());
+    }
+    else if (args.size() > 1 and is_prefix(args[1], "out"))
+    {
+      handle_stop(*target, process->step_out());
+    }
+    else if (args.size() == 3 and (args[1] == "-n" or is_prefix(args[1], "until")))
+    {
+      handle_step_count_command(*target, args);
+    }
+    else
+    {
+      handle_stop(*target, process->step_instruction());
+    }
   }
   else if (is_prefix(command, "memory"))
   {
@@ -788,14 +1527,101 @@ void handle_command(std::unique_ptr<mdb::target>& target, std::string_view line)
   {
     handle_catchpoint_command(*process, args);
   }
+  else if (is_prefix(command, "trace"))
+  {
+    handle_trace_command(*target, args);
+  }
+  else if (is_prefix(command, "tracepoint"))
+  {
+    handle_tracepoint_command(*target, args);
+  }
+  else if (is_prefix(command, "logpoint"))
+  {
+    handle_logpoint_command(*target, line);
+  }
+  else if (is_prefix(command, "record"))
+  {
+    handle_record_command(*target, args);
+  }
+  else if (is_prefix(command, "checkpoint"))
+  {
+    handle_checkpoint_command(*target, args);
+  }
+  else if (is_prefix(command, "restart"))
+  {
+    handle_restart_command(*target, args);
+  }
+  else if (is_prefix(command, "symbols"))
+  {
+    handle_symbols_command(*target, args);
+  }
+  else if (is_prefix(command, "libraries"))
+  {
+    handle_libraries_command(*target);
+  }
+  else if (command == "reverse-step" or command == "reverse-continue")
+  {
+    if (!g_execution_log)
+    {
+      mdb::error::send("Nothing has been recorded; use record start");
+    }
+    auto reason = command == "reverse-step" ? g_execution_log->reverse_step()
+                                            : g_execution_log->reverse_continue();
+    handle_stop(*target, reason);
+    if (auto id = g_execution_log->last_watchpoint())
+    {
+      fmt::print("Watchpoint {} was written by this instruction\n", *id);
+    }
+  }
   else
   {
     std::cerr << "Unknown command\n";
   }
 }
 
+char* complete_symbol_name(const char* text, int state)
+{
+  constexpr std::size_t                max_completions = 1000;
+  static std::vector<std::string_view> matches;
+  static std::size_t                   next = 0;
+  if (state == 0)
+  {
+    // Names with spaces cannot be typed as a single argument
+    matches.clear();
+    g_mdb_target->get_elves().for_each(
+        [&](const mdb::elf& elf)
+        {
+          auto found = elf.find_symbol_names_with_prefix(text, max_completions);
+          matches.insert(matches.end(), found.begin(), found.end());
+        });
+    std::sort(begin(matches), end(matches));
+    matches.erase(std::unique(begin(matches), end(matches)), end(matches));
+    matches.erase(std::remove_if(begin(matches),
+                                 end(matches),
+                                 [](auto name) { return name.find(' ') != name.npos; }),
+                  end(matches));
+    next = 0;
+  }
+  return next < matches.size() ? strdup(std::string(matches[next++]).c_str()) : nullptr;
+}
+
+char** complete_argument(const char* text, int start, int)
+{
+  rl_attempted_completion_over = 1;
+  if (start == 0)
+  {
+    return nullptr;
+  }
+  return rl_completion_matches(text, complete_symbol_name);
+}
+
 void main_loop(std::unique_ptr<mdb::target>& target)
 {
+  // Demangled names contain the default break characters, such as '(' and '<'
+  static char word_break_characters[] = " \t\n";
+  rl_completer_word_break_characters  = word_break_characters;
+  rl_attempted_completion_function    = complete_argument;
+
   char* line = nullptr;
   while ((line = readline("mdb> ")) != nullptr)
   {
@@ -841,8 +1667,17 @@ int main(int argc, const char** argv)
 
   try
   {
-    auto target   = attach(argc, argv);
+    auto target = attach(argc, argv);
+    // Destroyed before the target, however main_loop is left
+    struct trace_closer
+    {
+      ~trace_closer()
+      {
+        close_call_trace();
+      }
+    } closer;
     g_mdb_process = &target->get_process();
+    g_mdb_target  = target.get();
     signal(SIGINT, handle_sigint);
     main_loop(target);
   }
@@ -0,0 +1,240 @@
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <iostream>
+#include <libmdb/call_tracer.hpp>
+#include <libmdb/error.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+struct call_node
+{
+  std::uint32_t                                       function_id = 0;
+  std::uint64_t                                       calls       = 0;
+  std::uint64_t                                       inclusive   = 0;
+  std::uint64_t                                       exclusive   = 0;
+  std::map<std::uint32_t, std::unique_ptr<call_node>> children;
+};
+
+struct function_stats
+{
+  std::uint64_t calls     = 0;
+  std::uint64_t inclusive = 0;
+  std::uint64_t exclusive = 0;
+};
+
+struct open_frame
+{
+  call_node*    node;
+  std::uint64_t entry_time;
+  std::uint64_t child_time;
+};
+
+struct thread_state
+{
+  call_node                                      root;
+  std::vector<open_frame>                        stack;
+  std::unordered_map<std::uint32_t, std::size_t> active;
+};
+
+class call_profile
+{
+ public:
+  explicit call_profile(const mdb::call_trace& trace) : trace_(&trace)
+  {
+    std::uint64_t last_time = 0;
+    for (auto& event : trace.events())
+    {
+      auto& thread = threads_[event.tid];
+      if (event.kind == mdb::call_event_kind::entry)
+      {
+        enter(thread, event.function_id, event.timestamp);
+      }
+      else
+      {
+        leave(thread, event.function_id, event.timestamp);
+      }
+      last_time = event.timestamp;
+    }
+
+    for (auto& [tid, thread] : threads_)
+    {
+      while (!thread.stack.empty())
+      {
+        close_frame(thread, last_time);
+      }
+    }
+  }
+
+  void print_tree() const
+  {
+    fmt::print("{:>12}  {:>8}  {}\n", "total", "calls", "call tree");
+    for (auto& [tid, thread] : threads_)
+    {
+      fmt::print("thread {}\n", tid);
+      for (auto child : sorted_children(thread.root))
+      {
+        print_node(*child, 1);
+      }
+    }
+  }
+
+  void print_functions() const
+  {
+    std::vector<std::pair<std::uint32_t, function_stats>> rows(begin(functions_), end(functions_));
+    std::sort(begin(rows),
+              end(rows),
+              [](auto& lhs, auto& rhs) { return lhs.second.exclusive > rhs.second.exclusive; });
+
+    fmt::print("{:>12}  {:>12}  {:>8}  {}\n", "inclusive", "exclusive", "calls", "function");
+    for (auto& [id, stats] : rows)
+    {
+      fmt::print("{:>12}  {:>12}  {:>8}  {}\n",
+                 format_duration(stats.inclusive),
+                 format_duration(stats.exclusive),
+                 stats.calls,
+                 function_name(id));
+    }
+  }
+
+ private:
+  void enter(thread_state& thread, std::uint32_t function_id, std::uint64_t time)
+  {
+    auto parent = thread.stack.empty() ? &thread.root : thread.stack.back().node;
+
+    auto& child = parent->children[function_id];
+    if (!child)
+    {
+      child              = std::make_unique<call_node>();
+      child->function_id = function_id;
+    }
+
+    thread.stack.push_back({child.get(), time, 0});
+    ++thread.active[function_id];
+  }
+
+  void leave(thread_state& thread, std::uint32_t function_id, std::uint64_t time)
+  {
+    auto matches = [=](auto& frame) { return frame.node->function_id == function_id; };
+    if (std::none_of(begin(thread.stack), end(thread.stack), matches))
+    {
+      return;
+    }
+
+    while (!matches(thread.stack.back()))
+    {
+      close_frame(thread, time);
+    }
+    close_frame(thread, time);
+  }
+
+  void close_frame(thread_state& thread, std::uint64_t time)
+  {
+    auto frame = thread.stack.back();
+    thread.stack.pop_back();
+
+    auto duration = time - frame.entry_time;
+    auto self     = duration - std::min(duration, frame.child_time);
+    auto id       = frame.node->function_id;
+
+    frame.node->calls += 1;
+    frame.node->inclusive += duration;
+    frame.node->exclusive += self;
+
+    auto& stats = functions_[id];
+    stats.calls += 1;
+    stats.exclusive += self;
+    if (--thread.active[id] == 0)
+    {
+      stats.inclusive += duration;
+    }
+
+    if (!thread.stack.empty())
+    {
+      thread.stack.back().child_time += duration;
+    }
+  }
+
+  std::vector<const call_node*> sorted_children(const call_node& node) const
+  {
+    std::vector<const call_node*> ret;
+    for (auto& [id, child] : node.children)
+    {
+      ret.push_back(child.get());
+    }
+    std::sort(begin(ret),
+              end(ret),
+              [](auto lhs, auto rhs) { return lhs->inclusive > rhs->inclusive; });
+    return ret;
+  }
+
+  void print_node(const call_node& node, std::size_t depth) const
+  {
+    fmt::print("{:>12}  {:>8}  {:{}}{}\n",
+               format_duration(node.inclusive),
+               node.calls,
+               "",
+               depth * 2,
+               function_name(node.function_id));
+    for (auto child : sorted_children(node))
+    {
+      print_node(*child, depth + 1);
+    }
+  }
+
+  std::string function_name(std::uint32_t id) const
+  {
+    auto& names = trace_->function_names();
+    if (id < names.size() and !names[id].empty())
+    {
+      return names[id];
+    }
+    return fmt::format("#{}", id);
+  }
+
+  static std::string format_duration(std::uint64_t nanoseconds)
+  {
+    if (nanoseconds < 1'000)
+      return fmt::format("{} ns", nanoseconds);
+    if (nanoseconds < 1'000'000)
+      return fmt::format("{:.3f} us", static_cast<double>(nanoseconds) / 1e3);
+    if (nanoseconds < 1'000'000'000)
+      return fmt::format("{:.3f} ms", static_cast<double>(nanoseconds) / 1e6);
+    return fmt::format("{:.3f} s", static_cast<double>(nanoseconds) / 1e9);
+  }
+
+  const mdb::call_trace*                            trace_;
+  std::map<pid_t, thread_state>                     threads_;
+  std::unordered_map<std::uint32_t, function_stats> functions_;
+};
+}  // namespace
+
+int main(int argc, const char** argv)
+{
+  if (argc != 2)
+  {
+    std::cerr << "Usage: mdb_trace <trace file>\n";
+    return -1;
+  }
+
+  try
+  {
+    mdb::call_trace trace(argv[1]);
+    fmt::print("{} events, {} functions\n\n", trace.events().size(), trace.function_names().size());
+
+    call_profile profile(trace);
+    profile.print_tree();
+    fmt::print("\n");
+    profile.print_functions();
+  }
+  catch (const mdb::error& err)
+  {
+    std::cout << err.what() << '\n';
+    return -1;
+  }
+}